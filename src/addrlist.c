@@ -194,3 +194,26 @@ void clear_address_range_list(address_range_list *list) {
   list->first = NULL;
   list->last = NULL;
 }
+
+/** Rebuild an address bitmap so that it matches an address range list. */
+void build_address_bitmap(address_range_list *list, address_bitmap *bitmap) {
+  address_range_node *current = NULL;
+  unsigned long a;
+
+  if (bitmap == NULL) return;
+  memset(bitmap->bits, 0, sizeof(bitmap->bits));
+  if (list == NULL) return;
+  current = list->first;
+  while (current != NULL) {
+    for (a = current->range.start; a <= current->range.end; a++) {
+      bitmap->bits[a >> 3] |= (byte)(1 << (a & 0x07));
+    }
+    current = current->next;
+  }
+}
+
+/** Check if an address is set in an address bitmap. */
+bool is_address_in_bitmap(address_bitmap *bitmap, address a) {
+  if (bitmap == NULL) return FALSE;
+  return (bitmap->bits[a >> 3] >> (a & 0x07)) & 0x01;
+}
@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "vtypes.h"
 
 typedef struct addrr {
@@ -52,11 +53,24 @@ typedef struct addrrlist {
   address_range_node *last;
 } address_range_list;
 
+#define ADDRESS_BITMAP_BYTES 0x2000
+
+/**
+ * A compiled form of an address range list with one bit per address.
+ * Lookups take constant time, but the bitmap must be rebuilt with
+ * build_address_bitmap() whenever the list changes.
+ */
+typedef struct addrrbitmap {
+  byte bits[ADDRESS_BITMAP_BYTES];
+} address_bitmap;
+
 void init_address_range_list(address_range_list *list);
 void add_address_range(address_range_list *list, address_range ar);
 void remove_address_range(address_range_list *list, address_range ar);
 bool is_address_in_range(address_range ar, address a);
 bool is_address_in_range_list(address_range_list *list, address a);
 void clear_address_range_list(address_range_list *list);
+void build_address_bitmap(address_range_list *list, address_bitmap *bitmap);
+bool is_address_in_bitmap(address_bitmap *bitmap, address a);
 
 #endif /* _ADDRLIST_H_ */
@@ -25,10 +25,12 @@
  */
 
 #include "devices.h"
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/select.h>
 
 /*
@@ -69,13 +71,51 @@ acia_t *acia_create(FILE *in, FILE *out) {
 
     dev->input = in;
     dev->output = out;
+    dev->tx_head = 0;
+    dev->tx_count = 0;
+    dev->tx_dropped = 0;
+    dev->tx_flush_newline = 1;
+    dev->rx_head = 0;
+    dev->rx_count = 0;
+    dev->rx_lost = 0;
+    dev->rx_fifo_enabled = 1;
+    dev->input_eof = 0;
+    dev->timing = 0;
+    dev->clock_hz = ACIA_DEFAULT_CLOCK_HZ;
+    dev->clock = 0;
+    dev->tx_data = 0x00;
+    dev->tx_full = 0;
+    dev->tx_busy_until = 0;
+    dev->tx_overwritten = 0;
+    dev->rx_next = 0;
     acia_reset(dev);
 
     return dev;
 }
 
+/*
+ * Copy an ACIA. The copy shares the host input and output files.
+ * Output still buffered in dev is flushed first so it is not written
+ * twice.
+ */
+acia_t *acia_clone(acia_t *dev) {
+    acia_t *copy;
+
+    if (dev == NULL) return NULL;
+    copy = (acia_t *)malloc(sizeof(acia_t));
+    if (copy == NULL) return NULL;
+
+    acia_flush(dev);
+    *copy = *dev;
+    copy->tx_head = 0;
+    copy->tx_count = 0;
+
+    return copy;
+}
+
 void acia_destroy(acia_t *dev) {
     if (dev != NULL) {
+        acia_flush(dev);
         free(dev);
     }
 }
@@ -87,43 +127,199 @@ void acia_reset(acia_t *dev) {
     dev->control = 0x00;
     dev->rx_data = 0x00;
     dev->rx_full = 0;
+    dev->rx_overrun = 0;
+}
+
+/* Baud rates selected by the control register, in hundredths of a baud */
+static const unsigned long acia_baud_x100[16] = {
+    0, 5000, 7500, 10992, 13458, 15000, 30000, 60000,
+    120000, 180000, 240000, 360000, 480000, 720000, 960000, 1920000
+};
+
+/*
+ * Number of cycles one frame takes at the configured baud rate and
+ * word format, or 0 when the external clock is selected.
+ */
+unsigned long acia_frame_cycles(acia_t *dev) {
+    unsigned long baud;
+    unsigned long bits;
+
+    if (dev == NULL) return 0;
+    baud = acia_baud_x100[dev->control & ACIA_CTRL_BAUD];
+    if (baud == 0) return 0;
+
+    /* Start bit, 8 down to 5 data bits, parity and stop bits */
+    bits = 1 + (8 - ((dev->control & ACIA_CTRL_WL) >> 5));
+    if (dev->command & ACIA_CMD_PME) bits++;
+    bits += (dev->control & ACIA_CTRL_SBN) ? 2 : 1;
+
+    return (unsigned long)((double)dev->clock_hz * bits * 100.0 / baud + 0.5);
+}
+
+/* Check if the timing model applies to this ACIA right now. */
+static int _acia_timed(acia_t *dev) {
+    return dev->timing && acia_frame_cycles(dev) > 0;
+}
+
+/* Queue a byte for the host, flushing as needed. */
+static void _acia_tx_queue(acia_t *dev, byte value) {
+    if (dev->output == NULL) return;
+
+    if (V6502C_VERBOSE) {
+        fprintf(stderr, "[TX: %02X '%c']\n", value,
+            (value >= 32 && value < 127) ? value : '.');
+    }
+    if (dev->tx_count == ACIA_TX_BUFFER_SIZE) {
+        acia_flush(dev);
+    }
+    if (dev->tx_count == ACIA_TX_BUFFER_SIZE) {
+        /* The output cannot take any more, drop the byte */
+        dev->tx_dropped++;
+    } else {
+        dev->tx_buffer[(dev->tx_head + dev->tx_count) % ACIA_TX_BUFFER_SIZE] = value;
+        dev->tx_count++;
+    }
+    if (dev->tx_flush_newline && (value == '\n' || value == '\r')) {
+        acia_flush(dev);
+    }
+}
+
+/*
+ * Move the oldest byte in the FIFO into an empty data register. With
+ * timing on, acia_sync() does this when the byte has arrived.
+ */
+static void _acia_rx_refill(acia_t *dev) {
+    if (dev->rx_full || dev->rx_count == 0 || _acia_timed(dev)) return;
+    dev->rx_data = dev->rx_fifo[dev->rx_head];
+    dev->rx_head = (dev->rx_head + 1) % ACIA_RX_FIFO_SIZE;
+    dev->rx_count--;
+    dev->rx_full = 1;
+}
+
+/*
+ * Receive a byte from the line. It goes into the data register if that
+ * is empty, otherwise into the FIFO. With the FIFO disabled or full the
+ * byte is lost and an overrun is flagged. With timing on, the byte is
+ * queued and arrives one frame after the byte before it.
+ */
+void acia_receive(acia_t *dev, byte value) {
+    count_t arrival;
+
+    if (dev == NULL) return;
+
+    if (V6502C_VERBOSE) {
+        fprintf(stderr, "[RX: %02X '%c']\n", value,
+            (value >= 32 && value < 127) ? value : '.');
+    }
+
+    if (_acia_timed(dev)) {
+        if (dev->rx_count == ACIA_RX_FIFO_SIZE) {
+            dev->rx_overrun = 1;
+            dev->rx_lost++;
+            return;
+        }
+        if (dev->rx_count == 0) {
+            /* The line was idle, the start bit goes out now */
+            arrival = dev->clock + acia_frame_cycles(dev);
+            if (dev->rx_next < arrival) dev->rx_next = arrival;
+        }
+        dev->rx_fifo[(dev->rx_head + dev->rx_count) % ACIA_RX_FIFO_SIZE] = value;
+        dev->rx_count++;
+        return;
+    }
+
+    _acia_rx_refill(dev);
+    if (!dev->rx_full) {
+        dev->rx_data = value;
+        dev->rx_full = 1;
+    } else if (dev->rx_fifo_enabled && dev->rx_count < ACIA_RX_FIFO_SIZE) {
+        dev->rx_fifo[(dev->rx_head + dev->rx_count) % ACIA_RX_FIFO_SIZE] = value;
+        dev->rx_count++;
+    } else {
+        dev->rx_overrun = 1;
+        dev->rx_lost++;
+    }
+}
+
+/*
+ * Read whatever input is waiting, up to the free space in the FIFO and
+ * at most size bytes, with a single read(). The bytes are not received
+ * yet, pass them to acia_receive(). Returns the number of bytes read.
+ */
+int acia_read_input(acia_t *dev, byte *buffer, size_t size) {
+    size_t space;
+    ssize_t n;
+
+    if (dev == NULL || dev->input == NULL) return 0;
+
+    if (_acia_timed(dev)) {
+        /* Bytes wait in the FIFO until they have arrived */
+        space = ACIA_RX_FIFO_SIZE - dev->rx_count;
+    } else if (dev->rx_fifo_enabled) {
+        space = ACIA_RX_FIFO_SIZE - dev->rx_count + (dev->rx_full ? 0 : 1);
+    } else {
+        /* Everything that arrived is offered to the data register */
+        space = size;
+    }
+    if (space > size) space = size;
+    if (space == 0 || !input_available(dev->input)) return 0;
+
+    /* Use read() instead of fread() to avoid stdio buffering issues */
+    n = read(fileno(dev->input), buffer, space);
+    if (n == 0) dev->input_eof = 1;
+    return n > 0 ? (int)n : 0;
+}
+
+/* Read waiting input and receive it. Returns the number of bytes read. */
+int acia_pump(acia_t *dev) {
+    byte buffer[ACIA_RX_FIFO_SIZE];
+    int n;
+    int i;
+
+    n = acia_read_input(dev, buffer, sizeof(buffer));
+    for (i = 0; i < n; i++) {
+        acia_receive(dev, buffer[i]);
+    }
+    return n;
 }
 
 byte acia_read(acia_t *dev, byte reg) {
     byte status;
-    int c;
+    byte data;
 
     if (dev == NULL) return 0xFF;
 
     switch (reg & 0x03) {
     case ACIA_REG_DATA:
-        /* Read received data */
-        /* If buffer is empty but input available, read it now */
-        if (!dev->rx_full && dev->input != NULL && input_available(dev->input)) {
-            /* Use read() instead of fgetc() to avoid stdio buffering issues */
-            char ch;
-            int fd = fileno(dev->input);
-            if (read(fd, &ch, 1) == 1) {
-                c = (unsigned char)ch;
-                dev->rx_data = (byte)c;
-                if (V6502C_VERBOSE) {
-                    fprintf(stderr, "[RX: %02X '%c']\n", dev->rx_data,
-                        (dev->rx_data >= 32 && dev->rx_data < 127) ? dev->rx_data : '.');
-                }
-            }
-        }
+        /* Read received data, which clears an overrun */
+        _acia_rx_refill(dev);
+        data = dev->rx_data;
         dev->rx_full = 0;
-        return dev->rx_data;
+        dev->rx_overrun = 0;
+        _acia_rx_refill(dev);
+        if (_acia_timed(dev) && dev->rx_count > 0 && dev->rx_next <= dev->clock) {
+            /* The sender was held off, it starts the next byte now */
+            dev->rx_next = dev->clock + acia_frame_cycles(dev);
+        }
+        return data;
 
     case ACIA_REG_STATUS:
         /* Build status register */
-        status = ACIA_STATUS_TDRE; /* Always ready to transmit */
+        status = 0;
+        if (!_acia_timed(dev) || !dev->tx_full) {
+            status |= ACIA_STATUS_TDRE;
+        }
 
-        /* Check if we have buffered data or new input available */
-        /* Note: Don't consume input here - just check availability */
-        /* Input is only consumed when data register is read */
-        if (dev->rx_full || (dev->input != NULL && input_available(dev->input))) {
+        /* Only received data counts, new input is read by acia_pump() */
+        _acia_rx_refill(dev);
+        if (dev->rx_overrun) {
+            status |= ACIA_STATUS_OVR;
+        }
+        if (dev->rx_full) {
             status |= ACIA_STATUS_RDRF;
+            if (acia_irq_enabled(dev)) {
+                status |= ACIA_STATUS_IRQ;
+            }
         }
 
         return status;
@@ -144,13 +340,16 @@ void acia_write(acia_t *dev, byte reg, byte value) {
     switch (reg & 0x03) {
     case ACIA_REG_DATA:
         /* Transmit data */
-        if (dev->output != NULL) {
-            if (V6502C_VERBOSE) {
-                fprintf(stderr, "[TX: %02X '%c']\n", value,
-                    (value >= 32 && value < 127) ? value : '.');
-            }
-            fputc(value, dev->output);
-            fflush(dev->output);
+        if (!_acia_timed(dev)) {
+            _acia_tx_queue(dev, value);
+        } else if (!dev->tx_full && dev->clock >= dev->tx_busy_until) {
+            /* The shift register is idle and takes the byte at once */
+            _acia_tx_queue(dev, value);
+            dev->tx_busy_until = dev->clock + acia_frame_cycles(dev);
+        } else {
+            if (dev->tx_full) dev->tx_overwritten++;
+            dev->tx_data = value;
+            dev->tx_full = 1;
         }
         break;
 
@@ -169,6 +368,153 @@ void acia_write(acia_t *dev, byte reg, byte value) {
     }
 }
 
+/* Check if the receiver interrupt is enabled in the command register. */
+int acia_irq_enabled(acia_t *dev) {
+    if (dev == NULL) return 0;
+    return (dev->command & (ACIA_CMD_DTR | ACIA_CMD_IRD)) == ACIA_CMD_DTR;
+}
+
+/* Check if the receiver is asserting its interrupt. */
+int acia_irq_pending(acia_t *dev) {
+    if (!acia_irq_enabled(dev)) return 0;
+    _acia_rx_refill(dev);
+    return dev->rx_full;
+}
+
+/*
+ * Bring the ACIA up to the given cycle count. Hands a waiting byte to
+ * the shift register once it is idle, and moves bytes that have
+ * arrived on the line into the data register.
+ */
+void acia_sync(acia_t *dev, count_t now) {
+    unsigned long frame;
+
+    if (dev == NULL) return;
+    dev->clock = now;
+
+    if (!_acia_timed(dev)) {
+        /* Timing was switched off, nothing may be left waiting */
+        if (dev->tx_full) {
+            dev->tx_full = 0;
+            _acia_tx_queue(dev, dev->tx_data);
+        }
+        return;
+    }
+    frame = acia_frame_cycles(dev);
+
+    if (dev->tx_full && now >= dev->tx_busy_until) {
+        dev->tx_full = 0;
+        _acia_tx_queue(dev, dev->tx_data);
+        dev->tx_busy_until += frame;
+    }
+
+    while (dev->rx_count > 0 && now >= dev->rx_next) {
+        if (!dev->rx_full) {
+            dev->rx_data = dev->rx_fifo[dev->rx_head];
+            dev->rx_full = 1;
+        } else if (dev->rx_fifo_enabled) {
+            /* Flow control holds the sender until the data is read */
+            break;
+        } else {
+            dev->rx_overrun = 1;
+            dev->rx_lost++;
+        }
+        dev->rx_head = (dev->rx_head + 1) % ACIA_RX_FIFO_SIZE;
+        dev->rx_count--;
+        dev->rx_next += frame;
+    }
+}
+
+/*
+ * Returns the cycle count at which acia_sync() next has something to
+ * do, or ACIA_NO_EVENT.
+ */
+count_t acia_next_event(acia_t *dev) {
+    count_t next = ACIA_NO_EVENT;
+
+    if (dev == NULL || !_acia_timed(dev)) return ACIA_NO_EVENT;
+
+    if (dev->tx_full) {
+        next = dev->tx_busy_until;
+    }
+    if (dev->rx_count > 0 && (!dev->rx_full || !dev->rx_fifo_enabled)) {
+        if (dev->rx_next < next) next = dev->rx_next;
+    }
+    return next;
+}
+
+/*
+ * Block the host until input arrives for either ACIA or the timeout in
+ * milliseconds expires. Either ACIA may be NULL or have no input.
+ * Returns early if a signal arrives. Returns 1 if input is available.
+ */
+int acia_wait_input(acia_t *a, acia_t *b, int timeout_ms) {
+    struct pollfd fds[2];
+    int n = 0;
+
+    if (a != NULL && a->input != NULL) {
+        if (a->rx_full) return 1;
+        fds[n].fd = fileno(a->input);
+        fds[n].events = POLLIN;
+        n++;
+    }
+    if (b != NULL && b->input != NULL) {
+        if (b->rx_full) return 1;
+        fds[n].fd = fileno(b->input);
+        fds[n].events = POLLIN;
+        n++;
+    }
+
+    return poll(fds, (nfds_t)n, timeout_ms) > 0;
+}
+
+/*
+ * Write as much of the transmit buffer to the output as it will take.
+ * Bytes the output does not accept yet, for example because it is
+ * non-blocking and full, stay queued. Returns the number still queued.
+ */
+unsigned int acia_flush(acia_t *dev) {
+    unsigned int chunk;
+    ssize_t n;
+
+    if (dev == NULL) return 0;
+    if (dev->output == NULL) {
+        dev->tx_count = 0;
+        return 0;
+    }
+
+    /* Keep ordering with anything written to the stream through stdio */
+    if (dev->tx_count > 0) {
+        fflush(dev->output);
+    }
+
+    while (dev->tx_count > 0) {
+        chunk = ACIA_TX_BUFFER_SIZE - dev->tx_head;
+        if (chunk > dev->tx_count) chunk = dev->tx_count;
+        n = write(fileno(dev->output), &dev->tx_buffer[dev->tx_head], chunk);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            /* The output is gone, nothing queued can be delivered */
+            dev->tx_dropped += dev->tx_count;
+            dev->tx_count = 0;
+            break;
+        }
+        dev->tx_head = (dev->tx_head + (unsigned int)n) % ACIA_TX_BUFFER_SIZE;
+        dev->tx_count -= (unsigned int)n;
+    }
+    if (dev->tx_count == 0) {
+        dev->tx_head = 0;
+    }
+    return dev->tx_count;
+}
+
+/* Number of transmitted bytes waiting to be flushed. */
+unsigned int acia_tx_pending(acia_t *dev) {
+    if (dev == NULL) return 0;
+    return dev->tx_count;
+}
+
 /*
  * 6522 VIA Implementation
  */
@@ -182,6 +528,18 @@ via_t *via_create(void) {
     return dev;
 }
 
+via_t *via_clone(via_t *dev) {
+    via_t *copy;
+
+    if (dev == NULL) return NULL;
+    copy = (via_t *)malloc(sizeof(via_t));
+    if (copy == NULL) return NULL;
+
+    *copy = *dev;
+
+    return copy;
+}
+
 void via_destroy(via_t *dev) {
     if (dev != NULL) {
         free(dev);
@@ -206,6 +564,7 @@ void via_reset(via_t *dev) {
     dev->ier = 0x00;
     dev->t1_running = 0;
     dev->t2_running = 0;
+    dev->clock = 0;
 }
 
 byte via_read(via_t *dev, byte reg) {
@@ -355,37 +714,97 @@ void via_write(via_t *dev, byte reg, byte value) {
 }
 
 void via_tick(via_t *dev) {
+    via_advance(dev, 1);
+}
+
+/*
+ * Advance both timers by the given number of clock cycles.
+ * Equivalent to calling via_tick() once per cycle, but whole runs
+ * of cycles are subtracted at once.
+ */
+void via_advance(via_t *dev, unsigned long cycles) {
+    unsigned long n;
+
     if (dev == NULL) return;
 
     /* Timer 1 */
-    if (dev->t1_running) {
-        if (dev->t1_counter == 0) {
-            /* Timer expired */
+    n = cycles;
+    while (dev->t1_running && n > 0) {
+        if (dev->t1_counter >= n) {
+            dev->t1_counter -= (address)n;
+            n = 0;
+        } else {
+            /* Count down to zero, then expire on the following cycle */
+            n -= (unsigned long)dev->t1_counter + 1;
             dev->ifr |= VIA_INT_T1;
             if (dev->acr & VIA_ACR_T1_CONTINUOUS) {
-                /* Continuous mode: reload from latch */
+                /* Continuous mode: reload from latch, skipping whole periods */
                 dev->t1_counter = dev->t1_latch;
+                n %= (unsigned long)dev->t1_latch + 1;
             } else {
                 /* One-shot mode: stop timer */
+                dev->t1_counter = 0;
                 dev->t1_running = 0;
             }
-        } else {
-            dev->t1_counter--;
         }
     }
 
     /* Timer 2 */
-    if (dev->t2_running) {
-        if (dev->t2_counter == 0) {
+    n = cycles;
+    if (dev->t2_running && n > 0) {
+        if (dev->t2_counter >= n) {
+            dev->t2_counter -= (address)n;
+        } else {
             /* Timer expired */
+            dev->t2_counter = 0;
             dev->ifr |= VIA_INT_T2;
             dev->t2_running = 0;
-        } else {
-            dev->t2_counter--;
         }
     }
 }
 
+/*
+ * Advance the timers to the given cycle count. The VIA remembers the
+ * cycle count it was last synced to, so callers that own a cycle
+ * counter only need to sync before touching the VIA and when
+ * via_next_event() says a timer expires.
+ */
+void via_sync(via_t *dev, count_t now) {
+    count_t delta;
+
+    if (dev == NULL) return;
+
+    if (now > dev->clock) {
+        delta = now - dev->clock;
+        while (delta > 0x7FFFFFFFUL) {
+            via_advance(dev, 0x7FFFFFFFUL);
+            delta -= 0x7FFFFFFFUL;
+        }
+        via_advance(dev, (unsigned long)delta);
+    }
+    dev->clock = now;
+}
+
+/*
+ * Return the cycle count at which the next running timer expires,
+ * or VIA_NO_EVENT if neither timer is running.
+ */
+count_t via_next_event(via_t *dev) {
+    count_t next = VIA_NO_EVENT;
+    count_t t;
+
+    if (dev == NULL) return next;
+
+    if (dev->t1_running) {
+        next = dev->clock + dev->t1_counter + 1;
+    }
+    if (dev->t2_running) {
+        t = dev->clock + dev->t2_counter + 1;
+        if (t < next) next = t;
+    }
+    return next;
+}
+
 int via_irq_pending(via_t *dev) {
     if (dev == NULL) return 0;
     return (dev->ifr & dev->ier & 0x7F) != 0;
@@ -400,11 +819,44 @@ fileio_t *fileio_create(void) {
     if (dev == NULL) return NULL;
 
     dev->file = NULL;  /* Must initialize before reset checks it */
+    dev->writing = 0;
     fileio_reset(dev);
 
     return dev;
 }
 
+/*
+ * Copy a file I/O device. A file open for reading is opened again at
+ * the same position. A file open for writing is not shared, the copy
+ * sees it as closed with an error.
+ */
+fileio_t *fileio_clone(fileio_t *dev) {
+    fileio_t *copy;
+    long pos;
+
+    if (dev == NULL) return NULL;
+    copy = (fileio_t *)malloc(sizeof(fileio_t));
+    if (copy == NULL) return NULL;
+
+    *copy = *dev;
+    copy->file = NULL;
+    if (dev->file != NULL) {
+        pos = dev->writing ? -1 : ftell(dev->file);
+        if (pos >= 0) {
+            copy->file = fopen(dev->filename, "rb");
+        }
+        if (copy->file == NULL || fseek(copy->file, pos, SEEK_SET) != 0) {
+            if (copy->file != NULL) {
+                fclose(copy->file);
+                copy->file = NULL;
+            }
+            copy->status = FILEIO_STATUS_READY | FILEIO_STATUS_ERR;
+        }
+    }
+
+    return copy;
+}
+
 void fileio_destroy(fileio_t *dev) {
     if (dev != NULL) {
         if (dev->file != NULL) {
@@ -463,6 +915,7 @@ void fileio_write(fileio_t *dev, byte reg, byte value) {
             }
             dev->filename[dev->name_index] = '\0';
             dev->file = fopen(dev->filename, "rb");
+            dev->writing = 0;
             if (dev->file != NULL) {
                 dev->status = FILEIO_STATUS_READY | FILEIO_STATUS_OPEN;
             } else {
@@ -476,6 +929,7 @@ void fileio_write(fileio_t *dev, byte reg, byte value) {
             }
             dev->filename[dev->name_index] = '\0';
             dev->file = fopen(dev->filename, "wb");
+            dev->writing = 1;
             if (dev->file != NULL) {
                 dev->status = FILEIO_STATUS_READY | FILEIO_STATUS_OPEN;
             } else {
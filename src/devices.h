@@ -48,6 +48,50 @@
  *   Bit 5: DCD
  *   Bit 6: DSR
  *   Bit 7: IRQ
+ *
+ * Command Register bits:
+ *   Bit 0: DTR, the receiver and its interrupt are disabled when clear
+ *   Bit 1: IRD, receiver interrupt disabled when set
+ *   Bit 5: PME, parity enabled when set
+ *
+ * Control Register bits:
+ *   Bits 0-3: Baud rate, 0 selects the external clock
+ *   Bits 5-6: Word length, 00 = 8 bits through 11 = 5 bits
+ *   Bit 7:    Stop bits, 0 = 1 stop bit, 1 = 2 stop bits
+ *
+ * The receiver IRQ is level-triggered: it stays asserted while RDRF
+ * is set and goes away once the data register has been read.
+ *
+ * Received bytes are read from the input in bulk by acia_pump(), which
+ * the owner of the ACIA calls periodically, and wait in a receive FIFO
+ * until the data register is free. Status and data register reads only
+ * look at memory. Once a read finds the end of the input, input_eof is
+ * set. With rx_fifo_enabled cleared the ACIA behaves like a
+ * real 6551, holding a single byte: bytes that arrive while the data
+ * register is full are lost and the Overrun status bit is set until
+ * the data register is read.
+ *
+ * Transmitted bytes are queued in a ring buffer and written to the
+ * output in batches by acia_flush(). The ACIA flushes by itself when
+ * the buffer is full and, if tx_flush_newline is set, after a line
+ * feed or carriage return. Anything else must be flushed by the owner
+ * of the ACIA, which bounds the output latency.
+ *
+ * Setting timing enables a baud rate timing model. The owner passes
+ * the emulated cycle count, at clock_hz cycles per second, to
+ * acia_sync() before each access and when acia_next_event() says
+ * something happens. One frame takes the start bit, data bits, parity
+ * and stop bits at the baud rate in the control register.
+ *   Transmit: a byte written while the shift register is idle starts
+ *   shifting at once. A byte written while it is busy waits in the
+ *   transmit data register, and TDRE stays clear until the shift
+ *   register takes it. Writing again while TDRE is clear overwrites
+ *   the waiting byte.
+ *   Receive: bytes from the input arrive one frame apart. With the
+ *   FIFO enabled the sender waits while the data register is full, as
+ *   if hardware flow control were in use. With it disabled, a byte
+ *   arriving while the data register is full is an overrun.
+ * With the external clock selected, timing has no effect.
  */
 
 #define ACIA_REG_DATA    0
@@ -64,6 +108,22 @@
 #define ACIA_STATUS_DSR  0x40
 #define ACIA_STATUS_IRQ  0x80
 
+#define ACIA_CMD_DTR     0x01
+#define ACIA_CMD_IRD     0x02
+#define ACIA_CMD_PME     0x20
+
+#define ACIA_CTRL_BAUD   0x0F
+#define ACIA_CTRL_WL     0x60
+#define ACIA_CTRL_SBN    0x80
+
+#define ACIA_DEFAULT_CLOCK_HZ 1000000UL
+
+/* Returned by acia_next_event() when nothing is due */
+#define ACIA_NO_EVENT ((count_t)-1)
+
+#define ACIA_TX_BUFFER_SIZE 256
+#define ACIA_RX_FIFO_SIZE   4096
+
 typedef struct {
     FILE *input;
     FILE *output;
@@ -71,13 +131,45 @@ typedef struct {
     byte control;
     byte rx_data;
     int rx_full;
+    int rx_overrun;
+    byte rx_fifo[ACIA_RX_FIFO_SIZE];
+    unsigned int rx_head;       /* Index of the oldest byte in the FIFO */
+    unsigned int rx_count;      /* Number of bytes in the FIFO */
+    unsigned long rx_lost;      /* Bytes lost to overruns */
+    int rx_fifo_enabled;        /* Queue received bytes, on by default */
+    int input_eof;              /* The input has run out */
+    byte tx_buffer[ACIA_TX_BUFFER_SIZE];
+    unsigned int tx_head;       /* Index of the oldest queued byte */
+    unsigned int tx_count;      /* Number of queued bytes */
+    unsigned long tx_dropped;   /* Bytes lost because the output was full */
+    int tx_flush_newline;       /* Flush after CR or LF, on by default */
+    int timing;                 /* Model baud rate timing, off by default */
+    unsigned long clock_hz;     /* Rate of the cycle count given to acia_sync() */
+    count_t clock;              /* Cycle count last given to acia_sync() */
+    byte tx_data;               /* Transmit data register */
+    int tx_full;                /* tx_data waits for the shift register */
+    count_t tx_busy_until;      /* Cycle count the shift register is idle again */
+    unsigned long tx_overwritten; /* Bytes overwritten before being sent */
+    count_t rx_next;            /* Cycle count the next byte on the line arrives */
 } acia_t;
 
 acia_t *acia_create(FILE *in, FILE *out);
+acia_t *acia_clone(acia_t *dev);
 void acia_destroy(acia_t *dev);
 void acia_reset(acia_t *dev);
 byte acia_read(acia_t *dev, byte reg);
 void acia_write(acia_t *dev, byte reg, byte value);
+int acia_irq_enabled(acia_t *dev);
+int acia_irq_pending(acia_t *dev);
+int acia_wait_input(acia_t *a, acia_t *b, int timeout_ms);
+unsigned int acia_flush(acia_t *dev);
+int acia_read_input(acia_t *dev, byte *buffer, size_t size);
+int acia_pump(acia_t *dev);
+void acia_receive(acia_t *dev, byte value);
+unsigned long acia_frame_cycles(acia_t *dev);
+void acia_sync(acia_t *dev, count_t now);
+count_t acia_next_event(acia_t *dev);
+unsigned int acia_tx_pending(acia_t *dev);
 
 /*
  * MOS 6522 VIA (Versatile Interface Adapter)
@@ -148,14 +240,22 @@ typedef struct {
     byte ier;
     int t1_running;
     int t2_running;
+    count_t clock;   /* Cycle count the timers were last synced to */
 } via_t;
 
+/* Returned by via_next_event() when no timer is running */
+#define VIA_NO_EVENT ((count_t)-1)
+
 via_t *via_create(void);
+via_t *via_clone(via_t *dev);
 void via_destroy(via_t *dev);
 void via_reset(via_t *dev);
 byte via_read(via_t *dev, byte reg);
 void via_write(via_t *dev, byte reg, byte value);
 void via_tick(via_t *dev);
+void via_advance(via_t *dev, unsigned long cycles);
+void via_sync(via_t *dev, count_t now);
+count_t via_next_event(via_t *dev);
 int via_irq_pending(via_t *dev);
 
 /*
@@ -205,6 +305,7 @@ int via_irq_pending(via_t *dev);
 
 typedef struct {
     FILE *file;
+    int writing;    /* file was opened for writing */
     byte status;
     byte data;
     byte name_index;
@@ -212,6 +313,7 @@ typedef struct {
 } fileio_t;
 
 fileio_t *fileio_create(void);
+fileio_t *fileio_clone(fileio_t *dev);
 void fileio_destroy(fileio_t *dev);
 void fileio_reset(fileio_t *dev);
 byte fileio_read(fileio_t *dev, byte reg);
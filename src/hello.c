@@ -35,23 +35,26 @@
 
 #include "hello.h"
 
-byte mem[0xFFFF];
+byte mem[0x10000];
 
-byte read(address a) {
+/** The userdata pointer given to the CPU is the memory array. */
+byte read(void *userdata, address a) {
+  byte *m = (byte *)userdata;
   if (a == 0xFF00) {
     /** Character device */
     return getchar();
   }
-  return mem[a];
+  return m[a];
 }
 
-void write(address a, byte b) {
+void write(void *userdata, address a, byte b) {
+  byte *m = (byte *)userdata;
   if (a == 0xFF00) {
     /** Character device */
     putchar(b);
     return;
   }
-  mem[a] = b;
+  m[a] = b;
 }
 
 int main(int argc, char** argv) {
@@ -61,8 +64,9 @@ int main(int argc, char** argv) {
   cpu_init(&c);
 
   /** Set read and write function pointers */
-  c.read = read;
-  c.write = write;
+  c.userdata = mem;
+  c.read_ctx = read;
+  c.write_ctx = write;
 
   /** Load the program */
   memcpy(&mem[0x1000], src_hello_bin, src_hello_bin_len);
@@ -55,138 +55,164 @@ enum addressing_t {
   A_ZPI, A_ABI 
 };
 
+/**
+ * The opcode map. Each entry is X(opcode, instruction, addressing).
+ * This list is the single source for both the decode tables below
+ * and the table-driven dispatch core in v6502.c.
+ */
+#define V6502_OPCODES(X) \
+  /* 00-07 */ \
+  X(0x00, I_BRK, A_IMP) X(0x01, I_ORA, A_INX) X(0x02, I_NOP, A_IMP) X(0x03, I_NOP, A_IMP) \
+  X(0x04, I_TSB, A_ZPG) X(0x05, I_ORA, A_ZPG) X(0x06, I_ASL, A_ZPG) X(0x07, I_RMB0, A_ZPG) \
+  /* 08-0F */ \
+  X(0x08, I_PHP, A_IMP) X(0x09, I_ORA, A_IMM) X(0x0A, I_ASL, A_ACC) X(0x0B, I_NOP, A_IMP) \
+  X(0x0C, I_TSB, A_ABS) X(0x0D, I_ORA, A_ABS) X(0x0E, I_ASL, A_ABS) X(0x0F, I_BBR0, A_REL) \
+  /* 10-17 */ \
+  X(0x10, I_BPL, A_REL) X(0x11, I_ORA, A_INY) X(0x12, I_ORA, A_ZPI) X(0x13, I_NOP, A_IMP) \
+  X(0x14, I_TRB, A_ZPG) X(0x15, I_ORA, A_ZPX) X(0x16, I_ASL, A_ZPX) X(0x17, I_RMB1, A_ZPG) \
+  /* 18-1F */ \
+  X(0x18, I_CLC, A_IMP) X(0x19, I_ORA, A_ABY) X(0x1A, I_INC, A_ACC) X(0x1B, I_TRB, A_IMP) \
+  X(0x1C, I_TRB, A_ABS) X(0x1D, I_ORA, A_ABX) X(0x1E, I_ASL, A_ABX) X(0x1F, I_BBR1, A_REL) \
+  /* 20-27 */ \
+  X(0x20, I_JSR, A_ABS) X(0x21, I_AND, A_INX) X(0x22, I_NOP, A_IMP) X(0x23, I_NOP, A_IMP) \
+  X(0x24, I_BIT, A_ZPG) X(0x25, I_AND, A_ZPG) X(0x26, I_ROL, A_ZPG) X(0x27, I_RMB2, A_ZPG) \
+  /* 28-2F */ \
+  X(0x28, I_PLP, A_IMP) X(0x29, I_AND, A_IMM) X(0x2A, I_ROL, A_ACC) X(0x2B, I_NOP, A_IMP) \
+  X(0x2C, I_BIT, A_ABS) X(0x2D, I_AND, A_ABS) X(0x2E, I_ROL, A_ABS) X(0x2F, I_BBR2, A_REL) \
+  /* 30-37 */ \
+  X(0x30, I_BMI, A_REL) X(0x31, I_AND, A_INY) X(0x32, I_AND, A_ZPI) X(0x33, I_NOP, A_IMP) \
+  X(0x34, I_BIT, A_ZPX) X(0x35, I_AND, A_ZPX) X(0x36, I_ROL, A_ZPX) X(0x37, I_RMB3, A_ZPG) \
+  /* 38-3F */ \
+  X(0x38, I_SEC, A_IMP) X(0x39, I_AND, A_ABY) X(0x3A, I_DEC, A_ACC) X(0x3B, I_NOP, A_IMP) \
+  X(0x3C, I_BIT, A_ABX) X(0x3D, I_AND, A_ABX) X(0x3E, I_ROL, A_ABX) X(0x3F, I_BBR3, A_REL) \
+  /* 40-47 */ \
+  X(0x40, I_RTI, A_IMP) X(0x41, I_EOR, A_INX) X(0x42, I_NOP, A_IMP) X(0x43, I_NOP, A_IMP) \
+  X(0x44, I_NOP, A_IMP) X(0x45, I_EOR, A_ZPG) X(0x46, I_LSR, A_ZPG) X(0x47, I_RMB4, A_ZPG) \
+  /* 48-4F */ \
+  X(0x48, I_PHA, A_IMP) X(0x49, I_EOR, A_IMM) X(0x4A, I_LSR, A_ACC) X(0x4B, I_NOP, A_IMP) \
+  X(0x4C, I_JMP, A_ABS) X(0x4D, I_EOR, A_ABS) X(0x4E, I_LSR, A_ABS) X(0x4F, I_BBR4, A_REL) \
+  /* 50-57 */ \
+  X(0x50, I_BVC, A_REL) X(0x51, I_EOR, A_INY) X(0x52, I_EOR, A_ZPI) X(0x53, I_NOP, A_IMP) \
+  X(0x54, I_NOP, A_IMP) X(0x55, I_EOR, A_ZPX) X(0x56, I_LSR, A_ZPX) X(0x57, I_RMB5, A_ZPG) \
+  /* 58-5F */ \
+  X(0x58, I_CLI, A_IMP) X(0x59, I_EOR, A_ABY) X(0x5A, I_PHY, A_IMP) X(0x5B, I_NOP, A_IMP) \
+  X(0x5C, I_NOP, A_IMP) X(0x5D, I_EOR, A_ABX) X(0x5E, I_LSR, A_ABX) X(0x5F, I_BBR5, A_REL) \
+  /* 60-67 */ \
+  X(0x60, I_RTS, A_IMP) X(0x61, I_ADC, A_INX) X(0x62, I_NOP, A_IMP) X(0x63, I_NOP, A_IMP) \
+  X(0x64, I_STZ, A_ZPG) X(0x65, I_ADC, A_ZPG) X(0x66, I_ROR, A_ZPG) X(0x67, I_RMB6, A_ZPG) \
+  /* 68-6F */ \
+  X(0x68, I_PLA, A_IMP) X(0x69, I_ADC, A_IMM) X(0x6A, I_ROR, A_ACC) X(0x6B, I_NOP, A_IMP) \
+  X(0x6C, I_JMP, A_IND) X(0x6D, I_ADC, A_ABS) X(0x6E, I_ROR, A_ABS) X(0x6F, I_BBR6, A_REL) \
+  /* 70-77 */ \
+  X(0x70, I_BVS, A_REL) X(0x71, I_ADC, A_INY) X(0x72, I_ADC, A_ZPI) X(0x73, I_NOP, A_IMP) \
+  X(0x74, I_STZ, A_ZPX) X(0x75, I_ADC, A_ZPX) X(0x76, I_ROR, A_ZPX) X(0x77, I_RMB7, A_ZPG) \
+  /* 78-7F */ \
+  X(0x78, I_SEI, A_IMP) X(0x79, I_ADC, A_ABY) X(0x7A, I_PLY, A_IMP) X(0x7B, I_NOP, A_IMP) \
+  X(0x7C, I_JMP, A_ABX) X(0x7D, I_ADC, A_ABX) X(0x7E, I_ROR, A_ABX) X(0x7F, I_BBR7, A_REL) \
+  /* 80-87 */ \
+  X(0x80, I_BRA, A_REL) X(0x81, I_STA, A_INX) X(0x82, I_NOP, A_IMP) X(0x83, I_NOP, A_IMP) \
+  X(0x84, I_STY, A_ZPG) X(0x85, I_STA, A_ZPG) X(0x86, I_STX, A_ZPG) X(0x87, I_SMB0, A_ZPG) \
+  /* 88-8F */ \
+  X(0x88, I_DEY, A_IMP) X(0x89, I_BIT, A_IMM) X(0x8A, I_TXA, A_IMP) X(0x8B, I_NOP, A_IMP) \
+  X(0x8C, I_STY, A_ABS) X(0x8D, I_STA, A_ABS) X(0x8E, I_STX, A_ABS) X(0x8F, I_BBS0, A_REL) \
+  /* 90-97 */ \
+  X(0x90, I_BCC, A_REL) X(0x91, I_STA, A_INY) X(0x92, I_STA, A_ZPI) X(0x93, I_NOP, A_IMP) \
+  X(0x94, I_STY, A_ZPX) X(0x95, I_STA, A_ZPX) X(0x96, I_STX, A_ZPY) X(0x97, I_SMB1, A_ZPG) \
+  /* 98-9F */ \
+  X(0x98, I_TYA, A_IMP) X(0x99, I_STA, A_ABY) X(0x9A, I_TXS, A_IMP) X(0x9B, I_NOP, A_IMP) \
+  X(0x9C, I_STZ, A_ABS) X(0x9D, I_STA, A_ABX) X(0x9E, I_STZ, A_ABX) X(0x9F, I_BBS1, A_REL) \
+  /* A0-A7 */ \
+  X(0xA0, I_LDY, A_IMM) X(0xA1, I_LDA, A_INX) X(0xA2, I_LDX, A_IMM) X(0xA3, I_NOP, A_IMP) \
+  X(0xA4, I_LDY, A_ZPG) X(0xA5, I_LDA, A_ZPG) X(0xA6, I_LDX, A_ZPG) X(0xA7, I_SMB2, A_ZPG) \
+  /* A8-AF */ \
+  X(0xA8, I_TAY, A_IMP) X(0xA9, I_LDA, A_IMM) X(0xAA, I_TAX, A_IMP) X(0xAB, I_NOP, A_IMP) \
+  X(0xAC, I_LDY, A_ABS) X(0xAD, I_LDA, A_ABS) X(0xAE, I_LDX, A_ABS) X(0xAF, I_BBS2, A_REL) \
+  /* B0-B7 */ \
+  X(0xB0, I_BCS, A_REL) X(0xB1, I_LDA, A_INY) X(0xB2, I_LDA, A_ZPI) X(0xB3, I_NOP, A_IMP) \
+  X(0xB4, I_LDY, A_ZPX) X(0xB5, I_LDA, A_ZPX) X(0xB6, I_LDX, A_ZPY) X(0xB7, I_SMB3, A_ZPG) \
+  /* B8-BF */ \
+  X(0xB8, I_CLV, A_IMP) X(0xB9, I_LDA, A_ABY) X(0xBA, I_TSX, A_IMP) X(0xBB, I_NOP, A_IMP) \
+  X(0xBC, I_LDY, A_ABX) X(0xBD, I_LDA, A_ABX) X(0xBE, I_LDX, A_ABX) X(0xBF, I_BBS3, A_REL) \
+  /* C0-C7 */ \
+  X(0xC0, I_CPY, A_IMM) X(0xC1, I_CMP, A_INX) X(0xC2, I_NOP, A_IMP) X(0xC3, I_NOP, A_IMP) \
+  X(0xC4, I_CPY, A_ZPG) X(0xC5, I_CMP, A_ZPG) X(0xC6, I_DEC, A_ZPG) X(0xC7, I_SMB4, A_ZPG) \
+  /* C8-CF */ \
+  X(0xC8, I_INY, A_IMP) X(0xC9, I_CMP, A_IMM) X(0xCA, I_DEX, A_IMP) X(0xCB, I_WAI, A_IMP) \
+  X(0xCC, I_CPY, A_ABS) X(0xCD, I_CMP, A_ABS) X(0xCE, I_DEC, A_ABS) X(0xCF, I_BBS4, A_REL) \
+  /* D0-D7 */ \
+  X(0xD0, I_BNE, A_REL) X(0xD1, I_CMP, A_INY) X(0xD2, I_CMP, A_ZPI) X(0xD3, I_NOP, A_IMP) \
+  X(0xD4, I_NOP, A_IMP) X(0xD5, I_CMP, A_ZPX) X(0xD6, I_DEC, A_ZPX) X(0xD7, I_SMB5, A_ZPG) \
+  /* D8-DF */ \
+  X(0xD8, I_CLD, A_IMP) X(0xD9, I_CMP, A_ABY) X(0xDA, I_PHX, A_IMP) X(0xDB, I_STP, A_IMP) \
+  X(0xDC, I_NOP, A_IMP) X(0xDD, I_CMP, A_ABX) X(0xDE, I_DEC, A_ABX) X(0xDF, I_BBS5, A_REL) \
+  /* E0-E7 */ \
+  X(0xE0, I_CPX, A_IMM) X(0xE1, I_SBC, A_INX) X(0xE2, I_NOP, A_IMP) X(0xE3, I_NOP, A_IMP) \
+  X(0xE4, I_CPX, A_ZPG) X(0xE5, I_SBC, A_ZPG) X(0xE6, I_INC, A_ZPG) X(0xE7, I_SMB6, A_ZPG) \
+  /* E8-EF */ \
+  X(0xE8, I_INX, A_IMP) X(0xE9, I_SBC, A_IMM) X(0xEA, I_NOP, A_IMP) X(0xEB, I_NOP, A_IMP) \
+  X(0xEC, I_CPX, A_ABS) X(0xED, I_SBC, A_ABS) X(0xEE, I_INC, A_ABS) X(0xEF, I_BBS6, A_REL) \
+  /* F0-F7 */ \
+  X(0xF0, I_BEQ, A_REL) X(0xF1, I_SBC, A_INY) X(0xF2, I_SBC, A_ZPI) X(0xF3, I_NOP, A_IMP) \
+  X(0xF4, I_NOP, A_IMP) X(0xF5, I_SBC, A_ZPX) X(0xF6, I_INC, A_ZPX) X(0xF7, I_SMB7, A_ZPG) \
+  /* F8-FF */ \
+  X(0xF8, I_SED, A_IMP) X(0xF9, I_SBC, A_ABY) X(0xFA, I_PLX, A_IMP) X(0xFB, I_NOP, A_IMP) \
+  X(0xFC, I_NOP, A_IMP) X(0xFD, I_SBC, A_ABX) X(0xFE, I_INC, A_ABX) X(0xFF, I_BBS7, A_REL)
+
+#define _INSTRUCTION_ENTRY(op, i, m) i,
+#define _ADDRESSING_ENTRY(op, i, m) m,
+
 enum instruction_t instructions[] = {
-  /* 00     01     02     03     04     05     06     07 */ 
-  I_BRK, I_ORA, I_NOP, I_NOP, I_TSB, I_ORA, I_ASL, I_RMB0,
-  /* 08     09     0A     0B     0C     0D     0E     0F */ 
-  I_PHP, I_ORA, I_ASL, I_NOP, I_TSB, I_ORA, I_ASL, I_BBR0,
-  /* 10     11     12     13     14     15     16     17 */ 
-  I_BPL, I_ORA, I_ORA, I_NOP, I_TRB, I_ORA, I_ASL, I_RMB1,
-  /* 18     19     1A     1B     1C     1D     1E     1F */ 
-  I_CLC, I_ORA, I_INC, I_TRB, I_TRB, I_ORA, I_ASL, I_BBR1,
-  /* 20     21     22     23     24     25     26     27 */ 
-  I_JSR, I_AND, I_NOP, I_NOP, I_BIT, I_AND, I_ROL, I_RMB2,
-  /* 28     29     2A     2B     2C     2D     2E     2F */
-  I_PLP, I_AND, I_ROL, I_NOP, I_BIT, I_AND, I_ROL, I_BBR2,
-  /* 30     31     32     33     34     35     36     37 */ 
-  I_BMI, I_AND, I_AND, I_NOP, I_BIT, I_AND, I_ROL, I_RMB3,
-  /* 38     39     3A     3B     3C     3D     3E     3F */ 
-  I_SEC, I_AND, I_DEC, I_NOP, I_BIT, I_AND, I_ROL, I_BBR3,
-  /* 40     41     42     43     44     45     46     47 */ 
-  I_RTI, I_EOR, I_NOP, I_NOP, I_NOP, I_EOR, I_LSR, I_RMB4,
-  /* 48     49     4A     4B     4C     4D     4E     4F */ 
-  I_PHA, I_EOR, I_LSR, I_NOP, I_JMP, I_EOR, I_LSR, I_BBR4,
-  /* 50     51     52     53     54     55     56     57 */ 
-  I_BVC, I_EOR, I_EOR, I_NOP, I_NOP, I_EOR, I_LSR, I_RMB5,
-  /* 58     59     5A     5B     5C     5D     5E     5F */ 
-  I_CLI, I_EOR, I_PHY, I_NOP, I_NOP, I_EOR, I_LSR, I_BBR5,
-  /* 60     61     62     63     64     65     66     67 */ 
-  I_RTS, I_ADC, I_NOP, I_NOP, I_STZ, I_ADC, I_ROR, I_RMB6,
-  /* 68     69     6A     6B     6C     6D     6E     6F */ 
-  I_PLA, I_ADC, I_ROR, I_NOP, I_JMP, I_ADC, I_ROR, I_BBR6,
-  /* 70     71     72     73     74     75     76     77 */ 
-  I_BVS, I_ADC, I_ADC, I_NOP, I_STZ, I_ADC, I_ROR, I_RMB7,
-  /* 78     79     7A     7B     7C     7D     7E     7F */ 
-  I_SEI, I_ADC, I_PLY, I_NOP, I_JMP, I_ADC, I_ROR, I_BBR7,
-  /* 80     81     82     83     84     85     86     87 */ 
-  I_BRA, I_STA, I_NOP, I_NOP, I_STY, I_STA, I_STX, I_SMB0,
-  /* 88     89     8A     8B     8C     8D     8E     8F */ 
-  I_DEY, I_BIT, I_TXA, I_NOP, I_STY, I_STA, I_STX, I_BBS0,
-  /* 90     91     92     93     94     95     96     97 */ 
-  I_BCC, I_STA, I_STA, I_NOP, I_STY, I_STA, I_STX, I_SMB1,
-  /* 98     99     9A     9B     9C     9D     9E     9F */ 
-  I_TYA, I_STA, I_TXS, I_NOP, I_STZ, I_STA, I_STZ, I_BBS1,
-  /* A0     A1     A2     A3     A4     A5     A6     A7 */ 
-  I_LDY, I_LDA, I_LDX, I_NOP, I_LDY, I_LDA, I_LDX, I_SMB2,
-  /* A8     A9     AA     AB     AC     AD     AE     AF */ 
-  I_TAY, I_LDA, I_TAX, I_NOP, I_LDY, I_LDA, I_LDX, I_BBS2,
-  /* B0     B1     B2     B3     B4     B5     B6     B7 */ 
-  I_BCS, I_LDA, I_LDA, I_NOP, I_LDY, I_LDA, I_LDX, I_SMB3,
-  /* B8     B9     BA     BB     BC     BD     BE     BF */ 
-  I_CLV, I_LDA, I_TSX, I_NOP, I_LDY, I_LDA, I_LDX, I_BBS3,
-  /* C0     C1     C2     C3     C4     C5     C6     C7 */ 
-  I_CPY, I_CMP, I_NOP, I_NOP, I_CPY, I_CMP, I_DEC, I_SMB4,
-  /* C8     C9     CA     CB     CC     CD     CE     CF */ 
-  I_INY, I_CMP, I_DEX, I_WAI, I_CPY, I_CMP, I_DEC, I_BBS4,
-  /* D0     D1     D2     D3     D4     D5     D6     D7 */ 
-  I_BNE, I_CMP, I_CMP, I_NOP, I_NOP, I_CMP, I_DEC, I_SMB5,
-  /* D8     D9     DA     DB     DC     DD     DE     DF */ 
-  I_CLD, I_CMP, I_PHX, I_STP, I_NOP, I_CMP, I_DEC, I_BBS5,
-  /* E0     E1     E2     E3     E4     E5     E6     E7 */ 
-  I_CPX, I_SBC, I_NOP, I_NOP, I_CPX, I_SBC, I_INC, I_SMB6,
-  /* E8     E9     EA     EB     EC     ED     EE     EF */ 
-  I_INX, I_SBC, I_NOP, I_NOP, I_CPX, I_SBC, I_INC, I_BBS6,
-  /* F0     F1     F2     F3     F4     F5     F6     F7 */ 
-  I_BEQ, I_SBC, I_SBC, I_NOP, I_NOP, I_SBC, I_INC, I_SMB7,
-  /* F8     F9     FA     FB     FC     FD     FE     FF */ 
-  I_SED, I_SBC, I_PLX, I_NOP, I_NOP, I_SBC, I_INC, I_BBS7
+  V6502_OPCODES(_INSTRUCTION_ENTRY)
 };
 
 enum addressing_t addressings[] = {
-  /* 00     01     02     03     04     05     06     07 */ 
-  A_IMP, A_INX, A_IMP, A_IMP, A_ZPG, A_ZPG, A_ZPG, A_ZPG,
-  /* 08     09     0A     0B     0C     0D     0E     0F */ 
-  A_IMP, A_IMM, A_ACC, A_IMP, A_ABS, A_ABS, A_ABS, A_REL,
-  /* 10     11     12     13     14     15     16     17 */ 
-  A_REL, A_INY, A_ZPI, A_IMP, A_ZPG, A_ZPX, A_ZPX, A_ZPG,
-  /* 18     19     1A     1B     1C     1D     1E     1F */ 
-  A_IMP, A_ABY, A_ACC, A_IMP, A_ABS, A_ABX, A_ABX, A_REL,
-  /* 20     21     22     23     24     25     26     27 */ 
-  A_ABS, A_INX, A_IMP, A_IMP, A_ZPG, A_ZPG, A_ZPG, A_ZPG,
-  /* 28     29     2A     2B     2C     2D     2E     2F */ 
-  A_IMP, A_IMM, A_ACC, A_IMP, A_ABS, A_ABS, A_ABS, A_REL,
-  /* 30     31     32     33     34     35     36     37 */ 
-  A_REL, A_INY, A_ZPI, A_IMP, A_ZPX, A_ZPX, A_ZPX, A_ZPG,
-  /* 38     39     3A     3B     3C     3D     3E     3F */ 
-  A_IMP, A_ABY, A_ACC, A_IMP, A_ABX, A_ABX, A_ABX, A_REL,
-  /* 40     41     42     43     44     45     46     47 */ 
-  A_IMP, A_INX, A_IMP, A_IMP, A_IMP, A_ZPG, A_ZPG, A_ZPG,
-  /* 48     49     4A     4B     4C     4D     4E     4F */ 
-  A_IMP, A_IMM, A_ACC, A_IMP, A_ABS, A_ABS, A_ABS, A_REL,
-  /* 50     51     52     53     54     55     56     57 */ 
-  A_REL, A_INY, A_ZPI, A_IMP, A_IMP, A_ZPX, A_ZPX, A_ZPG,
-  /* 58     59     5A     5B     5C     5D     5E     5F */ 
-  A_IMP, A_ABY, A_IMP, A_IMP, A_IMP, A_ABX, A_ABX, A_REL,
-  /* 60     61     62     63     64     65     66     67 */ 
-  A_IMP, A_INX, A_IMP, A_IMP, A_ZPG, A_ZPG, A_ZPG, A_ZPG,
-  /* 68     69     6A     6B     6C     6D     6E     6F */ 
-  A_IMP, A_IMM, A_ACC, A_IMP, A_IND, A_ABS, A_ABS, A_REL,
-  /* 70     71     72     73     74     75     76     77 */ 
-  A_REL, A_INY, A_ZPI, A_IMP, A_ZPX, A_ZPX, A_ZPX, A_ZPG,
-  /* 78     79     7A     7B     7C     7D     7E     7F */ 
-  A_IMP, A_ABY, A_IMP, A_IMP, A_ABX, A_ABX, A_ABX, A_REL,
-  /* 80     81     82     83     84     85     86     87 */ 
-  A_REL, A_INX, A_IMP, A_IMP, A_ZPG, A_ZPG, A_ZPG, A_ZPG,
-  /* 88     89     8A     8B     8C     8D     8E     8F */ 
-  A_IMP, A_IMM, A_IMP, A_IMP, A_ABS, A_ABS, A_ABS, A_REL,
-  /* 90     91     92     93     94     95     96     97 */ 
-  A_REL, A_INY, A_ZPI, A_IMP, A_ZPX, A_ZPX, A_ZPY, A_ZPG,
-  /* 98     99     9A     9B     9C     9D     9E     9F */ 
-  A_IMP, A_ABY, A_IMP, A_IMP, A_ABS, A_ABX, A_ABX, A_REL,
-  /* A0     A1     A2     A3     A4     A5     A6     A7 */ 
-  A_IMM, A_INX, A_IMM, A_IMP, A_ZPG, A_ZPG, A_ZPG, A_ZPG,
-  /* A8     A9     AA     AB     AC     AD     AE     AF */ 
-  A_IMP, A_IMM, A_IMP, A_IMP, A_ABS, A_ABS, A_ABS, A_REL,
-  /* B0     B1     B2     B3     B4     B5     B6     B7 */ 
-  A_REL, A_INY, A_ZPI, A_IMP, A_ZPX, A_ZPX, A_ZPY, A_ZPG,
-  /* B8     B9     BA     BB     BC     BD     BE     BF */ 
-  A_IMP, A_ABY, A_IMP, A_IMP, A_ABX, A_ABX, A_ABX, A_REL,
-  /* C0     C1     C2     C3     C4     C5     C6     C7 */ 
-  A_IMM, A_INX, A_IMP, A_IMP, A_ZPG, A_ZPG, A_ZPG, A_ZPG,
-  /* C8     C9     CA     CB     CC     CD     CE     CF */ 
-  A_IMP, A_IMM, A_IMP, A_IMP, A_ABS, A_ABS, A_ABS, A_REL,
-  /* D0     D1     D2     D3     D4     D5     D6     D7 */ 
-  A_REL, A_INY, A_ZPI, A_IMP, A_IMP, A_ZPX, A_ZPX, A_ZPG,
-  /* D8     D9     DA     DB     DC     DD     DE     DF */ 
-  A_IMP, A_ABY, A_IMP, A_IMP, A_IMP, A_ABX, A_ABX, A_REL,
-  /* E0     E1     E2     E3     E4     E5     E6     E7 */ 
-  A_IMM, A_INX, A_IMP, A_IMP, A_ZPG, A_ZPG, A_ZPG, A_ZPG,
-  /* E8     E9     EA     EB     EC     ED     EE     EF */ 
-  A_IMP, A_IMM, A_IMP, A_IMP, A_ABS, A_ABS, A_ABS, A_REL,
-  /* F0     F1     F2     F3     F4     F5     F6     F7 */ 
-  A_REL, A_INY, A_ZPI, A_IMP, A_IMP, A_ZPX, A_ZPX, A_ZPG,
-  /* F8     F9     FA     FB     FC     FD     FE     FF */ 
-  A_IMP, A_ABY, A_IMP, A_IMP, A_IMP, A_ABX, A_ABX, A_REL
+  V6502_OPCODES(_ADDRESSING_ENTRY)
+};
+
+/**
+ * Base cycle counts for the NMOS 6502. Opcodes that are undefined on
+ * the NMOS part are decoded as 65C02 instructions by this emulator and
+ * use the 65C02 timings.
+ */
+byte cycles_6502[] = {
+  /* 00 */ 7, 6, 2, 1, 5, 3, 5, 5, 3, 2, 2, 1, 6, 4, 6, 5,
+  /* 10 */ 2, 5, 5, 1, 5, 4, 6, 5, 2, 4, 2, 1, 6, 4, 7, 5,
+  /* 20 */ 6, 6, 2, 1, 3, 3, 5, 5, 4, 2, 2, 1, 4, 4, 6, 5,
+  /* 30 */ 2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 2, 1, 4, 4, 7, 5,
+  /* 40 */ 6, 6, 2, 1, 3, 3, 5, 5, 3, 2, 2, 1, 3, 4, 6, 5,
+  /* 50 */ 2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 3, 1, 8, 4, 7, 5,
+  /* 60 */ 6, 6, 2, 1, 3, 3, 5, 5, 4, 2, 2, 1, 5, 4, 6, 5,
+  /* 70 */ 2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 4, 1, 6, 4, 7, 5,
+  /* 80 */ 3, 6, 2, 1, 3, 3, 3, 5, 2, 2, 2, 1, 4, 4, 4, 5,
+  /* 90 */ 2, 6, 5, 1, 4, 4, 4, 5, 2, 5, 2, 1, 4, 5, 5, 5,
+  /* A0 */ 2, 6, 2, 1, 3, 3, 3, 5, 2, 2, 2, 1, 4, 4, 4, 5,
+  /* B0 */ 2, 5, 5, 1, 4, 4, 4, 5, 2, 4, 2, 1, 4, 4, 4, 5,
+  /* C0 */ 2, 6, 2, 1, 3, 3, 5, 5, 2, 2, 2, 3, 4, 4, 6, 5,
+  /* D0 */ 2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 3, 3, 4, 4, 7, 5,
+  /* E0 */ 2, 6, 2, 1, 3, 3, 5, 5, 2, 2, 2, 1, 4, 4, 6, 5,
+  /* F0 */ 2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 4, 1, 4, 4, 7, 5
+};
+
+/**
+ * Base cycle counts for the 65C02.
+ */
+byte cycles_65c02[] = {
+  /* 00 */ 7, 6, 2, 1, 5, 3, 5, 5, 3, 2, 2, 1, 6, 4, 6, 5,
+  /* 10 */ 2, 5, 5, 1, 5, 4, 6, 5, 2, 4, 2, 1, 6, 4, 6, 5,
+  /* 20 */ 6, 6, 2, 1, 3, 3, 5, 5, 4, 2, 2, 1, 4, 4, 6, 5,
+  /* 30 */ 2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 2, 1, 4, 4, 6, 5,
+  /* 40 */ 6, 6, 2, 1, 3, 3, 5, 5, 3, 2, 2, 1, 3, 4, 6, 5,
+  /* 50 */ 2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 3, 1, 8, 4, 6, 5,
+  /* 60 */ 6, 6, 2, 1, 3, 3, 5, 5, 4, 2, 2, 1, 6, 4, 6, 5,
+  /* 70 */ 2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 4, 1, 6, 4, 6, 5,
+  /* 80 */ 3, 6, 2, 1, 3, 3, 3, 5, 2, 2, 2, 1, 4, 4, 4, 5,
+  /* 90 */ 2, 6, 5, 1, 4, 4, 4, 5, 2, 5, 2, 1, 4, 5, 5, 5,
+  /* A0 */ 2, 6, 2, 1, 3, 3, 3, 5, 2, 2, 2, 1, 4, 4, 4, 5,
+  /* B0 */ 2, 5, 5, 1, 4, 4, 4, 5, 2, 4, 2, 1, 4, 4, 4, 5,
+  /* C0 */ 2, 6, 2, 1, 3, 3, 5, 5, 2, 2, 2, 3, 4, 4, 6, 5,
+  /* D0 */ 2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 3, 3, 4, 4, 7, 5,
+  /* E0 */ 2, 6, 2, 1, 3, 3, 5, 5, 2, 2, 2, 1, 4, 4, 6, 5,
+  /* F0 */ 2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 4, 1, 4, 4, 7, 5
 };
 
 #endif
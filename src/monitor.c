@@ -29,10 +29,13 @@
  */
 
 #include "monitor.h"
+#include "vstate.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 /* Monitor REPL - reads commands from a file or stdin */
 void monitor_repl(vmachine_t *machine, FILE *in) {
@@ -41,6 +44,9 @@ void monitor_repl(vmachine_t *machine, FILE *in) {
   char cmdbuf[256];
 
   while (!done) {
+    /* Show any output the guest left buffered before prompting */
+    machine_flush(machine);
+
     if (in == stdin) {
       printf("=> ");
     }
@@ -71,6 +77,15 @@ void monitor_trace_fn(vmachine_t *machine, cpu *prevc, cpu *c) {
   print_register_change("SP", prevc->sp, c->sp);
 }
 
+void monitor_step(cpu *c) {
+  cpu_step(c);
+  if (c->tick_ctx != NULL) {
+    c->tick_ctx(c->userdata);
+  } else if (c->tick != NULL) {
+    c->tick();
+  }
+}
+
 /* Input/output utilities */
 
 int read_line(FILE *in, char *buf, int maxlen) {
@@ -140,7 +155,7 @@ void print_memory(cpu *c, address start, address end) {
     }
 
     if (current >= start) {
-      printf("%02X ", c->read(current));
+      printf("%02X ", cpu_peek_byte(c, current));
     } else {
       printf("   ");
     }
@@ -160,13 +175,20 @@ void print_help(void) {
   puts("  H | HELP         - show this help screen");
   puts("  R | RESET        - reset CPU");
   puts("  S | STEP         - step");
+  puts("  RS | RSTEP       - step back one instruction");
+  puts("  RC | RCONTINUE [10F0] - run backwards to a breakpoint [or address 10F0]");
+  puts("  HISTORY [N|OFF]  - show, start with N undo entries, or stop the history");
   puts("  G | GO [10F0]    - start execution [at address 10F0 if provided]");
   puts("  T | TRACE [10F0] - start execution and print all changes to CPU state");
+  puts("  TRACEFILE [FILE|OFF] - show, start or stop a binary trace to FILE");
+  puts("  PROFILE [ON|OFF|CLEAR|SAVE FILE] - show the busiest addresses, or control profiling");
+  puts("  CALLS [ON|OFF|CLEAR|SAVE FILE] - show the busiest routines, or control call graph profiling");
+  puts("  STATS [CLEAR]    - show or clear the opcode and addressing mode mix");
   puts("  V | VERBOSE      - toggle verbose output");
   puts("  Q | QUIT         - quit");
   puts("");
   puts("Working with Registers:");
-  puts("  ?         - print all register values");
+  puts("  ?         - print all register values and the cycle count");
   puts("  PC [FFFF] - print or set the program counter");
   puts("  A [FF]    - print or set the accumulator");
   puts("  X [FF]    - print or set the X index register");
@@ -189,6 +211,9 @@ void print_help(void) {
   puts("  SAVE 1000.10F0 <FILENAME> - Save data in Wozmon format.");
   puts("  PROTECT D000.FFFF         - Protect memory range from writes.");
   puts("  UNPROTECT D000.FFFF       - Unprotect memory range for writes.");
+  puts("  SAVESTATE <FILENAME>      - Save the whole machine state.");
+  puts("  SAVEDELTA <FILENAME>      - Save changes since the last checkpoint.");
+  puts("  LOADSTATE <FILENAME> [..] - Restore a saved state and its deltas.");
 }
 
 void not_implemented(void) {
@@ -314,7 +339,7 @@ int write_file(vmachine_t *machine, address_range ar, char *filename) {
   a = ar.start;
   fprintf(file, "%04X:", a);
   while (a <= ar.end) {
-    fprintf(file, " %02X", c->read(a));
+    fprintf(file, " %02X", cpu_peek_byte(c, a));
     a++;
     i++;
     if (a <= ar.end && (i % 8) == 0) {
@@ -348,6 +373,372 @@ int read_file(vmachine_t *machine, char *filename) {
   return 0;
 }
 
+/* History commands */
+
+void history_command(vmachine_t *machine, int argc, char **argv) {
+  vhistory_t *history = machine->history;
+  unsigned long entries = VHISTORY_DEFAULT_ENTRIES;
+  char *end = NULL;
+  int i;
+
+  if (argc == 1) {
+    if (history == NULL) {
+      puts("History is off.");
+    } else {
+      printf("History: %lu instructions, %lu of %lu entries, %u snapshots\n",
+             history->instructions, history->count, history->size,
+             history->snapshot_count);
+    }
+    return;
+  }
+
+  for (i = 0; argv[1][i]; i++) {
+    argv[1][i] = toupper((unsigned char) argv[1][i]);
+  }
+  if (!strcmp("OFF", argv[1])) {
+    machine_set_history(machine, NULL);
+    puts("History stopped.");
+    return;
+  }
+  if (strcmp("ON", argv[1])) {
+    entries = strtoul(argv[1], &end, 10);
+    if (*end != '\0' || entries == 0) {
+      printf("Invalid number of entries: %s\n", argv[1]);
+      return;
+    }
+  }
+
+  history = vhistory_create(entries, VHISTORY_DEFAULT_SNAPSHOTS, VHISTORY_DEFAULT_INTERVAL);
+  if (history == NULL) {
+    puts("Not enough memory for the history.");
+    return;
+  }
+  machine_set_history(machine, history);
+  printf("History started, %lu entries.\n", entries);
+}
+
+/* Binary trace command */
+
+void trace_command(vmachine_t *machine, int argc, char **argv) {
+  vtrace_t *trace = machine->trace;
+
+  if (argc == 1) {
+    if (trace == NULL) {
+      puts("Binary trace is off.");
+    } else {
+      printf("Binary trace: %lu instructions\n", trace->records);
+    }
+    return;
+  }
+
+  if (!strcmp("OFF", argv[1]) || !strcmp("off", argv[1])) {
+    if (trace != NULL) {
+      printf("Binary trace stopped, %lu instructions.\n", trace->records);
+    }
+    if (machine_set_trace(machine, NULL) != 0) {
+      puts("Error writing the trace file.");
+    }
+    return;
+  }
+
+  trace = vtrace_open(argv[1], VTRACE_DEFAULT_BUFFER);
+  if (trace == NULL) {
+    printf("Unable to create trace file: %s\n", argv[1]);
+    return;
+  }
+  if (machine_set_trace(machine, trace) != 0) {
+    puts("Error writing the previous trace file.");
+  }
+  printf("Binary trace started: %s\n", argv[1]);
+}
+
+/* Profile commands */
+
+#define PROFILE_TOP 16
+
+/* Print the addresses that used the most cycles. */
+static void print_profile(cpu_profile_t *profile) {
+  long top[PROFILE_TOP];
+  double total = 0;
+  int count = 0;
+  int i, j;
+  long a;
+
+  for (a = 0; a < CPU_PROFILE_ENTRIES; a++) {
+    if (profile[a].instructions == 0) continue;
+    total += (double)profile[a].cycles;
+    for (i = count; i > 0 && profile[top[i - 1]].cycles < profile[a].cycles; i--) {
+      if (i < PROFILE_TOP) top[i] = top[i - 1];
+    }
+    if (i < PROFILE_TOP) {
+      top[i] = a;
+      if (count < PROFILE_TOP) count++;
+    }
+  }
+  if (count == 0) {
+    puts("No instructions profiled yet.");
+    return;
+  }
+  printf("Addr %14s %6s %14s\n", "Cycles", "%", "Instructions");
+  for (j = 0; j < count; j++) {
+    printf("%04lX %14.0f %6.2f %14.0f\n", top[j], (double)profile[top[j]].cycles,
+           100.0 * (double)profile[top[j]].cycles / total,
+           (double)profile[top[j]].instructions);
+  }
+}
+
+/* Save one "ADDR INSTRUCTIONS CYCLES" line per executed address. */
+int save_profile(cpu_profile_t *profile, char *filename) {
+  FILE *file;
+  long a;
+
+  file = fopen(filename, "w");
+  if (file == NULL) {
+    printf("Unable to open file: %s\n", filename);
+    return -1;
+  }
+  fputs("; v6502c profile: address, instructions, cycles\n", file);
+  for (a = 0; a < CPU_PROFILE_ENTRIES; a++) {
+    if (profile[a].instructions == 0) continue;
+    fprintf(file, "%04lX %.0f %.0f\n", a, (double)profile[a].instructions,
+            (double)profile[a].cycles);
+  }
+  if (fclose(file) != 0) {
+    printf("Error writing file: %s\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+void profile_command(vmachine_t *machine, int argc, char **argv) {
+  cpu_profile_t *profile = machine->c.profile;
+  int i;
+
+  if (argc == 1) {
+    if (profile == NULL) {
+      puts("Profiling is off.");
+    } else {
+      print_profile(profile);
+    }
+    return;
+  }
+
+  for (i = 0; argv[1][i]; i++) {
+    argv[1][i] = toupper((unsigned char) argv[1][i]);
+  }
+  if (!strcmp("ON", argv[1])) {
+    if (profile == NULL) {
+      profile = (cpu_profile_t *)calloc(CPU_PROFILE_ENTRIES, sizeof(cpu_profile_t));
+      if (profile == NULL) {
+        puts("Not enough memory for the profile.");
+        return;
+      }
+      machine_set_profile(machine, profile);
+    }
+    puts("Profiling started.");
+  } else if (!strcmp("OFF", argv[1])) {
+    machine_set_profile(machine, NULL);
+    puts("Profiling stopped.");
+  } else if (profile == NULL) {
+    puts("Profiling is off.");
+  } else if (!strcmp("CLEAR", argv[1])) {
+    memset(profile, 0, CPU_PROFILE_ENTRIES * sizeof(cpu_profile_t));
+    puts("Profile cleared.");
+  } else if (!strcmp("SAVE", argv[1]) && argc > 2) {
+    if (save_profile(profile, argv[2]) == 0) {
+      printf("Profile saved: %s\n", argv[2]);
+    }
+  } else {
+    printf("Invalid argument: %s\n", argv[1]);
+  }
+}
+
+/* Call graph commands */
+
+/* Print the routines that used the most cycles, callees included. */
+static void print_calls(vcalls_t *calls) {
+  vcalls_total_t *totals;
+  double total = 0;
+  long count;
+  long i;
+
+  for (i = 0; i < (long)calls->count; i++) {
+    total += (double)calls->nodes[i].cycles;
+  }
+  count = vcalls_totals(calls, &totals);
+  if (count < 0) {
+    puts("Not enough memory for the report.");
+    return;
+  }
+  if (count == 0) {
+    puts("No calls profiled yet.");
+  } else {
+    printf("Addr %14s %6s %14s %10s\n", "Inclusive", "%", "Exclusive", "Calls");
+    for (i = 0; i < count && i < PROFILE_TOP; i++) {
+      printf("%04X %14.0f %6.2f %14.0f %10.0f\n", totals[i].callee,
+             (double)totals[i].inclusive, 100.0 * (double)totals[i].inclusive / total,
+             (double)totals[i].exclusive, (double)totals[i].calls);
+    }
+  }
+  if (calls->lost > 0) {
+    printf("%lu calls were not followed.\n", calls->lost);
+  }
+  free(totals);
+}
+
+void calls_command(vmachine_t *machine, int argc, char **argv) {
+  vcalls_t *calls = machine->calls;
+  FILE *file;
+  int i;
+
+  if (argc == 1) {
+    if (calls == NULL) {
+      puts("Call graph profiling is off.");
+    } else {
+      vcalls_update(calls, &machine->c);
+      print_calls(calls);
+    }
+    return;
+  }
+
+  for (i = 0; argv[1][i]; i++) {
+    argv[1][i] = toupper((unsigned char) argv[1][i]);
+  }
+  if (!strcmp("ON", argv[1])) {
+    if (calls == NULL) {
+      calls = vcalls_create();
+      if (calls == NULL) {
+        puts("Not enough memory for the call graph.");
+        return;
+      }
+      machine_set_calls(machine, calls);
+    }
+    puts("Call graph profiling started.");
+  } else if (!strcmp("OFF", argv[1])) {
+    machine_set_calls(machine, NULL);
+    puts("Call graph profiling stopped.");
+  } else if (calls == NULL) {
+    puts("Call graph profiling is off.");
+  } else if (!strcmp("CLEAR", argv[1])) {
+    vcalls_clear(calls, &machine->c);
+    puts("Call graph cleared.");
+  } else if (!strcmp("SAVE", argv[1]) && argc > 2) {
+    file = fopen(argv[2], "w");
+    if (file == NULL) {
+      printf("Unable to open file: %s\n", argv[2]);
+      return;
+    }
+    vcalls_update(calls, &machine->c);
+    i = vcalls_write_collapsed(calls, file);
+    if (fclose(file) != 0 || i != 0) {
+      printf("Error writing file: %s\n", argv[2]);
+    } else {
+      printf("Call graph saved: %s\n", argv[2]);
+    }
+  } else {
+    printf("Invalid argument: %s\n", argv[1]);
+  }
+}
+
+/* Instruction mix command */
+
+#if defined(V6502C_STATS)
+
+static clock_t stats_start = 0;
+
+static int _by_count(const void *a, const void *b) {
+  const count_t *ca = *(const count_t * const *)a;
+  const count_t *cb = *(const count_t * const *)b;
+
+  if (*ca != *cb) return *ca < *cb ? 1 : -1;
+  return ca < cb ? -1 : 1;
+}
+
+/* Print counts largest first, with a bar scaled to the largest. */
+static void print_histogram(count_t *counts, int n, count_t total, bool opcodes) {
+  count_t *sorted[256];
+  int i, j, bar;
+
+  for (i = 0; i < n; i++) {
+    sorted[i] = &counts[i];
+  }
+  qsort(sorted, n, sizeof(count_t *), _by_count);
+  for (i = 0; i < n && *sorted[i] > 0; i++) {
+    j = (int)(sorted[i] - counts);
+    if (opcodes) {
+      printf("  %02X %-4s %-3s", j, cpu_opcode_name((byte)j), cpu_addressing_name(cpu_opcode_addressing((byte)j)));
+    } else {
+      printf("  %-11s", cpu_addressing_name(j));
+    }
+    printf(" %14.0f %6.2f%% ", (double)*sorted[i], 100.0 * (double)*sorted[i] / (double)total);
+    bar = (int)(40.0 * (double)*sorted[i] / (double)*sorted[0] + 0.5);
+    while (bar-- > 0) putchar('#');
+    putchar('\n');
+  }
+}
+
+#endif
+
+void stats_command(vmachine_t *machine, int argc, char **argv) {
+#if defined(V6502C_STATS)
+  cpu_stats_t stats;
+  double seconds;
+  int i;
+
+  if (argc > 1) {
+    for (i = 0; argv[1][i]; i++) {
+      argv[1][i] = toupper((unsigned char) argv[1][i]);
+    }
+    if (!strcmp("CLEAR", argv[1])) {
+      cpu_clear_stats(&machine->c);
+      stats_start = clock();
+      puts("Statistics cleared.");
+    } else {
+      printf("Invalid argument: %s\n", argv[1]);
+    }
+    return;
+  }
+
+  cpu_get_stats(&machine->c, &stats);
+  if (stats.instructions == 0) {
+    puts("No instructions run yet.");
+    return;
+  }
+  puts("Opcodes:");
+  print_histogram(stats.opcodes, 256, stats.instructions, TRUE);
+  puts("Addressing modes:");
+  print_histogram(stats.addressings, CPU_ADDRESSING_MODES, stats.instructions, FALSE);
+  printf("Instructions: %.0f\n", (double)stats.instructions);
+  seconds = (double)(clock() - stats_start) / CLOCKS_PER_SEC;
+  if (seconds > 0) {
+    printf("Instructions per second of host CPU time: %.0f\n",
+           (double)stats.instructions / seconds);
+  }
+  printf("Reads per instruction: %.2f\n", (double)stats.reads / (double)stats.instructions);
+  printf("Writes per instruction: %.2f\n", (double)stats.writes / (double)stats.instructions);
+#else
+  puts("Statistics are not built in, rebuild with make STATS=-DV6502C_STATS");
+#endif
+}
+
+void print_history_stop(enum vhistory_stop_t stop, address pc) {
+  switch (stop) {
+  case VHISTORY_STOP_NONE:
+    puts("No history to run back through.");
+    return;
+  case VHISTORY_STOP_BREAKPOINT:
+    puts("Stopped.");
+    break;
+  case VHISTORY_STOP_SNAPSHOT:
+    puts("Undo log exhausted, restored the previous snapshot.");
+    break;
+  case VHISTORY_STOP_START:
+    puts("Reached the start of the history.");
+    break;
+  }
+  print_pc(pc);
+}
+
 /* Command parsing */
 
 int parse_command(vmachine_t *machine, char *cmdbuf) {
@@ -359,6 +750,8 @@ int parse_command(vmachine_t *machine, char *cmdbuf) {
   address current = 0;
   byte b = 0;
   address_range ar;
+  long size = 0;
+  enum vhistory_stop_t stop;
   char *p = cmdbuf;
 
   /* Skip leading whitespace */
@@ -392,9 +785,32 @@ int parse_command(vmachine_t *machine, char *cmdbuf) {
     return 1;
   } else if (!strcmp("R", cmd) || !strcmp("RESET", cmd)) {
     cpu_reset(c);
-    cpu_step(c);
+    monitor_step(c);
   } else if (!strcmp("S", cmd) || !strcmp("STEP", cmd)) {
-    cpu_step(c);
+    monitor_step(c);
+  } else if (!strcmp("RS", cmd) || !strcmp("RSTEP", cmd)) {
+    if (vhistory_step_back(machine)) {
+      print_pc(c->pc);
+    } else {
+      puts("No history to step back through.");
+    }
+  } else if (!strcmp("RC", cmd) || !strcmp("RCONTINUE", cmd)) {
+    if (argc > 1 && !parse_address(argv[1], &current)) {
+      printf("Invalid address: %s\n", argv[1]);
+    } else {
+      stop = vhistory_continue_back(machine, argc > 1 ? (long)current : -1);
+      print_history_stop(stop, c->pc);
+    }
+  } else if (!strcmp("HISTORY", cmd)) {
+    history_command(machine, argc, argv);
+  } else if (!strcmp("TRACEFILE", cmd)) {
+    trace_command(machine, argc, argv);
+  } else if (!strcmp("PROFILE", cmd)) {
+    profile_command(machine, argc, argv);
+  } else if (!strcmp("CALLS", cmd)) {
+    calls_command(machine, argc, argv);
+  } else if (!strcmp("STATS", cmd)) {
+    stats_command(machine, argc, argv);
   } else if (!strcmp("G", cmd) || !strcmp("GO", cmd) ||
              !strcmp("T", cmd) || !strcmp("TRACE", cmd)) {
     V6502C_TRACE = (!strcmp("T", cmd) || !strcmp("TRACE", cmd));
@@ -419,6 +835,7 @@ int parse_command(vmachine_t *machine, char *cmdbuf) {
     print_register(" Y", c->y);
     print_register("SR", c->sr);
     print_register("SP", c->sp);
+    printf("CY : %lu\n", (unsigned long) c->cycles);
   } else if (!strcmp("PC", cmd)) {
     if (argc == 1) {
       print_pc(c->pc);
@@ -519,6 +936,28 @@ int parse_command(vmachine_t *machine, char *cmdbuf) {
         write_file(machine, ar, filename);
       }
     }
+  } else if (!strcmp("SAVESTATE", cmd) || !strcmp("SAVEDELTA", cmd)) {
+    if (argc == 1) {
+      puts("Please provide a filename.");
+    } else {
+      size = !strcmp("SAVESTATE", cmd) ?
+        vmachine_save_state(machine, argv[1]) :
+        vmachine_save_delta(machine, argv[1]);
+      if (size < 0) {
+        printf("Could not save state to %s\n", argv[1]);
+      } else {
+        printf("Saved state to %s, %ld bytes\n", argv[1], size);
+      }
+    }
+  } else if (!strcmp("LOADSTATE", cmd)) {
+    if (argc == 1) {
+      puts("Please provide a filename.");
+    } else if (vmachine_load_state_chain(machine, (const char **)&argv[1], argc - 1) < 0) {
+      printf("Could not load state from %s\n", argv[1]);
+    } else {
+      printf("Loaded state from %s\n", argv[1]);
+      print_pc(c->pc);
+    }
   } else if (!strcmp("PROTECT", cmd)) {
     if (argc == 1) {
       puts("Please provide an address range.");
@@ -598,7 +1037,7 @@ int parse_command(vmachine_t *machine, char *cmdbuf) {
       } else {
         /* now we should only get bytes */
         if (parse_byte(arg, &b)) {
-          c->write(current, b);
+          cpu_poke_byte(c, current, b);
           current++;
           if (editing == EDITING_RANGE) {
             if (current > ar.end) {
@@ -614,5 +1053,7 @@ int parse_command(vmachine_t *machine, char *cmdbuf) {
     } /* for i = 1 to argc */
   } /* command list */
 
+  /* Register edits are where the next instruction starts from */
+  vhistory_sync(machine->history, machine);
   return 0;
 }
@@ -32,6 +32,7 @@
  */
 
 #include "vmachine.h"
+#include "vhistory.h"
 
 /* Monitor entry point - starts the interactive REPL */
 void monitor_run(vmachine_t *machine);
@@ -42,6 +43,9 @@ void monitor_repl(vmachine_t *machine, FILE *in);
 /* Trace callback for use with vmachine_t.trace_fn */
 void monitor_trace_fn(vmachine_t *machine, cpu *prevc, cpu *c);
 
+/* Step one instruction and call the tick function, as cpu_run() does */
+void monitor_step(cpu *c);
+
 /* Command parsing */
 int parse_command(vmachine_t *machine, char *cmdbuf);
 
@@ -64,6 +68,23 @@ int parse_byte(char *s, byte *b);
 int parse_address(char *s, address *a);
 int parse_address_range(char *s, address_range *r);
 
+/* History commands */
+void history_command(vmachine_t *machine, int argc, char **argv);
+void print_history_stop(enum vhistory_stop_t stop, address pc);
+
+/* Binary trace command */
+void trace_command(vmachine_t *machine, int argc, char **argv);
+
+/* Profile commands */
+void profile_command(vmachine_t *machine, int argc, char **argv);
+int save_profile(cpu_profile_t *profile, char *filename);
+
+/* Call graph commands */
+void calls_command(vmachine_t *machine, int argc, char **argv);
+
+/* Instruction mix command, needs a build with -DV6502C_STATS */
+void stats_command(vmachine_t *machine, int argc, char **argv);
+
 /* File I/O commands */
 int write_file(vmachine_t *machine, address_range ar, char *filename);
 int read_file(vmachine_t *machine, char *filename);
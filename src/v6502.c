@@ -23,6 +23,8 @@
  *
  */
 
+#include <string.h>
+
 #include "v6502.h"
 #include "inst.h"
 
@@ -37,6 +39,17 @@ bool V6502C_VERBOSE = FALSE;
 #define OVERFLOW_FLAG 6
 #define NEGATIVE_FLAG 7
 
+/** Count an event in the instruction mix when built with stats. */
+#if defined(V6502C_STATS)
+#define _STAT(x) (x)
+#else
+#define _STAT(x)
+#endif
+
+/** Report a call or return to the optional call callback. */
+#define _CALL(c, kind) \
+  if ((c)->call_ctx != NULL) (c)->call_ctx((c)->userdata, (kind))
+
 /** Helper method for setting a bit. */
 void _set_bit(cpu *c, byte bit) {
   c->sr = c->sr | (1<<bit);
@@ -114,6 +127,8 @@ void _reset(cpu *c) {
   c->reset = FALSE;
   c->irq = FALSE;
   c->nmi = FALSE;
+  c->stopped = FALSE;
+  c->waiting = FALSE;
 }
 
 /**
@@ -146,6 +161,7 @@ void _service_interrupt(cpu *c, address vector, bool is_brk) {
 
   /* Load PC from vector */
   c->pc = cpu_read_address(c, vector);
+  _CALL(c, CPU_CALL_INTERRUPT);
 }
 
 void cpu_init(cpu *c) {
@@ -153,7 +169,19 @@ void cpu_init(cpu *c) {
   c->write = NULL;
   c->read = NULL;
   c->tick = NULL;
+  c->userdata = NULL;
+  c->read_ctx = NULL;
+  c->write_ctx = NULL;
+  c->tick_ctx = NULL;
+  c->call_ctx = NULL;
+#if defined(V6502C_STATS)
+  cpu_clear_stats(c);
+#endif
   c->variant = CPU_65C02;  /* Default to 65C02 */
+  c->cycles = 0;
+  c->breakpoints = NULL;
+  c->profile = NULL;
+  c->irq_line = FALSE;
   _reset(c);
 }
 
@@ -164,11 +192,30 @@ void cpu_set_variant(cpu *c, enum cpu_variant_t variant) {
 
 byte cpu_read_byte(cpu *c, address a) {
   byte b = 0;
-  if (c == NULL || c->read == NULL) return 0;
+  if (c == NULL) return 0;
+  _STAT(c->stats.reads++);
+  if (c->read_ctx != NULL) return c->read_ctx(c->userdata, a);
+  if (c->read == NULL) return 0;
   b = c->read(a);
   return b;
 }
 
+byte cpu_peek_byte(cpu *c, address a) {
+  if (c == NULL) return 0;
+  if (c->read_ctx != NULL) return c->read_ctx(c->userdata, a);
+  if (c->read == NULL) return 0;
+  return c->read(a);
+}
+
+void cpu_poke_byte(cpu *c, address a, byte b) {
+  if (c == NULL) return;
+  if (c->write_ctx != NULL) {
+    c->write_ctx(c->userdata, a, b);
+  } else if (c->write != NULL) {
+    c->write(a, b);
+  }
+}
+
 address cpu_read_address(cpu *c, address a) {
   byte hi = 0, lo = 0;
   address value;
@@ -181,8 +228,13 @@ address cpu_read_address(cpu *c, address a) {
 }
 
 void cpu_write_byte(cpu *c, address a, byte b) {
-  if (c == NULL || c->write == NULL) return;
-  c->write(a, b);
+  if (c == NULL) return;
+  _STAT(c->stats.writes++);
+  if (c->write_ctx != NULL) {
+    c->write_ctx(c->userdata, a, b);
+  } else if (c->write != NULL) {
+    c->write(a, b);
+  }
 }
 
 void cpu_write_address(cpu *c, address a, address value) {
@@ -207,727 +259,1221 @@ address cpu_next_address(cpu *c) {
   return a;
 }
 
-void cpu_step(cpu *c) {
-  byte b = 0, i = 0, temp = 0, lo = 0, hi = 0;
-  signed char offset = 0;
-  address a = 0;
-  enum instruction_t instruction = I_BRK;
-  enum addressing_t addressing = A_IMP;
-  
-  if (c == NULL) return;
+/*
+ * Addressing modes.
+ *
+ * Each loader consumes the operand bytes following the opcode and
+ * produces the effective address in *a and, unless the instruction
+ * is a store, the operand value in *b. Loaders return TRUE when
+ * indexing crossed a page boundary, which costs an extra cycle for
+ * instructions that only read their operand.
+ */
 
-  /** Handle reset. */
-  if (c->reset) {
-    c->reset = FALSE;
-    _reset(c);
-    return;
+/**
+ * TRUE if instruction i takes an extra cycle when indexing crosses a
+ * page. The 65C02 also charges it for shifts and rotates.
+ */
+#define _PAGE_PENALTY(i, v) \
+  ((i) == I_ADC || (i) == I_AND || (i) == I_BIT || (i) == I_CMP || \
+   (i) == I_EOR || (i) == I_LDA || (i) == I_LDX || (i) == I_LDY || \
+   (i) == I_ORA || (i) == I_SBC || \
+   ((v) == CPU_65C02 && ((i) == I_ASL || (i) == I_LSR || \
+                         (i) == I_ROL || (i) == I_ROR)))
+
+/** Helper method to check whether two addresses are on different pages. */
+#define _PAGE_CROSSED(x, y) ((((x) ^ (y)) & 0xFF00) != 0)
+
+/** accumulator */
+static bool _load_A_ACC(cpu *c, bool store, address *a, byte *b) {
+  *b = c->a;
+  return FALSE;
+}
+
+/** absolute */
+static bool _load_A_ABS(cpu *c, bool store, address *a, byte *b) {
+  *a = cpu_next_address(c);
+  if (!store) {
+    *b = cpu_read_byte(c, *a);
   }
-  
-  b = cpu_next_byte(c);
+  return FALSE;
+}
 
-  instruction = instructions[b];
-  addressing = addressings[b];
+/** absolute, x-indexed */
+static bool _load_A_ABX(cpu *c, bool store, address *a, byte *b) {
+  address base = cpu_next_address(c);
+  *a = base + c->x;
+  if (!store) {
+    *b = cpu_read_byte(c, *a);
+  }
+  return _PAGE_CROSSED(base, *a);
+}
 
-  /** load data */
-  switch (addressing) {
-  case A_ACC:
-    /* accumulator */
-    b = c->a;
-    break;
-  case A_ABS:
-    /* absolute */
-    a = cpu_next_address(c);
-    if (!_is_store(instruction)) {
-      b = cpu_read_byte(c, a);
-    }
-    break;
-  case A_ABX:
-    /* absolute, x-indexed */
-    a = cpu_next_address(c) + c->x;
-    if (!_is_store(instruction)) {
-      b = cpu_read_byte(c, a);
-    }
-    break;
-  case A_ABY:
-    /* absolute, y-indexed */
-    a = cpu_next_address(c) + c->y;
-    if (!_is_store(instruction)) {
-      b = cpu_read_byte(c, a);
-    }
-    break;
-  case A_IMM:
-    /* immediate */
-    b = cpu_next_byte(c);
-    break;
-  case A_IND:
-    /* indirect */
-    /* Only used for JMP, result is an address */
-    /*
-     * Note: The NMOS 6502 has a bug where JMP ($xxFF) wraps within the
-     * same page when reading the high byte (e.g., JMP ($10FF) reads the
-     * low byte from $10FF but the high byte from $1000, not $1100).
-     * This implementation uses 65C02 behavior which correctly crosses
-     * page boundaries. This is intentional as few programs rely on
-     * the bug and the correct behavior is more useful.
-     */
-    a = cpu_next_address(c);
-    a = cpu_read_address(c, a);
-    break;
-  case A_INX:
-    /* pre-indexed indirect - wraps within zero page */
-    a = ((address) cpu_next_byte(c) + c->x) & 0xFF;
-    /* Read pointer from zero page (may wrap at page boundary) */
-    lo = cpu_read_byte(c, a);
-    hi = cpu_read_byte(c, (a + 1) & 0xFF);
-    a = (hi << 8) | lo;
-    if (!_is_store(instruction)) {
-      b = cpu_read_byte(c, a);
-    }
-    break;
-  case A_INY:
-    /* post-indexed indirect - pointer wraps within zero page */
-    a = (address) cpu_next_byte(c);
-    /* Read pointer from zero page (may wrap at page boundary) */
-    lo = cpu_read_byte(c, a);
-    hi = cpu_read_byte(c, (a + 1) & 0xFF);
-    a = ((hi << 8) | lo) + c->y;
-    if (!_is_store(instruction)) {
-      b = cpu_read_byte(c, a);
-    }
-    break;
-  case A_REL:
-    /* relative */
-    /* used for branching, result is an address */
-    offset = (signed char) cpu_next_byte(c);
-    a = c->pc + offset;
-    break;
-  case A_ZPG:
-    /* zero-page */
-    a = (address) cpu_next_byte(c);
-    if (!_is_store(instruction)) {
-      b = cpu_read_byte(c, a);
-    }
-    break;
-  case A_ZPX:
-    /* zero-page x-indexed - wraps within zero page */
-    a = ((address) cpu_next_byte(c) + c->x) & 0xFF;
-    if (!_is_store(instruction)) {
-      b = cpu_read_byte(c, a);
-    }
-    break;
-  case A_ZPY:
-    /* zero-page y-indexed - wraps within zero page */
-    a = ((address) cpu_next_byte(c) + c->y) & 0xFF;
-    if (!_is_store(instruction)) {
-      b = cpu_read_byte(c, a);
-    }
-    break;
-  case A_ZPI:
-    /* zero-page indirect */
-    /* WDC extension for W65C02 */
-    a = (address) cpu_next_byte(c);
-    a = cpu_read_address(c, a);
-    if (!_is_store(instruction)) {
-      b = cpu_read_byte(c, a);
-    }
-    break;
-  case A_ABI:
-    /* absolute indexed indirect */
-    /* WDC extension for W65C02 */
-    /* Only for JMP, result is an address */
-    a = cpu_next_address(c) + c->x;
-    a = cpu_read_address(c, a);
-    break;
-  case A_IMP:
-  default:
-    /* implied */
-    /* No address needed */
-    break;
+/** absolute, y-indexed */
+static bool _load_A_ABY(cpu *c, bool store, address *a, byte *b) {
+  address base = cpu_next_address(c);
+  *a = base + c->y;
+  if (!store) {
+    *b = cpu_read_byte(c, *a);
   }
+  return _PAGE_CROSSED(base, *a);
+}
 
-  /** perform instruction */
-  switch (instruction) {
-  case I_ADC:
-    /* add with carry */
-    {
-      int carry_in = _check_bit(c, CARRY_FLAG) ? 1 : 0;
-      
-      if (_check_bit(c, BCD_FLAG)) {
-        /* BCD (Decimal) Mode */
-        byte original_a = c->a;
-        int lo_nibble = (c->a & 0x0F) + (b & 0x0F) + carry_in;
-        int hi_nibble = (c->a >> 4) + (b >> 4);
-        int binary_result = c->a + b + carry_in;
-        
-        /* Adjust low nibble if > 9 */
-        if (lo_nibble > 9) {
-          lo_nibble += 6;    /* Add 6 to convert to BCD */
-          hi_nibble++;       /* Carry to high nibble */
-        }
-        
-        /* Adjust high nibble if > 9 */
-        if (hi_nibble > 9) {
-          hi_nibble += 6;    /* Add 6 to convert to BCD */
-          _set_bit(c, CARRY_FLAG);  /* Set carry out */
-        } else {
-          _clear_bit(c, CARRY_FLAG);
-        }
-        
-        c->a = ((hi_nibble & 0x0F) << 4) | (lo_nibble & 0x0F);
-        
-        /* In BCD mode, N and Z flags reflect the binary result on 6502 */
-        _set_zero_flag(c, binary_result & 0xFF);
-        _set_negative_flag(c, binary_result);
-        
-        /* Overflow flag behavior differs between CPU variants */
-        if (c->variant == CPU_65C02) {
-          /* 65C02: V flag reflects signed overflow like in binary mode */
-          if (((original_a ^ binary_result) & (b ^ binary_result) & 0x80) != 0) {
-            _set_bit(c, OVERFLOW_FLAG);
-          } else {
-            _clear_bit(c, OVERFLOW_FLAG);
-          }
-        } else {
-          /* Original 6502: V flag undefined in BCD mode */
-          _clear_bit(c, OVERFLOW_FLAG);
-        }
-        
-      } else {
-        /* Binary Mode */
-        int result = c->a + b + carry_in;
-        
-        /* Set carry flag if result > 255 (unsigned overflow) */
-        if (result > 0xFF) {
-          _set_bit(c, CARRY_FLAG);
-        } else {
-          _clear_bit(c, CARRY_FLAG);
-        }
-        
-        /* Set overflow flag if signed overflow occurred */
-        /* Overflow happens when: (+) + (+) = (-) or (-) + (-) = (+) */
-        if (((c->a ^ result) & (b ^ result) & 0x80) != 0) {
-          _set_bit(c, OVERFLOW_FLAG);
-        } else {
-          _clear_bit(c, OVERFLOW_FLAG);
-        }
-        
-        c->a = result & 0xFF;
-        _set_zero_flag(c, c->a);
-        _set_negative_flag(c, c->a);
-      }
-    }
-    break;
-  case I_AND:
-    /* and */
-    c->a = c->a & b;
-    _set_zero_flag(c, c->a);
-    _set_negative_flag(c, c->a);
-    break;
-  case I_ASL:
-    /* arithmetic shift left */
-    if (b & (1<<7)) {
-      _set_bit(c, CARRY_FLAG);
-    } else {
-      _clear_bit(c, CARRY_FLAG);
-    }
-    b = b << 1;
-    if (addressing == A_ACC) {
-      c->a = b;
-    } else {
-      cpu_write_byte(c, a, b);
-    }
-    _set_zero_flag(c, b);
-    _set_negative_flag(c, b);
-    break;
-  case I_BCC:
-    /* branch on carry clear */
-    if (!_check_bit(c, CARRY_FLAG)) {
-      c->pc = a;
-    }
-    break;
-  case I_BCS:
-    /* branch on carry set */
-    if (_check_bit(c, CARRY_FLAG)) {
-      c->pc = a;
-    }
-    break;
-  case I_BEQ:
-    /* branch on equal (zero) */
-    if (_check_bit(c, ZERO_FLAG)) {
-      c->pc = a;
-    }
-    break;
-  case I_BIT:
-    if (b & (1<<7)) {
-      _set_bit(c, 7);
-    } else {
-      _clear_bit(c, 7);
-    }
+/** immediate */
+static bool _load_A_IMM(cpu *c, bool store, address *a, byte *b) {
+  *b = cpu_next_byte(c);
+  return FALSE;
+}
 
-    if (b & (1<<6)) {
-      _set_bit(c, 6);
-    } else {
-      _clear_bit(c, 6);
-    }
-      
-    temp = c->a & b;
-    _set_zero_flag(c, temp);
-    break;
-  case I_BMI:
-    /* branch on negative */
-    if (_check_bit(c, NEGATIVE_FLAG)) {
-      c->pc = a;
-    }
-    break;
-  case I_BNE:
-    /* branch on not equal (not zero) */
-    if (!_check_bit(c, ZERO_FLAG)) {
-      c->pc = a;
-    }
-    break;
-  case I_BPL:
-    /* branch on positive (not negative) */
-    if (!_check_bit(c, NEGATIVE_FLAG)) {
-      c->pc = a;
-    }
-    break;
-  case I_BRK:
-    /* software interrupt */
-    c->pc++;  /* Skip padding byte after BRK opcode */
-    _service_interrupt(c, IRQ_VECTOR, TRUE);
-    break;
-  case I_BVC:
-    /* branch on overflow clear */
-    if (!_check_bit(c, OVERFLOW_FLAG)) {
-      c->pc = a;
-    }
-    break;
-  case I_BVS:
-    /* branch on overflow set */
-    if (_check_bit(c, OVERFLOW_FLAG)) {
-      c->pc = a;
-    }
-    break;
-  case I_CLC:
-    /* clear carry */
-    _clear_bit(c, CARRY_FLAG);
-    break;
-  case I_CLD:
-    /* clear decimal */
-    _clear_bit(c, BCD_FLAG);
-    break;
-  case I_CLI:
-    /* clear interrupt disable */
-    _clear_bit(c, IRQ_DISABLE);
-    break;
-  case I_CLV:
-    /* clear overflow */
-    _clear_bit(c, OVERFLOW_FLAG);
-    break;
-  case I_CMP:
-    /* compare memory to A */
-    temp = c->a - b;
-    
-    /* Set carry if A >= operand (no borrow needed) */
-    if (c->a >= b) {
-      _set_bit(c, CARRY_FLAG);
-    } else {
-      _clear_bit(c, CARRY_FLAG);
-    }
-    
-    _set_zero_flag(c, temp);
-    _set_negative_flag(c, temp);
-    break;
-  case I_CPX:
-    /* compare memory to X */
-    temp = c->x - b;
-    
-    /* Set carry if X >= operand (no borrow needed) */
-    if (c->x >= b) {
-      _set_bit(c, CARRY_FLAG);
-    } else {
-      _clear_bit(c, CARRY_FLAG);
-    }
-    
-    _set_zero_flag(c, temp);
-    _set_negative_flag(c, temp);
-    break;
-  case I_CPY:
-    /* compare memory to Y */
-    temp = c->y - b;
-    
-    /* Set carry if Y >= operand (no borrow needed) */
-    if (c->y >= b) {
-      _set_bit(c, CARRY_FLAG);
-    } else {
-      _clear_bit(c, CARRY_FLAG);
-    }
-    
-    _set_zero_flag(c, temp);
-    _set_negative_flag(c, temp);
-    break;
-  case I_DEC:
-    /* decrement memory */
-    b--;
-    cpu_write_byte(c, a, b);
-    _set_zero_flag(c, b);
-    _set_negative_flag(c, b);
-    break;
-  case I_DEX:
-    /* decrement x */
-    c->x--;
-    _set_zero_flag(c, c->x);
-    _set_negative_flag(c, c->x);
-    break;
-  case I_DEY:
-    /* decrement y */
-    c->y--;
-    _set_zero_flag(c, c->y);
-    _set_negative_flag(c, c->y);
-    break;
-  case I_EOR:
-    /* exclusive or */
-    c->a = c->a ^ b;
-    _set_zero_flag(c, c->a);
-    _set_negative_flag(c, c->a);
-    break;
-  case I_INC:
-    /* increment memory */
-    b++;
+/** implied - no operand */
+static bool _load_A_IMP(cpu *c, bool store, address *a, byte *b) {
+  return FALSE;
+}
+
+/** indirect - only used for JMP, result is an address */
+static bool _load_A_IND(cpu *c, bool store, address *a, byte *b) {
+  /*
+   * Note: The NMOS 6502 has a bug where JMP ($xxFF) wraps within the
+   * same page when reading the high byte (e.g., JMP ($10FF) reads the
+   * low byte from $10FF but the high byte from $1000, not $1100).
+   * This implementation uses 65C02 behavior which correctly crosses
+   * page boundaries. This is intentional as few programs rely on
+   * the bug and the correct behavior is more useful.
+   */
+  *a = cpu_next_address(c);
+  *a = cpu_read_address(c, *a);
+  return FALSE;
+}
+
+/** pre-indexed indirect - wraps within zero page */
+static bool _load_A_INX(cpu *c, bool store, address *a, byte *b) {
+  byte lo = 0, hi = 0;
+  *a = ((address) cpu_next_byte(c) + c->x) & 0xFF;
+  /* Read pointer from zero page (may wrap at page boundary) */
+  lo = cpu_read_byte(c, *a);
+  hi = cpu_read_byte(c, (*a + 1) & 0xFF);
+  *a = (hi << 8) | lo;
+  if (!store) {
+    *b = cpu_read_byte(c, *a);
+  }
+  return FALSE;
+}
+
+/** post-indexed indirect - pointer wraps within zero page */
+static bool _load_A_INY(cpu *c, bool store, address *a, byte *b) {
+  byte lo = 0, hi = 0;
+  *a = (address) cpu_next_byte(c);
+  /* Read pointer from zero page (may wrap at page boundary) */
+  lo = cpu_read_byte(c, *a);
+  hi = cpu_read_byte(c, (*a + 1) & 0xFF);
+  *a = ((hi << 8) | lo) + c->y;
+  if (!store) {
+    *b = cpu_read_byte(c, *a);
+  }
+  return _PAGE_CROSSED((hi << 8) | lo, *a);
+}
+
+/** relative - used for branching, result is an address */
+static bool _load_A_REL(cpu *c, bool store, address *a, byte *b) {
+  signed char offset = (signed char) cpu_next_byte(c);
+  *a = c->pc + offset;
+  return FALSE;
+}
+
+/** zero-page */
+static bool _load_A_ZPG(cpu *c, bool store, address *a, byte *b) {
+  *a = (address) cpu_next_byte(c);
+  if (!store) {
+    *b = cpu_read_byte(c, *a);
+  }
+  return FALSE;
+}
+
+/** zero-page x-indexed - wraps within zero page */
+static bool _load_A_ZPX(cpu *c, bool store, address *a, byte *b) {
+  *a = ((address) cpu_next_byte(c) + c->x) & 0xFF;
+  if (!store) {
+    *b = cpu_read_byte(c, *a);
+  }
+  return FALSE;
+}
+
+/** zero-page y-indexed - wraps within zero page */
+static bool _load_A_ZPY(cpu *c, bool store, address *a, byte *b) {
+  *a = ((address) cpu_next_byte(c) + c->y) & 0xFF;
+  if (!store) {
+    *b = cpu_read_byte(c, *a);
+  }
+  return FALSE;
+}
+
+/** zero-page indirect - WDC extension for W65C02 */
+static bool _load_A_ZPI(cpu *c, bool store, address *a, byte *b) {
+  *a = (address) cpu_next_byte(c);
+  *a = cpu_read_address(c, *a);
+  if (!store) {
+    *b = cpu_read_byte(c, *a);
+  }
+  return FALSE;
+}
+
+#if !defined(V6502C_TABLE_CORE)
+/*
+ * absolute indexed indirect - WDC extension for W65C02, JMP only.
+ * No opcode in inst.h is decoded with it yet, only the switch core
+ * names it.
+ */
+static bool _load_A_ABI(cpu *c, bool store, address *a, byte *b) {
+  *a = cpu_next_address(c) + c->x;
+  *a = cpu_read_address(c, *a);
+  return FALSE;
+}
+#endif
+
+/*
+ * Instructions.
+ *
+ * Each executor receives the CPU variant, the addressing mode the
+ * opcode was decoded with, and the effective address and operand
+ * produced by the addressing mode loader.
+ */
+
+/** Helper method to write a shift or rotate result back. */
+static void _store_result(cpu *c, enum addressing_t m, address a, byte b) {
+  if (m == A_ACC) {
+    c->a = b;
+  } else {
     cpu_write_byte(c, a, b);
-    _set_zero_flag(c, b);
-    _set_negative_flag(c, b);
-    break;
-  case I_INX:
-    /* increment x */
-    c->x++;
-    _set_zero_flag(c, c->x);
-    _set_negative_flag(c, c->x);
-    break;
-  case I_INY:
-    /* increment y */
-    c->y++;
-    _set_zero_flag(c, c->y);
-    _set_negative_flag(c, c->y);
-    break;
-  case I_JMP:
-    /* jump to address */
-    c->pc = a;
-    break;
-  case I_JSR:
-    /* jump to subroutine - push return address minus 1 */
-    c->pc--;
-    hi = (byte)(c->pc >> 8);
-    lo = (byte)(c->pc & 0xFF);
-    _push(c, hi);
-    _push(c, lo);
+  }
+  _set_zero_flag(c, b);
+  _set_negative_flag(c, b);
+}
+
+/** Helper method to compare a register with an operand. */
+static void _compare(cpu *c, byte r, byte b) {
+  byte temp = r - b;
+
+  /* Set carry if register >= operand (no borrow needed) */
+  if (r >= b) {
+    _set_bit(c, CARRY_FLAG);
+  } else {
+    _clear_bit(c, CARRY_FLAG);
+  }
+
+  _set_zero_flag(c, temp);
+  _set_negative_flag(c, temp);
+}
+
+/** Helper method to pull SR, ignoring the break flag and bit 5. */
+static void _pull_sr(cpu *c) {
+  byte b = c->sr;
+  c->sr = _pop(c);
+  if (b & (1<<BREAK_FLAG)) {
+    _set_bit(c, BREAK_FLAG);
+  } else {
+    _clear_bit(c, BREAK_FLAG);
+  }
+  if (b & (1<<5)) {
+    _set_bit(c, 5);
+  } else {
+    _clear_bit(c, 5);
+  }
+}
+
+/**
+ * Helper method to take a branch when the condition holds.
+ * A taken branch costs one extra cycle, or two if it lands on a
+ * different page.
+ */
+static void _branch(cpu *c, bool condition, address a) {
+  if (condition) {
+    c->cycles += _PAGE_CROSSED(c->pc, a) ? 2 : 1;
     c->pc = a;
-    break;
-  case I_LDA:
-    /* load A */
-    c->a = b;
-    _set_zero_flag(c, c->a);
-    _set_negative_flag(c, c->a);
-    break;
-  case I_LDX:
-    /* load X */
-    c->x = b;
-    _set_zero_flag(c, c->x);
-    _set_negative_flag(c, c->x);
-    break;
-  case I_LDY:
-    /* load Y */
-    c->y = b;
-    _set_zero_flag(c, c->y);
-    _set_negative_flag(c, c->y);
-    break;
-  case I_LSR:
-    /* shift one bit right */
-    if (b & 1) {
-      _set_bit(c, CARRY_FLAG);
-    } else {
-      _clear_bit(c, CARRY_FLAG);
-    }
-    b = b >> 1;
-    if (addressing == A_ACC) {
-      c->a = b;
-    } else {
-      cpu_write_byte(c, a, b);
-    }
-    _set_zero_flag(c, b);
-    _set_negative_flag(c, b);
-    break;
-  case I_ORA:
-    /* or */
-    c->a = c->a | b;
-    _set_zero_flag(c, c->a);
-    _set_negative_flag(c, c->a);
-    break;  
-  case I_PHA:
-    /* push A */
-    _push(c, c->a);
-    break;
-  case I_PHP:
-    /* push processor status */
-    /* push SR with break flag and bit 5 set */
-    b = c->sr;
-    /* set break flag */
-    b = b | (1<<BREAK_FLAG);
-    /* set bit 5 */
-    b = b | (1<<5);
-    _push(c, b);
-    break;
-  case I_PLA:
-    /* pull A */
-    c->a = _pop(c);
-    _set_zero_flag(c, c->a);
-    _set_negative_flag(c, c->a);
-    break;
-  case I_PLP:
-    /* pull processor status from stack */
-    /* the break flag and bit 5 should be ignored */
-    b = c->sr;
-    c->sr = _pop(c);
-    if (b & (1<<BREAK_FLAG)) {
-      _set_bit(c, BREAK_FLAG);
-    } else {
-      _clear_bit(c, BREAK_FLAG);
-    }
-    if (b & (1<<5)) {
-      _set_bit(c, 5);
-    } else {
-      _clear_bit(c, 5);
+  }
+}
+
+/** add with carry */
+static void _do_I_ADC(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  int carry_in = _check_bit(c, CARRY_FLAG) ? 1 : 0;
+
+  if (_check_bit(c, BCD_FLAG)) {
+    /* BCD (Decimal) Mode */
+    byte original_a = c->a;
+
+    int lo_nibble = (c->a & 0x0F) + (b & 0x0F) + carry_in;
+    int hi_nibble = (c->a >> 4) + (b >> 4);
+    int binary_result = c->a + b + carry_in;
+
+    /* The 65C02 takes an extra cycle to produce valid flags */
+    if (v == CPU_65C02) {
+      c->cycles++;
     }
-    break;
-  case I_ROL:
-    /* rotate one bit left */
-    temp = b & (1<<7);        /* Save bit 7 */
-    b = b << 1;               /* Shift left */
-    if (_check_bit(c, CARRY_FLAG)) {  /* Rotate carry into bit 0 */
-      b = b | 1;
+
+    /* Adjust low nibble if > 9 */
+    if (lo_nibble > 9) {
+      lo_nibble += 6;    /* Add 6 to convert to BCD */
+      hi_nibble++;       /* Carry to high nibble */
     }
 
-    /* Set new carry from old bit 7 */
-    if (temp) {
-      _set_bit(c, CARRY_FLAG);
+    /* Adjust high nibble if > 9 */
+    if (hi_nibble > 9) {
+      hi_nibble += 6;    /* Add 6 to convert to BCD */
+      _set_bit(c, CARRY_FLAG);  /* Set carry out */
     } else {
       _clear_bit(c, CARRY_FLAG);
     }
 
-    if (addressing == A_ACC) {
-      c->a = b;
+    c->a = ((hi_nibble & 0x0F) << 4) | (lo_nibble & 0x0F);
+
+    /* In BCD mode, N and Z flags reflect the binary result on 6502 */
+    _set_zero_flag(c, binary_result & 0xFF);
+    _set_negative_flag(c, binary_result);
+
+    /* Overflow flag behavior differs between CPU variants */
+    if (v == CPU_65C02) {
+      /* 65C02: V flag reflects signed overflow like in binary mode */
+      if (((original_a ^ binary_result) & (b ^ binary_result) & 0x80) != 0) {
+        _set_bit(c, OVERFLOW_FLAG);
+      } else {
+        _clear_bit(c, OVERFLOW_FLAG);
+      }
     } else {
-      cpu_write_byte(c, a, b);
-    }
-    _set_zero_flag(c, b);
-    _set_negative_flag(c, b);
-    break;
-  case I_ROR:
-    /* rotate one bit right */
-    temp = b & 1;             /* Save bit 0 for new carry */
-    b = b >> 1;               /* Shift right */
-    if (_check_bit(c, CARRY_FLAG)) {  /* Rotate old carry into bit 7 */
-      b = b | (1<<7);
+      /* Original 6502: V flag undefined in BCD mode */
+      _clear_bit(c, OVERFLOW_FLAG);
     }
 
-    /* Set new carry from old bit 0 */
-    if (temp) {
+  } else {
+    /* Binary Mode */
+    int result = c->a + b + carry_in;
+
+    /* Set carry flag if result > 255 (unsigned overflow) */
+    if (result > 0xFF) {
       _set_bit(c, CARRY_FLAG);
     } else {
       _clear_bit(c, CARRY_FLAG);
     }
 
-    if (addressing == A_ACC) {
-      c->a = b;
+    /* Set overflow flag if signed overflow occurred */
+    /* Overflow happens when: (+) + (+) = (-) or (-) + (-) = (+) */
+    if (((c->a ^ result) & (b ^ result) & 0x80) != 0) {
+      _set_bit(c, OVERFLOW_FLAG);
     } else {
-      cpu_write_byte(c, a, b);
-    }
-    _set_zero_flag(c, b);
-    _set_negative_flag(c, b);
-    break;
-  case I_RTI:
-    /* return from interrupt */
-    
-    /* pull SR minus bit 5 and break flag */
-    b = c->sr;
-    c->sr = _pop(c);
-    if (b & (1<<BREAK_FLAG)) {
-      _set_bit(c, BREAK_FLAG);
-    } else {
-      _clear_bit(c, BREAK_FLAG);
-    }
-    if (b & (1<<5)) {
-      _set_bit(c, 5);
-    } else {
-      _clear_bit(c, 5);
+      _clear_bit(c, OVERFLOW_FLAG);
     }
 
-    /* pull pc */
-    lo = _pop(c);
-    hi = _pop(c);
-    c->pc = (hi << 8) | lo;
-    break;
-  case I_RTS:
-    /* return from subroutine - add 1 to popped address */
-    lo = _pop(c);
-    hi = _pop(c);
-    c->pc = ((hi << 8) | lo) + 1;
-    break;
-  case I_SBC:
-    /* subtract memory from A with borrow */
-    {
-      int borrow = 1 - (_check_bit(c, CARRY_FLAG) ? 1 : 0);
-      
-      if (_check_bit(c, BCD_FLAG)) {
-        /* BCD (Decimal) Mode */
-        byte original_a = c->a;
-        int lo_nibble = (c->a & 0x0F) - (b & 0x0F) - borrow;
-        int hi_nibble = (c->a >> 4) - (b >> 4);
-        int binary_result = c->a - b - borrow;
-        
-        /* Adjust low nibble if < 0 (borrow from high nibble) */
-        if (lo_nibble < 0) {
-          lo_nibble += 10;   /* Add 10 for decimal borrow */
-          hi_nibble--;       /* Borrow from high nibble */
-        }
-        
-        /* Adjust high nibble if < 0 */
-        if (hi_nibble < 0) {
-          hi_nibble += 10;   /* Add 10 for decimal borrow */
-          _clear_bit(c, CARRY_FLAG);  /* Set borrow flag */
-        } else {
-          _set_bit(c, CARRY_FLAG);    /* No borrow occurred */
-        }
-        
-        c->a = ((hi_nibble & 0x0F) << 4) | (lo_nibble & 0x0F);
-        
-        /* In BCD mode, N and Z flags reflect the binary result on 6502 */
-        _set_zero_flag(c, binary_result & 0xFF);
-        _set_negative_flag(c, binary_result);
-        
-        /* Overflow flag behavior differs between CPU variants */
-        if (c->variant == CPU_65C02) {
-          /* 65C02: V flag reflects signed overflow like in binary mode */
-          if (((original_a ^ b) & (original_a ^ binary_result) & 0x80) != 0) {
-            _set_bit(c, OVERFLOW_FLAG);
-          } else {
-            _clear_bit(c, OVERFLOW_FLAG);
-          }
-        } else {
-          /* Original 6502: V flag undefined in BCD mode */
-          _clear_bit(c, OVERFLOW_FLAG);
-        }
-        
-      } else {
-        /* Binary Mode */
-        int result = c->a - b - borrow;
-        
-        /* Set carry flag if NO borrow occurred (result >= 0) */
-        if (result >= 0) {
-          _set_bit(c, CARRY_FLAG);
-        } else {
-          _clear_bit(c, CARRY_FLAG);
-        }
-        
-        /* Set overflow flag if signed overflow occurred */
-        /* Overflow in subtraction: (+) - (-) = (-) or (-) - (+) = (+) */
-        if (((c->a ^ b) & (c->a ^ result) & 0x80) != 0) {
-          _set_bit(c, OVERFLOW_FLAG);
-        } else {
-          _clear_bit(c, OVERFLOW_FLAG);
-        }
-        
-        c->a = result & 0xFF;
-        _set_zero_flag(c, c->a);
-        _set_negative_flag(c, c->a);
-      }
-    }
-    break;
-  case I_SEC:
-    /* set carry flag */
-    _set_bit(c, CARRY_FLAG);
-    break;
-  case I_SED:
-    /* set decimal flag */
-    _set_bit(c, BCD_FLAG);
-    break;
-  case I_SEI:
-    /* set interrupt disable flag */
-    _set_bit(c, IRQ_DISABLE);
-    break;
-  case I_STA:
-    /* store A */
-    cpu_write_byte(c, a, c->a);
-    break;
-  case I_STX:
-    /* store X */
-    cpu_write_byte(c, a, c->x);
-    break;
-  case I_STY:
-    /* store Y */
-    cpu_write_byte(c, a, c->y);
-    break;
-  case I_TAX:
-    /* transfer A to X */
-    c->x = c->a;
-    _set_zero_flag(c, c->x);
-    _set_negative_flag(c, c->x);
-    break;
-  case I_TAY:
-    /* transfer A to Y */
-    c->y = c->a;
-    _set_zero_flag(c, c->y);
-    _set_negative_flag(c, c->y);
-    break;
-  case I_TSX:
-    /* transfer SP to X */
-    c->x = c->sp;
-    _set_zero_flag(c, c->x);
-    _set_negative_flag(c, c->x);
-    break;
-  case I_TXA:
-    /* transfer X to A */
-    c->a = c->x;
+    c->a = result & 0xFF;
     _set_zero_flag(c, c->a);
     _set_negative_flag(c, c->a);
-    break;
-  case I_TXS:
-    /* transfer X to SP */
-    c->sp = c->x;
-    break;
-  case I_TYA:
-    /* transfer Y to A */
-    c->a = c->y;
+  }
+}
+
+/** and */
+static void _do_I_AND(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->a = c->a & b;
+  _set_zero_flag(c, c->a);
+  _set_negative_flag(c, c->a);
+}
+
+/** arithmetic shift left */
+static void _do_I_ASL(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  if (b & (1<<7)) {
+    _set_bit(c, CARRY_FLAG);
+  } else {
+    _clear_bit(c, CARRY_FLAG);
+  }
+  b = b << 1;
+  _store_result(c, m, a, b);
+}
+
+/** branch on carry clear */
+static void _do_I_BCC(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _branch(c, !_check_bit(c, CARRY_FLAG), a);
+}
+
+/** branch on carry set */
+static void _do_I_BCS(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _branch(c, _check_bit(c, CARRY_FLAG), a);
+}
+
+/** branch on equal (zero) */
+static void _do_I_BEQ(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _branch(c, _check_bit(c, ZERO_FLAG), a);
+}
+
+/** bit test */
+static void _do_I_BIT(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  if (b & (1<<7)) {
+    _set_bit(c, 7);
+  } else {
+    _clear_bit(c, 7);
+  }
+
+  if (b & (1<<6)) {
+    _set_bit(c, 6);
+  } else {
+    _clear_bit(c, 6);
+  }
+
+  _set_zero_flag(c, c->a & b);
+}
+
+/** branch on negative */
+static void _do_I_BMI(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _branch(c, _check_bit(c, NEGATIVE_FLAG), a);
+}
+
+/** branch on not equal (not zero) */
+static void _do_I_BNE(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _branch(c, !_check_bit(c, ZERO_FLAG), a);
+}
+
+/** branch on positive (not negative) */
+static void _do_I_BPL(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _branch(c, !_check_bit(c, NEGATIVE_FLAG), a);
+}
+
+/** software interrupt */
+static void _do_I_BRK(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->pc++;  /* Skip padding byte after BRK opcode */
+  _service_interrupt(c, IRQ_VECTOR, TRUE);
+}
+
+/** branch on overflow clear */
+static void _do_I_BVC(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _branch(c, !_check_bit(c, OVERFLOW_FLAG), a);
+}
+
+/** branch on overflow set */
+static void _do_I_BVS(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _branch(c, _check_bit(c, OVERFLOW_FLAG), a);
+}
+
+/** clear carry */
+static void _do_I_CLC(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _clear_bit(c, CARRY_FLAG);
+}
+
+/** clear decimal */
+static void _do_I_CLD(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _clear_bit(c, BCD_FLAG);
+}
+
+/** clear interrupt disable */
+static void _do_I_CLI(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _clear_bit(c, IRQ_DISABLE);
+}
+
+/** clear overflow */
+static void _do_I_CLV(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _clear_bit(c, OVERFLOW_FLAG);
+}
+
+/** compare memory to A */
+static void _do_I_CMP(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _compare(c, c->a, b);
+}
+
+/** compare memory to X */
+static void _do_I_CPX(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _compare(c, c->x, b);
+}
+
+/** compare memory to Y */
+static void _do_I_CPY(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _compare(c, c->y, b);
+}
+
+/** decrement memory */
+static void _do_I_DEC(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  b--;
+  cpu_write_byte(c, a, b);
+  _set_zero_flag(c, b);
+  _set_negative_flag(c, b);
+}
+
+/** decrement x */
+static void _do_I_DEX(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->x--;
+  _set_zero_flag(c, c->x);
+  _set_negative_flag(c, c->x);
+}
+
+/** decrement y */
+static void _do_I_DEY(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->y--;
+  _set_zero_flag(c, c->y);
+  _set_negative_flag(c, c->y);
+}
+
+/** exclusive or */
+static void _do_I_EOR(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->a = c->a ^ b;
+  _set_zero_flag(c, c->a);
+  _set_negative_flag(c, c->a);
+}
+
+/** increment memory */
+static void _do_I_INC(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  b++;
+  cpu_write_byte(c, a, b);
+  _set_zero_flag(c, b);
+  _set_negative_flag(c, b);
+}
+
+/** increment x */
+static void _do_I_INX(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->x++;
+  _set_zero_flag(c, c->x);
+  _set_negative_flag(c, c->x);
+}
+
+/** increment y */
+static void _do_I_INY(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->y++;
+  _set_zero_flag(c, c->y);
+  _set_negative_flag(c, c->y);
+}
+
+/** jump to address */
+static void _do_I_JMP(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->pc = a;
+}
+
+/** jump to subroutine - push return address minus 1 */
+static void _do_I_JSR(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->pc--;
+  _push(c, (byte)(c->pc >> 8));
+  _push(c, (byte)(c->pc & 0xFF));
+  c->pc = a;
+  _CALL(c, CPU_CALL_JSR);
+}
+
+/** load A */
+static void _do_I_LDA(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->a = b;
+  _set_zero_flag(c, c->a);
+  _set_negative_flag(c, c->a);
+}
+
+/** load X */
+static void _do_I_LDX(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->x = b;
+  _set_zero_flag(c, c->x);
+  _set_negative_flag(c, c->x);
+}
+
+/** load Y */
+static void _do_I_LDY(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->y = b;
+  _set_zero_flag(c, c->y);
+  _set_negative_flag(c, c->y);
+}
+
+/** shift one bit right */
+static void _do_I_LSR(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  if (b & 1) {
+    _set_bit(c, CARRY_FLAG);
+  } else {
+    _clear_bit(c, CARRY_FLAG);
+  }
+  b = b >> 1;
+  _store_result(c, m, a, b);
+}
+
+/** no operation */
+static void _do_I_NOP(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+}
+
+/** or */
+static void _do_I_ORA(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->a = c->a | b;
+  _set_zero_flag(c, c->a);
+  _set_negative_flag(c, c->a);
+}
+
+/** push A */
+static void _do_I_PHA(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _push(c, c->a);
+}
+
+/** push processor status with break flag and bit 5 set */
+static void _do_I_PHP(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _push(c, c->sr | (1<<BREAK_FLAG) | (1<<5));
+}
+
+/** pull A */
+static void _do_I_PLA(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->a = _pop(c);
+  _set_zero_flag(c, c->a);
+  _set_negative_flag(c, c->a);
+}
+
+/** pull processor status from stack */
+static void _do_I_PLP(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _pull_sr(c);
+}
+
+/** rotate one bit left */
+static void _do_I_ROL(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  byte temp = b & (1<<7);   /* Save bit 7 */
+  b = b << 1;               /* Shift left */
+  if (_check_bit(c, CARRY_FLAG)) {  /* Rotate carry into bit 0 */
+    b = b | 1;
+  }
+
+  /* Set new carry from old bit 7 */
+  if (temp) {
+    _set_bit(c, CARRY_FLAG);
+  } else {
+    _clear_bit(c, CARRY_FLAG);
+  }
+
+  _store_result(c, m, a, b);
+}
+
+/** rotate one bit right */
+static void _do_I_ROR(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  byte temp = b & 1;        /* Save bit 0 for new carry */
+  b = b >> 1;               /* Shift right */
+  if (_check_bit(c, CARRY_FLAG)) {  /* Rotate old carry into bit 7 */
+    b = b | (1<<7);
+  }
+
+  /* Set new carry from old bit 0 */
+  if (temp) {
+    _set_bit(c, CARRY_FLAG);
+  } else {
+    _clear_bit(c, CARRY_FLAG);
+  }
+
+  _store_result(c, m, a, b);
+}
+
+/** return from interrupt */
+static void _do_I_RTI(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  byte lo = 0, hi = 0;
+
+  /* pull SR minus bit 5 and break flag */
+  _pull_sr(c);
+
+  /* pull pc */
+  lo = _pop(c);
+  hi = _pop(c);
+  c->pc = (hi << 8) | lo;
+  _CALL(c, CPU_CALL_RTI);
+}
+
+/** return from subroutine - add 1 to popped address */
+static void _do_I_RTS(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  byte lo = 0, hi = 0;
+  lo = _pop(c);
+  hi = _pop(c);
+  c->pc = ((hi << 8) | lo) + 1;
+  _CALL(c, CPU_CALL_RTS);
+}
+
+/** subtract memory from A with borrow */
+static void _do_I_SBC(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  int borrow = 1 - (_check_bit(c, CARRY_FLAG) ? 1 : 0);
+
+  if (_check_bit(c, BCD_FLAG)) {
+    /* BCD (Decimal) Mode */
+    byte original_a = c->a;
+
+    int lo_nibble = (c->a & 0x0F) - (b & 0x0F) - borrow;
+    int hi_nibble = (c->a >> 4) - (b >> 4);
+    int binary_result = c->a - b - borrow;
+
+    /* The 65C02 takes an extra cycle to produce valid flags */
+    if (v == CPU_65C02) {
+      c->cycles++;
+    }
+
+    /* Adjust low nibble if < 0 (borrow from high nibble) */
+    if (lo_nibble < 0) {
+      lo_nibble += 10;   /* Add 10 for decimal borrow */
+      hi_nibble--;       /* Borrow from high nibble */
+    }
+
+    /* Adjust high nibble if < 0 */
+    if (hi_nibble < 0) {
+      hi_nibble += 10;   /* Add 10 for decimal borrow */
+      _clear_bit(c, CARRY_FLAG);  /* Set borrow flag */
+    } else {
+      _set_bit(c, CARRY_FLAG);    /* No borrow occurred */
+    }
+
+    c->a = ((hi_nibble & 0x0F) << 4) | (lo_nibble & 0x0F);
+
+    /* In BCD mode, N and Z flags reflect the binary result on 6502 */
+    _set_zero_flag(c, binary_result & 0xFF);
+    _set_negative_flag(c, binary_result);
+
+    /* Overflow flag behavior differs between CPU variants */
+    if (v == CPU_65C02) {
+      /* 65C02: V flag reflects signed overflow like in binary mode */
+      if (((original_a ^ b) & (original_a ^ binary_result) & 0x80) != 0) {
+        _set_bit(c, OVERFLOW_FLAG);
+      } else {
+        _clear_bit(c, OVERFLOW_FLAG);
+      }
+    } else {
+      /* Original 6502: V flag undefined in BCD mode */
+      _clear_bit(c, OVERFLOW_FLAG);
+    }
+
+  } else {
+    /* Binary Mode */
+    int result = c->a - b - borrow;
+
+    /* Set carry flag if NO borrow occurred (result >= 0) */
+    if (result >= 0) {
+      _set_bit(c, CARRY_FLAG);
+    } else {
+      _clear_bit(c, CARRY_FLAG);
+    }
+
+    /* Set overflow flag if signed overflow occurred */
+    /* Overflow in subtraction: (+) - (-) = (-) or (-) - (+) = (+) */
+    if (((c->a ^ b) & (c->a ^ result) & 0x80) != 0) {
+      _set_bit(c, OVERFLOW_FLAG);
+    } else {
+      _clear_bit(c, OVERFLOW_FLAG);
+    }
+
+    c->a = result & 0xFF;
     _set_zero_flag(c, c->a);
     _set_negative_flag(c, c->a);
+  }
+}
+
+/** set carry flag */
+static void _do_I_SEC(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _set_bit(c, CARRY_FLAG);
+}
+
+/** set decimal flag */
+static void _do_I_SED(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _set_bit(c, BCD_FLAG);
+}
+
+/** set interrupt disable flag */
+static void _do_I_SEI(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  _set_bit(c, IRQ_DISABLE);
+}
+
+/** store A */
+static void _do_I_STA(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  cpu_write_byte(c, a, c->a);
+}
+
+/** store X */
+static void _do_I_STX(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  cpu_write_byte(c, a, c->x);
+}
+
+/** store Y */
+static void _do_I_STY(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  cpu_write_byte(c, a, c->y);
+}
+
+/** transfer A to X */
+static void _do_I_TAX(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->x = c->a;
+  _set_zero_flag(c, c->x);
+  _set_negative_flag(c, c->x);
+}
+
+/** transfer A to Y */
+static void _do_I_TAY(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->y = c->a;
+  _set_zero_flag(c, c->y);
+  _set_negative_flag(c, c->y);
+}
+
+/** transfer SP to X */
+static void _do_I_TSX(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->x = c->sp;
+  _set_zero_flag(c, c->x);
+  _set_negative_flag(c, c->x);
+}
+
+/** transfer X to A */
+static void _do_I_TXA(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->a = c->x;
+  _set_zero_flag(c, c->a);
+  _set_negative_flag(c, c->a);
+}
+
+/** transfer X to SP */
+static void _do_I_TXS(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->sp = c->x;
+}
+
+/** transfer Y to A */
+static void _do_I_TYA(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->a = c->y;
+  _set_zero_flag(c, c->a);
+  _set_negative_flag(c, c->a);
+}
+
+/** stop the clock until reset */
+static void _do_I_STP(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->stopped = TRUE;
+}
+
+/** wait for interrupt */
+static void _do_I_WAI(cpu *c, enum cpu_variant_t v, enum addressing_t m, address a, byte b) {
+  c->waiting = TRUE;
+}
+
+/*
+ * The remaining 65C02 extended instructions are decoded but not yet
+ * implemented. They execute as NOPs after loading their operand.
+ */
+#define _do_I_BBR0 _do_I_NOP
+#define _do_I_BBR1 _do_I_NOP
+#define _do_I_BBR2 _do_I_NOP
+#define _do_I_BBR3 _do_I_NOP
+#define _do_I_BBR4 _do_I_NOP
+#define _do_I_BBR5 _do_I_NOP
+#define _do_I_BBR6 _do_I_NOP
+#define _do_I_BBR7 _do_I_NOP
+#define _do_I_BBS0 _do_I_NOP
+#define _do_I_BBS1 _do_I_NOP
+#define _do_I_BBS2 _do_I_NOP
+#define _do_I_BBS3 _do_I_NOP
+#define _do_I_BBS4 _do_I_NOP
+#define _do_I_BBS5 _do_I_NOP
+#define _do_I_BBS6 _do_I_NOP
+#define _do_I_BBS7 _do_I_NOP
+#define _do_I_BRA _do_I_NOP
+#define _do_I_PHX _do_I_NOP
+#define _do_I_PHY _do_I_NOP
+#define _do_I_PLX _do_I_NOP
+#define _do_I_PLY _do_I_NOP
+#define _do_I_RMB0 _do_I_NOP
+#define _do_I_RMB1 _do_I_NOP
+#define _do_I_RMB2 _do_I_NOP
+#define _do_I_RMB3 _do_I_NOP
+#define _do_I_RMB4 _do_I_NOP
+#define _do_I_RMB5 _do_I_NOP
+#define _do_I_RMB6 _do_I_NOP
+#define _do_I_RMB7 _do_I_NOP
+#define _do_I_SMB0 _do_I_NOP
+#define _do_I_SMB1 _do_I_NOP
+#define _do_I_SMB2 _do_I_NOP
+#define _do_I_SMB3 _do_I_NOP
+#define _do_I_SMB4 _do_I_NOP
+#define _do_I_SMB5 _do_I_NOP
+#define _do_I_SMB6 _do_I_NOP
+#define _do_I_SMB7 _do_I_NOP
+#define _do_I_STZ _do_I_NOP
+#define _do_I_TRB _do_I_NOP
+#define _do_I_TSB _do_I_NOP
+
+#if defined(V6502C_TABLE_CORE)
+
+/*
+ * Table-driven core.
+ *
+ * One handler is generated per opcode and per CPU variant from the
+ * opcode map in inst.h. Each handler calls its addressing mode
+ * loader and instruction executor directly, so the addressing mode,
+ * store check and variant are all constants the compiler can fold.
+ */
+
+typedef void _opcode_fn(cpu *c);
+
+#define _IS_STORE(i) ((i) == I_STA || (i) == I_STX || (i) == I_STY)
+
+#define _OPCODE_HANDLER(op, i, m, v) \
+  static void _op_##v##_##op(cpu *c) { \
+    address a = 0; \
+    byte b = 0; \
+    if (_load_##m(c, _IS_STORE(i), &a, &b) && _PAGE_PENALTY(i, v)) { \
+      c->cycles++; \
+    } \
+    _do_##i(c, v, m, a, b); \
+  }
+
+#define _HANDLER_6502(op, i, m) _OPCODE_HANDLER(op, i, m, CPU_6502)
+#define _HANDLER_65C02(op, i, m) _OPCODE_HANDLER(op, i, m, CPU_65C02)
+#define _ENTRY_6502(op, i, m) _op_CPU_6502_##op,
+#define _ENTRY_65C02(op, i, m) _op_CPU_65C02_##op,
+
+V6502_OPCODES(_HANDLER_6502)
+V6502_OPCODES(_HANDLER_65C02)
+
+static _opcode_fn *const _opcodes_6502[256] = {
+  V6502_OPCODES(_ENTRY_6502)
+};
+
+static _opcode_fn *const _opcodes_65c02[256] = {
+  V6502_OPCODES(_ENTRY_65C02)
+};
+
+/** Execute one opcode through the per-variant handler table. */
+static void _execute(cpu *c, byte op) {
+  if (c->variant == CPU_6502) {
+    _opcodes_6502[op](c);
+  } else {
+    _opcodes_65c02[op](c);
+  }
+}
+
+#else
+
+/*
+ * Switch-based core.
+ *
+ * Decodes the opcode through the instructions[] and addressings[]
+ * tables, loads the operand, then performs the instruction.
+ */
+
+#define _LOAD_CASE(m) case m: crossed = _load_##m(c, store, &a, &b); break;
+#define _DO_CASE(i) case i: _do_##i(c, c->variant, addressing, a, b); break;
+
+/** Execute one opcode by decoding it and switching on the result. */
+static void _execute(cpu *c, byte op) {
+  byte b = 0;
+  address a = 0;
+  enum instruction_t instruction = instructions[op];
+  enum addressing_t addressing = addressings[op];
+  bool store = _is_store(instruction);
+  bool crossed = FALSE;
+
+  /** load data */
+  switch (addressing) {
+  _LOAD_CASE(A_ACC)
+  _LOAD_CASE(A_ABS)
+  _LOAD_CASE(A_ABX)
+  _LOAD_CASE(A_ABY)
+  _LOAD_CASE(A_IMM)
+  _LOAD_CASE(A_IND)
+  _LOAD_CASE(A_INX)
+  _LOAD_CASE(A_INY)
+  _LOAD_CASE(A_REL)
+  _LOAD_CASE(A_ZPG)
+  _LOAD_CASE(A_ZPX)
+  _LOAD_CASE(A_ZPY)
+  _LOAD_CASE(A_ZPI)
+  _LOAD_CASE(A_ABI)
+  _LOAD_CASE(A_IMP)
+  default:
     break;
-  case I_NOP:
+  }
+
+  if (crossed && _PAGE_PENALTY(instruction, c->variant)) {
+    c->cycles++;
+  }
+
+  /** perform instruction */
+  switch (instruction) {
+  _DO_CASE(I_ADC)
+  _DO_CASE(I_AND)
+  _DO_CASE(I_ASL)
+  _DO_CASE(I_BCC)
+  _DO_CASE(I_BCS)
+  _DO_CASE(I_BEQ)
+  _DO_CASE(I_BIT)
+  _DO_CASE(I_BMI)
+  _DO_CASE(I_BNE)
+  _DO_CASE(I_BPL)
+  _DO_CASE(I_BRK)
+  _DO_CASE(I_BVC)
+  _DO_CASE(I_BVS)
+  _DO_CASE(I_CLC)
+  _DO_CASE(I_CLD)
+  _DO_CASE(I_CLI)
+  _DO_CASE(I_CLV)
+  _DO_CASE(I_CMP)
+  _DO_CASE(I_CPX)
+  _DO_CASE(I_CPY)
+  _DO_CASE(I_DEC)
+  _DO_CASE(I_DEX)
+  _DO_CASE(I_DEY)
+  _DO_CASE(I_EOR)
+  _DO_CASE(I_INC)
+  _DO_CASE(I_INX)
+  _DO_CASE(I_INY)
+  _DO_CASE(I_JMP)
+  _DO_CASE(I_JSR)
+  _DO_CASE(I_LDA)
+  _DO_CASE(I_LDX)
+  _DO_CASE(I_LDY)
+  _DO_CASE(I_LSR)
+  _DO_CASE(I_ORA)
+  _DO_CASE(I_PHA)
+  _DO_CASE(I_PHP)
+  _DO_CASE(I_PLA)
+  _DO_CASE(I_PLP)
+  _DO_CASE(I_ROL)
+  _DO_CASE(I_ROR)
+  _DO_CASE(I_RTI)
+  _DO_CASE(I_RTS)
+  _DO_CASE(I_SBC)
+  _DO_CASE(I_SEC)
+  _DO_CASE(I_SED)
+  _DO_CASE(I_SEI)
+  _DO_CASE(I_STA)
+  _DO_CASE(I_STX)
+  _DO_CASE(I_STY)
+  _DO_CASE(I_TAX)
+  _DO_CASE(I_TAY)
+  _DO_CASE(I_TSX)
+  _DO_CASE(I_TXA)
+  _DO_CASE(I_TXS)
+  _DO_CASE(I_TYA)
+  _DO_CASE(I_STP)
+  _DO_CASE(I_WAI)
+  _DO_CASE(I_NOP)
   default:
     /* Do nothing */
     break;
   }
+}
 
-  /* Handle Interrupts - checked after each instruction */
+#endif /* V6502C_TABLE_CORE */
+
+/** Cycles taken by the reset sequence and by interrupt entry. */
+#define RESET_CYCLES 7
+#define INTERRUPT_CYCLES 7
+
+/** TRUE if an IRQ was requested or the IRQ line is asserted. */
+#define _IRQ_ASSERTED(c) ((c)->irq || (c)->irq_line)
+
+/** Helper method to service a pending NMI or unmasked IRQ. */
+static void _check_interrupts(cpu *c) {
   if (c->nmi) {
     c->nmi = FALSE;
     _service_interrupt(c, NMI_VECTOR, FALSE);
-  } else if (c->irq && !_check_bit(c, IRQ_DISABLE)) {
+    c->cycles += INTERRUPT_CYCLES;
+  } else if (_IRQ_ASSERTED(c) && !_check_bit(c, IRQ_DISABLE)) {
     c->irq = FALSE;
     _service_interrupt(c, IRQ_VECTOR, FALSE);
+    c->cycles += INTERRUPT_CYCLES;
   }
-  
+}
+
+int cpu_step(cpu *c) {
+  byte op = 0;
+  count_t start = 0;
+  address pc = 0;
+
+  if (c == NULL) return 0;
+
+  /** Handle reset. */
+  if (c->reset) {
+    c->reset = FALSE;
+    _reset(c);
+    c->cycles += RESET_CYCLES;
+    return RESET_CYCLES;
+  }
+
+  /* A stopped CPU does nothing until it is reset */
+  if (c->stopped) return 0;
+
+  start = c->cycles;
+
+  /*
+   * A waiting CPU resumes on any interrupt. If the interrupt is a
+   * masked IRQ it is not serviced and execution simply continues.
+   */
+  if (c->waiting) {
+    if (!c->nmi && !_IRQ_ASSERTED(c)) return 0;
+    c->waiting = FALSE;
+    if (c->nmi || !_check_bit(c, IRQ_DISABLE)) {
+      _check_interrupts(c);
+      return (int)(c->cycles - start);
+    }
+  }
+
+  pc = c->pc;
+  op = cpu_next_byte(c);
+  _STAT(c->stats.opcodes[op]++);
+  c->cycles += (c->variant == CPU_6502) ? cycles_6502[op] : cycles_65c02[op];
+  _execute(c, op);
+
+  if (c->profile != NULL) {
+    c->profile[pc].instructions++;
+    c->profile[pc].cycles += c->cycles - start;
+  }
+
+  /* Handle Interrupts - checked after each instruction */
+  if (!c->waiting) {
+    _check_interrupts(c);
+  }
+
+  return (int)(c->cycles - start);
 }
 
 void cpu_run(cpu *c) {
   if (c == NULL) return;
-  while (!c->halted) {
+  while (!c->halted && !c->stopped) {
     cpu_step(c);
-    if (c->tick != NULL) {
+    if (c->tick_ctx != NULL) {
+      c->tick_ctx(c->userdata);
+    } else if (c->tick != NULL) {
       c->tick();
     }
   }
 }
 
+/** Run the CPU until the budget is used up or something stops it. */
+static enum cpu_exit_t _run(cpu *c, count_t budget, bool by_cycles) {
+  count_t used = 0;
+  bool irq = FALSE;
+  int cycles = 0;
+
+  if (c == NULL) return CPU_EXIT_HALTED;
+
+  irq = _IRQ_ASSERTED(c);
+  while (used < budget) {
+    if (c->halted) return CPU_EXIT_HALTED;
+    if (c->stopped && !c->reset) return CPU_EXIT_STOPPED;
+    if (used > 0 && c->breakpoints != NULL && cpu_is_breakpoint(c, c->pc)) {
+      return CPU_EXIT_BREAKPOINT;
+    }
+
+    cycles = cpu_step(c);
+    used += by_cycles ? (count_t) cycles : 1;
+
+    if (c->waiting) return CPU_EXIT_WAITING;
+    if (_IRQ_ASSERTED(c) && !irq) return CPU_EXIT_IRQ;
+    irq = _IRQ_ASSERTED(c);
+  }
+  return CPU_EXIT_BUDGET;
+}
+
+enum cpu_exit_t cpu_run_cycles(cpu *c, count_t budget) {
+  return _run(c, budget, TRUE);
+}
+
+enum cpu_exit_t cpu_run_instructions(cpu *c, count_t budget) {
+  return _run(c, budget, FALSE);
+}
+
+void cpu_set_breakpoint(cpu *c, address a) {
+  if (c == NULL || c->breakpoints == NULL) return;
+  c->breakpoints[a >> 3] |= (byte)(1 << (a & 7));
+}
+
+void cpu_clear_breakpoint(cpu *c, address a) {
+  if (c == NULL || c->breakpoints == NULL) return;
+  c->breakpoints[a >> 3] &= (byte)~(1 << (a & 7));
+}
+
+bool cpu_is_breakpoint(cpu *c, address a) {
+  if (c == NULL || c->breakpoints == NULL) return FALSE;
+  return (c->breakpoints[a >> 3] >> (a & 7)) & 1;
+}
+
+#if defined(V6502C_STATS)
+
+#define _NAME_ENTRY(op, i, m) #i,
+
+static const char *_opcode_names[256] = {
+  V6502_OPCODES(_NAME_ENTRY)
+};
+
+static const char *_addressing_names[CPU_ADDRESSING_MODES] = {
+  "ACC", "ABS", "ABX", "ABY", "IMM", "IMP", "IND", "INX", "INY",
+  "REL", "ZPG", "ZPX", "ZPY", "ZPI", "ABI"
+};
+
+void cpu_get_stats(cpu *c, cpu_stats_t *stats) {
+  int op;
+
+  *stats = c->stats;
+  /* Only opcodes are counted as they run, the totals follow from them */
+  stats->instructions = 0;
+  memset(stats->addressings, 0, sizeof(stats->addressings));
+  for (op = 0; op < 256; op++) {
+    stats->instructions += stats->opcodes[op];
+    stats->addressings[addressings[op]] += stats->opcodes[op];
+  }
+}
+
+void cpu_clear_stats(cpu *c) {
+  memset(&c->stats, 0, sizeof(c->stats));
+}
+
+const char *cpu_opcode_name(byte op) {
+  return _opcode_names[op] + 2;  /* Skip the I_ prefix */
+}
+
+int cpu_opcode_addressing(byte op) {
+  return (int)addressings[op];
+}
+
+const char *cpu_addressing_name(int mode) {
+  if (mode < 0 || mode >= CPU_ADDRESSING_MODES) return "???";
+  return _addressing_names[mode];
+}
+
+#endif /* V6502C_STATS */
+
+/* Read a two byte address without counting it in the statistics. */
+static address _peek_address(cpu *c, address a) {
+  return (address)(cpu_peek_byte(c, a) | (cpu_peek_byte(c, (address)(a + 1)) << 8));
+}
+
+int cpu_decode(cpu *c, address *ea) {
+  address pc = c->pc;
+  address base;
+  byte op = cpu_peek_byte(c, pc);
+  byte lo;
+
+  *ea = 0;
+  switch (addressings[op]) {
+  case A_ACC:
+  case A_IMP:
+    return 1;
+  case A_IMM:
+    return 2;
+  case A_REL:
+    *ea = pc + 2 + (signed char)cpu_peek_byte(c, pc + 1);
+    return 2;
+  case A_ZPG:
+    *ea = cpu_peek_byte(c, pc + 1);
+    return 2;
+  case A_ZPX:
+    *ea = (cpu_peek_byte(c, pc + 1) + c->x) & 0xFF;
+    return 2;
+  case A_ZPY:
+    *ea = (cpu_peek_byte(c, pc + 1) + c->y) & 0xFF;
+    return 2;
+  case A_INX:
+    lo = (byte)(cpu_peek_byte(c, pc + 1) + c->x);
+    *ea = cpu_peek_byte(c, lo) | (cpu_peek_byte(c, (byte)(lo + 1)) << 8);
+    return 2;
+  case A_INY:
+    lo = cpu_peek_byte(c, pc + 1);
+    *ea = (cpu_peek_byte(c, lo) | (cpu_peek_byte(c, (byte)(lo + 1)) << 8)) + c->y;
+    return 2;
+  case A_ZPI:
+    *ea = _peek_address(c, cpu_peek_byte(c, pc + 1));
+    return 2;
+  case A_ABS:
+    *ea = _peek_address(c, pc + 1);
+    return 3;
+  case A_ABX:
+    *ea = _peek_address(c, pc + 1) + c->x;
+    return 3;
+  case A_ABY:
+    *ea = _peek_address(c, pc + 1) + c->y;
+    return 3;
+  case A_IND:
+    *ea = _peek_address(c, _peek_address(c, pc + 1));
+    return 3;
+  case A_ABI:
+    base = _peek_address(c, pc + 1) + c->x;
+    *ea = _peek_address(c, base);
+    return 3;
+  }
+  return 1;
+}
+
 /** Halt the CPU. */
 void cpu_halt(cpu *c) {
   if (c == NULL) return;
@@ -940,6 +1486,12 @@ void cpu_irq(cpu *c) {
   c->irq = TRUE;
 }
 
+/** Set the level of the IRQ input. */
+void cpu_set_irq_line(cpu *c, bool level) {
+  if (c == NULL) return;
+  c->irq_line = level;
+}
+
 /** Trigger a CPU reset. */
 void cpu_reset(cpu *c) {
   if (c == NULL) return;
@@ -57,6 +57,68 @@ typedef void WriteFn(address, byte);
     Can be used to slow down execution. */
 typedef void TickFn(void);
 
+/**
+ * The context-carrying callbacks below receive the cpu's userdata
+ * pointer as their first argument. They let one process host many
+ * machines without routing callbacks through global state. When set,
+ * they are used instead of the plain callbacks above.
+ **/
+
+/** Read a byte from the given emulated memory address. */
+typedef byte ReadCtxFn(void *userdata, address);
+
+/** Write a byte to the given emulated memory address. */
+typedef void WriteCtxFn(void *userdata, address, byte);
+
+/** Called between each CPU cycle. */
+typedef void TickCtxFn(void *userdata);
+
+/** Control transfers reported to the call callback. */
+enum cpu_call_t {
+  CPU_CALL_JSR,        /* A JSR pushed its return address and jumped */
+  CPU_CALL_RTS,        /* An RTS pulled its return address */
+  CPU_CALL_INTERRUPT,  /* BRK, IRQ or NMI pushed PC and SR and jumped */
+  CPU_CALL_RTI         /* An RTI pulled SR and PC */
+};
+
+/**
+ * Called after each of the transfers above, for call graph profiling.
+ * The registers already hold the new PC and SP.
+ */
+typedef void CallCtxFn(void *userdata, enum cpu_call_t kind);
+
+/** Reasons cpu_run_cycles() and cpu_run_instructions() return. */
+enum cpu_exit_t {
+  CPU_EXIT_BUDGET,      /* The cycle or instruction budget was used up */
+  CPU_EXIT_HALTED,      /* cpu_halt() was called */
+  CPU_EXIT_STOPPED,     /* An STP instruction stopped the clock */
+  CPU_EXIT_WAITING,     /* A WAI instruction is waiting for an interrupt */
+  CPU_EXIT_BREAKPOINT,  /* The PC reached a breakpoint */
+  CPU_EXIT_IRQ          /* An IRQ was raised during the run and is still asserted */
+};
+
+/** Execution counts for one address, see cpu_step(). */
+typedef struct cpu_profile_s {
+  count_t instructions;  /* Instructions started at the address */
+  count_t cycles;        /* Cycles they took, excluding interrupts */
+} cpu_profile_t;
+
+#if defined(V6502C_STATS)
+/**
+ * Instruction mix counters, only built with -DV6502C_STATS. Reads and
+ * writes count every memory access made through the CPU, including
+ * opcode fetches.
+ */
+#define CPU_ADDRESSING_MODES 15
+typedef struct cpu_stats_s {
+  count_t instructions;
+  count_t opcodes[256];
+  count_t addressings[CPU_ADDRESSING_MODES];  /* By enum addressing_t */
+  count_t reads;
+  count_t writes;
+} cpu_stats_t;
+#endif
+
 /** CPU variant types */
 enum cpu_variant_t {
   CPU_6502,   /* Original NMOS 6502 */
@@ -73,11 +135,25 @@ typedef struct cpu_s {
   bool halted;
   bool reset;
   bool irq;
+  bool irq_line;   /* Level-triggered IRQ input, held by devices */
   bool nmi;
+  bool stopped;    /* STP executed, cleared by reset */
+  bool waiting;    /* WAI executed, cleared by the next interrupt */
   enum cpu_variant_t variant;
+  count_t cycles;  /* Clock cycles executed since cpu_init() */
+  byte *breakpoints; /* Optional 8KB bitmap, one bit per address */
+  cpu_profile_t *profile; /* Optional counts for each of the 64K addresses */
   ReadFn *read;
   WriteFn *write;
   TickFn *tick;
+  void *userdata;  /* Passed to the context-carrying callbacks */
+  ReadCtxFn *read_ctx;
+  WriteCtxFn *write_ctx;
+  TickCtxFn *tick_ctx;
+  CallCtxFn *call_ctx;  /* Optional, see CallCtxFn */
+#if defined(V6502C_STATS)
+  cpu_stats_t stats;    /* Opcodes, reads and writes, see cpu_get_stats() */
+#endif
 } cpu;
 
 /** Call this to initialize the CPU data structure before using it. */
@@ -89,6 +165,14 @@ void cpu_set_variant(cpu *c, enum cpu_variant_t variant);
 /** Read a byte from the given address. */
 byte cpu_read_byte(cpu *c, address a);
 
+/**
+ * Read or write a byte like cpu_read_byte() and cpu_write_byte(), but
+ * for debuggers and tracers: the access is not counted in the
+ * statistics.
+ */
+byte cpu_peek_byte(cpu *c, address a);
+void cpu_poke_byte(cpu *c, address a, byte b);
+
 /** Read a two byte address starting at the given address. */
 address cpu_read_address(cpu *c, address a);
 
@@ -104,12 +188,64 @@ byte cpu_next_byte(cpu *c);
 /** Read the next address from memory and increment the program counter. */
 address cpu_next_address(cpu *c);
 
-/** Step the CPU by one instruction. */
-void cpu_step(cpu *c);
+/**
+ * Step the CPU by one instruction.
+ * Returns the number of clock cycles consumed, including page
+ * crossing and taken branch penalties and any interrupt serviced
+ * after the instruction. If c->profile is set the instruction is
+ * counted against its address.
+ */
+int cpu_step(cpu *c);
 
-/** Run the CPU until it halts. */
+/** Run the CPU until it halts or executes STP. */
 void cpu_run(cpu *c);
 
+/**
+ * Run the CPU for a bounded slice without calling the tick function.
+ * The cycle budget may be overrun by the last instruction executed.
+ * Breakpoints are not checked before the first instruction, so a run
+ * that stopped at a breakpoint can be resumed.
+ * Returns the reason the slice ended.
+ */
+enum cpu_exit_t cpu_run_cycles(cpu *c, count_t budget);
+enum cpu_exit_t cpu_run_instructions(cpu *c, count_t budget);
+
+/**
+ * Set or clear a breakpoint. The caller must point c->breakpoints
+ * at a zeroed bitmap of at least CPU_BREAKPOINT_BYTES bytes first.
+ */
+#define CPU_BREAKPOINT_BYTES 0x2000
+void cpu_set_breakpoint(cpu *c, address a);
+void cpu_clear_breakpoint(cpu *c, address a);
+bool cpu_is_breakpoint(cpu *c, address a);
+
+/**
+ * Profiling counts every instruction by the address it started at. To
+ * start, point c->profile at a zeroed array of CPU_PROFILE_ENTRIES.
+ */
+#define CPU_PROFILE_ENTRIES 0x10000
+
+/**
+ * Decode the instruction at the PC without executing it. Stores the
+ * address it reads, writes or jumps to in ea, or 0 if it has none, and
+ * returns its length in bytes. Memory is read through the callbacks.
+ */
+int cpu_decode(cpu *c, address *ea);
+
+#if defined(V6502C_STATS)
+/**
+ * Copy the instruction mix counted since cpu_init() or
+ * cpu_clear_stats(), with the instruction and addressing mode totals.
+ */
+void cpu_get_stats(cpu *c, cpu_stats_t *stats);
+void cpu_clear_stats(cpu *c);
+
+/** Describe opcodes and addressing modes for reports. */
+const char *cpu_opcode_name(byte op);
+int cpu_opcode_addressing(byte op);
+const char *cpu_addressing_name(int mode);
+#endif
+
 /** Halt the CPU. */
 void cpu_halt(cpu *c);
 
@@ -119,6 +255,13 @@ void cpu_reset(cpu *c);
 /** Trigger a CPU interrupt request (IRQ). */
 void cpu_irq(cpu *c);
 
+/**
+ * Set the level of the IRQ input. Unlike cpu_irq(), which requests a
+ * single interrupt, the line keeps interrupting the CPU whenever IRQs
+ * are unmasked until the device driving it releases it.
+ */
+void cpu_set_irq_line(cpu *c, bool level);
+
 /** Trigger a CPU non-maskable interrupt. */
 void cpu_nmi(cpu *c);
 
@@ -0,0 +1,239 @@
+/**
+ *
+ * Call graph profiles.
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vcalls.h"
+
+#define VCALLS_INITIAL_NODES 1024
+
+vcalls_t *vcalls_create(void) {
+  vcalls_t *calls = (vcalls_t *)malloc(sizeof(vcalls_t));
+
+  if (calls == NULL) return NULL;
+  calls->nodes = (vcalls_node_t *)malloc(VCALLS_INITIAL_NODES * sizeof(vcalls_node_t));
+  if (calls->nodes == NULL) {
+    free(calls);
+    return NULL;
+  }
+  calls->size = VCALLS_INITIAL_NODES;
+  calls->count = 1;
+  memset(&calls->nodes[VCALLS_ROOT], 0, sizeof(vcalls_node_t));
+  calls->depth = 0;
+  calls->current = VCALLS_ROOT;
+  calls->last = 0;
+  calls->lost = 0;
+  return calls;
+}
+
+void vcalls_destroy(vcalls_t *calls) {
+  if (calls == NULL) return;
+  free(calls->nodes);
+  free(calls);
+}
+
+void vcalls_clear(vcalls_t *calls, cpu *c) {
+  calls->count = 1;
+  memset(&calls->nodes[VCALLS_ROOT], 0, sizeof(vcalls_node_t));
+  calls->depth = 0;
+  calls->current = VCALLS_ROOT;
+  calls->last = c->cycles;
+  calls->lost = 0;
+}
+
+void vcalls_update(vcalls_t *calls, cpu *c) {
+  /* The cycle count only goes backwards when the history rewinds it */
+  if (c->cycles > calls->last) {
+    calls->nodes[calls->current].cycles += c->cycles - calls->last;
+  }
+  calls->last = c->cycles;
+}
+
+/* Pop the frames whose return address is above the stack pointer. */
+static void _unwind(vcalls_t *calls, byte sp) {
+  while (calls->depth > 0 && sp + 2 > calls->stack[calls->depth - 1].sp) {
+    calls->depth--;
+  }
+  calls->current = calls->depth > 0 ? calls->stack[calls->depth - 1].node : VCALLS_ROOT;
+}
+
+/* Find or add the child of the current node for a callee. */
+static unsigned long _child(vcalls_t *calls, address callee) {
+  vcalls_node_t *parent = &calls->nodes[calls->current];
+  vcalls_node_t *nodes;
+  vcalls_node_t *node;
+  unsigned long i;
+
+  for (i = parent->child; i != VCALLS_ROOT; i = calls->nodes[i].sibling) {
+    if (calls->nodes[i].callee == callee) return i;
+  }
+
+  if (calls->count == calls->size) {
+    nodes = (vcalls_node_t *)realloc(calls->nodes, 2 * calls->size * sizeof(vcalls_node_t));
+    if (nodes == NULL) return VCALLS_ROOT;
+    calls->nodes = nodes;
+    calls->size *= 2;
+    parent = &calls->nodes[calls->current];
+  }
+  i = calls->count++;
+  node = &calls->nodes[i];
+  node->callee = callee;
+  node->parent = calls->current;
+  node->child = VCALLS_ROOT;
+  node->sibling = parent->child;
+  node->calls = 0;
+  node->cycles = 0;
+  parent->child = i;
+  return i;
+}
+
+/* Enter the routine at the PC, sp is the SP before the call. */
+static void _enter(vcalls_t *calls, address callee, byte sp) {
+  unsigned long node;
+
+  _unwind(calls, sp);
+  if (calls->depth == VCALLS_MAX_DEPTH) {
+    calls->lost++;
+    return;
+  }
+  node = _child(calls, callee);
+  if (node == VCALLS_ROOT) {
+    calls->lost++;
+    return;
+  }
+  calls->nodes[node].calls++;
+  calls->stack[calls->depth].node = node;
+  calls->stack[calls->depth].sp = sp;
+  calls->depth++;
+  calls->current = node;
+}
+
+void vcalls_event(vcalls_t *calls, cpu *c, enum cpu_call_t kind) {
+  vcalls_update(calls, c);
+  switch (kind) {
+  case CPU_CALL_JSR:
+    _enter(calls, c->pc, (byte)(c->sp + 2));
+    break;
+  case CPU_CALL_INTERRUPT:
+    _enter(calls, c->pc, (byte)(c->sp + 3));
+    break;
+  case CPU_CALL_RTS:
+  case CPU_CALL_RTI:
+    _unwind(calls, c->sp);
+    break;
+  }
+}
+
+static int _by_inclusive(const void *a, const void *b) {
+  const vcalls_total_t *ta = (const vcalls_total_t *)a;
+  const vcalls_total_t *tb = (const vcalls_total_t *)b;
+
+  if (ta->inclusive != tb->inclusive) return ta->inclusive < tb->inclusive ? 1 : -1;
+  return ta->callee < tb->callee ? -1 : 1;
+}
+
+long vcalls_totals(vcalls_t *calls, vcalls_total_t **totals) {
+  count_t *inclusive;
+  long *index;
+  vcalls_total_t *t;
+  vcalls_node_t *node;
+  unsigned long i, j;
+  long count = 0;
+
+  *totals = NULL;
+  inclusive = (count_t *)malloc(calls->count * sizeof(count_t));
+  index = (long *)malloc(0x10000 * sizeof(long));
+  t = (vcalls_total_t *)malloc(calls->count * sizeof(vcalls_total_t));
+  if (inclusive == NULL || index == NULL || t == NULL) {
+    free(inclusive);
+    free(index);
+    free(t);
+    return -1;
+  }
+
+  /* Children come after their parents, so this sums each subtree */
+  for (i = 0; i < calls->count; i++) {
+    inclusive[i] = calls->nodes[i].cycles;
+  }
+  for (i = calls->count - 1; i > VCALLS_ROOT; i--) {
+    inclusive[calls->nodes[i].parent] += inclusive[i];
+  }
+
+  for (i = 0; i < 0x10000; i++) {
+    index[i] = -1;
+  }
+  for (i = VCALLS_ROOT + 1; i < calls->count; i++) {
+    node = &calls->nodes[i];
+    if (index[node->callee] < 0) {
+      index[node->callee] = count;
+      t[count].callee = node->callee;
+      t[count].calls = 0;
+      t[count].inclusive = 0;
+      t[count].exclusive = 0;
+      count++;
+    }
+    t[index[node->callee]].calls += node->calls;
+    t[index[node->callee]].exclusive += node->cycles;
+
+    /* A recursive call is already inside an outer call's cycles */
+    for (j = node->parent; j != VCALLS_ROOT; j = calls->nodes[j].parent) {
+      if (calls->nodes[j].callee == node->callee) break;
+    }
+    if (j == VCALLS_ROOT) {
+      t[index[node->callee]].inclusive += inclusive[i];
+    }
+  }
+
+  free(inclusive);
+  free(index);
+  qsort(t, count, sizeof(vcalls_total_t), _by_inclusive);
+  *totals = t;
+  return count;
+}
+
+/* Write the path from the root to a node, outermost call first. */
+static void _write_path(vcalls_t *calls, FILE *file, unsigned long i) {
+  if (i == VCALLS_ROOT) {
+    fputs("(root)", file);
+    return;
+  }
+  _write_path(calls, file, calls->nodes[i].parent);
+  fprintf(file, ";$%04X", calls->nodes[i].callee);
+}
+
+int vcalls_write_collapsed(vcalls_t *calls, FILE *file) {
+  unsigned long i;
+
+  for (i = 0; i < calls->count; i++) {
+    if (calls->nodes[i].cycles == 0) continue;
+    _write_path(calls, file, i);
+    fprintf(file, " %.0f\n", (double)calls->nodes[i].cycles);
+  }
+  return ferror(file) ? -1 : 0;
+}
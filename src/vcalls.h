@@ -0,0 +1,117 @@
+#ifndef _VCALLS_H_
+#define _VCALLS_H_
+
+/**
+ *
+ * Call graph profiles.
+ *
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+
+#include "vtypes.h"
+#include "v6502.h"
+
+/*
+ * A shadow call stack follows the CPU through JSR, RTS, interrupts and
+ * RTI, and charges the cycles between them to the routine running, as
+ * a tree of call paths.
+ *
+ * Each frame remembers the stack pointer from before its return
+ * address was pushed. After a return, and before a call, every frame
+ * whose return address is no longer on the 6502 stack is popped. So an
+ * RTS used as a jump to a pushed address does not end the routine, and
+ * a routine that pulls its return address and returns straight to its
+ * caller's caller ends both frames.
+ */
+#define VCALLS_MAX_DEPTH 256
+#define VCALLS_ROOT      0     /* Node for whatever ran before the first call */
+
+typedef struct vcalls_node {
+  address callee;        /* Routine or interrupt handler address */
+  unsigned long parent;
+  unsigned long child;   /* First child, or VCALLS_ROOT for none */
+  unsigned long sibling; /* Next child of the parent, or VCALLS_ROOT */
+  count_t calls;
+  count_t cycles;        /* Exclusive cycles, spent in this routine itself */
+} vcalls_node_t;
+
+typedef struct vcalls_frame {
+  unsigned long node;
+  byte sp;               /* SP before the return address was pushed */
+} vcalls_frame_t;
+
+typedef struct vcalls {
+  vcalls_node_t *nodes;  /* The call tree, parents before children */
+  unsigned long size;    /* Nodes allocated */
+  unsigned long count;   /* Nodes in use */
+  vcalls_frame_t stack[VCALLS_MAX_DEPTH];
+  int depth;
+  unsigned long current; /* Node of the running routine */
+  count_t last;          /* Cycle count already charged */
+  unsigned long lost;    /* Calls not followed, the stack or memory ran out */
+} vcalls_t;
+
+/* Per routine totals, see vcalls_totals() */
+typedef struct vcalls_total {
+  address callee;
+  count_t calls;
+  count_t inclusive;     /* Cycles in the routine and everything it called */
+  count_t exclusive;
+} vcalls_total_t;
+
+/*
+ * Create an empty profile. Returns NULL if memory runs out. Attach it
+ * to a machine with machine_set_calls().
+ */
+vcalls_t *vcalls_create(void);
+void vcalls_destroy(vcalls_t *calls);
+
+/* Forget everything, starting again from the CPU's current state. */
+void vcalls_clear(vcalls_t *calls, cpu *c);
+
+/* Follow a call or return. See CallCtxFn. */
+void vcalls_event(vcalls_t *calls, cpu *c, enum cpu_call_t kind);
+
+/* Charge the cycles since the last call or return to the running routine. */
+void vcalls_update(vcalls_t *calls, cpu *c);
+
+/*
+ * Total the profile by routine, busiest first by inclusive cycles.
+ * Recursive calls are only counted once towards the inclusive cycles.
+ * Returns the number of routines, or -1 if memory runs out. The caller
+ * frees *totals.
+ */
+long vcalls_totals(vcalls_t *calls, vcalls_total_t **totals);
+
+/*
+ * Write each call path and its exclusive cycles in the collapsed stack
+ * format read by flame graph tools, e.g. "$F01A;$E3B2;$DA63 1234".
+ * Returns 0, or -1 if writing failed.
+ */
+int vcalls_write_collapsed(vcalls_t *calls, FILE *file);
+
+#endif
@@ -0,0 +1,303 @@
+/**
+ *
+ * Execution history of a vMachine, for stepping backwards.
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vhistory.h"
+
+vhistory_t *vhistory_create(unsigned long entries, unsigned int snapshots, count_t interval) {
+  vhistory_t *history;
+
+  if (entries == 0) return NULL;
+  history = (vhistory_t *)malloc(sizeof(vhistory_t));
+  if (history == NULL) return NULL;
+  history->ring = (vhistory_entry_t *)malloc(entries * sizeof(vhistory_entry_t));
+  history->snapshots = NULL;
+  if (snapshots > 0 && interval > 0) {
+    history->snapshots = (vhistory_snapshot_t *)malloc(snapshots * sizeof(vhistory_snapshot_t));
+  } else {
+    snapshots = 0;
+  }
+  if (history->ring == NULL || (snapshots > 0 && history->snapshots == NULL)) {
+    vhistory_destroy(history);
+    return NULL;
+  }
+  history->size = entries;
+  history->snapshot_size = snapshots;
+  history->interval = interval;
+  memset(&history->before, 0, sizeof(history->before));
+  history->head = 0;
+  history->count = 0;
+  history->instructions = 0;
+  history->broken = FALSE;
+  history->snapshot_count = 0;
+  history->snapshot_first = 0;
+  history->next_snapshot = 0;
+  return history;
+}
+
+void vhistory_destroy(vhistory_t *history) {
+  if (history != NULL) {
+    free(history->ring);
+    free(history->snapshots);
+    free(history);
+  }
+}
+
+static void _save_regs(vhistory_entry_t *e, cpu *c) {
+  e->cycles = c->cycles;
+  e->pc = c->pc;
+  e->a = c->a;
+  e->x = c->x;
+  e->y = c->y;
+  e->sr = c->sr;
+  e->sp = c->sp;
+  e->kind = VHISTORY_REGS;
+}
+
+static void _restore_regs(vmachine_t *machine, const vhistory_entry_t *e) {
+  cpu *c = &machine->c;
+
+  machine_set_cycles(machine, e->cycles);
+  c->pc = e->pc;
+  c->a = e->a;
+  c->x = e->x;
+  c->y = e->y;
+  c->sr = e->sr;
+  c->sp = e->sp;
+  c->waiting = FALSE;
+  c->stopped = FALSE;
+  machine->history->before = *e;
+}
+
+static void _clear_log(vhistory_t *history) {
+  history->head = 0;
+  history->count = 0;
+  history->instructions = 0;
+}
+
+void vhistory_clear(vhistory_t *history, vmachine_t *machine) {
+  if (history == NULL) return;
+  _clear_log(history);
+  history->broken = FALSE;
+  _save_regs(&history->before, &machine->c);
+  history->snapshot_count = 0;
+  history->snapshot_first = 0;
+  history->next_snapshot = machine->c.cycles;
+}
+
+void vhistory_sync(vhistory_t *history, vmachine_t *machine) {
+  if (history != NULL) {
+    _save_regs(&history->before, &machine->c);
+  }
+}
+
+/* Forget the oldest instruction to make room. */
+static void _evict(vhistory_t *history) {
+  unsigned long tail = (history->head + history->size - history->count) % history->size;
+
+  while (history->count > 0) {
+    history->count--;
+    if (history->ring[tail].kind == VHISTORY_REGS) {
+      history->instructions--;
+      return;
+    }
+    tail = (tail + 1) % history->size;
+  }
+
+  /* The current instruction alone overflowed the ring */
+  history->broken = TRUE;
+}
+
+static void _push(vhistory_t *history, const vhistory_entry_t *e) {
+  if (history->count == history->size) {
+    _evict(history);
+  }
+  history->ring[history->head] = *e;
+  history->head = (history->head + 1) % history->size;
+  history->count++;
+}
+
+static vhistory_entry_t *_pop(vhistory_t *history) {
+  if (history->count == 0) return NULL;
+  history->head = (history->head + history->size - 1) % history->size;
+  history->count--;
+  return &history->ring[history->head];
+}
+
+static bool _top_is_write(vhistory_t *history) {
+  return history->count > 0 &&
+    history->ring[(history->head + history->size - 1) % history->size].kind == VHISTORY_WRITE;
+}
+
+/* Backing memory of a page. The I/O page keeps its unclaimed addresses in mem. */
+static byte *_page_mem(vmachine_t *machine, int i) {
+  if (machine->pages[i].mem != NULL) return machine->pages[i].mem;
+  return &machine->mem[i << 8];
+}
+
+static void _take_snapshot(vhistory_t *history, vmachine_t *machine) {
+  vhistory_snapshot_t *snapshot;
+  int i;
+
+  if (history->snapshot_count == history->snapshot_size) {
+    history->snapshot_first = (history->snapshot_first + 1) % history->snapshot_size;
+    history->snapshot_count--;
+  }
+  snapshot = &history->snapshots[(history->snapshot_first + history->snapshot_count) %
+                                 history->snapshot_size];
+  history->snapshot_count++;
+
+  _save_regs(&snapshot->regs, &machine->c);
+  for (i = 0; i < VMACHINE_PAGES; i++) {
+    memcpy(&snapshot->mem[i << 8], _page_mem(machine, i), 0x100);
+  }
+}
+
+static vhistory_snapshot_t *_snapshot(vhistory_t *history, unsigned int n) {
+  return &history->snapshots[(history->snapshot_first + n) % history->snapshot_size];
+}
+
+/* Snapshots taken after the machine's rewound clock are of a future that may not happen. */
+static void _drop_newer_snapshots(vhistory_t *history, count_t cycles) {
+  while (history->snapshot_count > 0 &&
+         _snapshot(history, history->snapshot_count - 1)->regs.cycles > cycles) {
+    history->snapshot_count--;
+  }
+  history->next_snapshot = cycles + history->interval;
+}
+
+void vhistory_record_step(vhistory_t *history, vmachine_t *machine) {
+  cpu *c = &machine->c;
+
+  if (history->broken) {
+    /* The instruction cannot be undone, start again after it */
+    _clear_log(history);
+    history->broken = FALSE;
+  } else if (c->pc != history->before.pc || c->cycles != history->before.cycles ||
+             _top_is_write(history)) {
+    _push(history, &history->before);
+    history->instructions++;
+  }
+  _save_regs(&history->before, c);
+
+  if (history->snapshot_size > 0 && c->cycles >= history->next_snapshot) {
+    _take_snapshot(history, machine);
+    history->next_snapshot = c->cycles + history->interval;
+  }
+}
+
+void vhistory_record_write(vhistory_t *history, address a, byte old) {
+  vhistory_entry_t e;
+
+  e.cycles = 0;
+  e.pc = a;
+  e.a = old;
+  e.x = 0;
+  e.y = 0;
+  e.sr = 0;
+  e.sp = 0;
+  e.kind = VHISTORY_WRITE;
+  _push(history, &e);
+}
+
+/* Undo writes down to the previous instruction's registers. */
+static void _undo_writes(vmachine_t *machine) {
+  vhistory_t *history = machine->history;
+  vhistory_entry_t *e;
+
+  while (_top_is_write(history)) {
+    e = _pop(history);
+    machine_restore_byte(machine, e->pc, e->a);
+  }
+}
+
+bool vhistory_step_back(vmachine_t *machine) {
+  vhistory_t *history = machine->history;
+  vhistory_entry_t regs;
+
+  if (history == NULL || history->instructions == 0) return FALSE;
+
+  /* Writes made since the last instruction, e.g. from the monitor */
+  _undo_writes(machine);
+
+  regs = *_pop(history);
+  history->instructions--;
+  _undo_writes(machine);
+  _restore_regs(machine, &regs);
+  _drop_newer_snapshots(history, regs.cycles);
+  return TRUE;
+}
+
+static void _restore_snapshot(vmachine_t *machine, vhistory_snapshot_t *snapshot) {
+  vhistory_t *history = machine->history;
+  vhistory_entry_t regs = snapshot->regs;
+  byte *mem;
+  int i, j;
+
+  for (i = 0; i < VMACHINE_PAGES; i++) {
+    mem = _page_mem(machine, i);
+    if (memcmp(mem, &snapshot->mem[i << 8], 0x100) == 0) continue;
+    for (j = 0; j < 0x100; j++) {
+      if (mem[j] != snapshot->mem[(i << 8) | j]) {
+        machine_restore_byte(machine, (address)((i << 8) | j), snapshot->mem[(i << 8) | j]);
+      }
+    }
+  }
+  _clear_log(history);
+  history->broken = FALSE;
+  _restore_regs(machine, &regs);
+  _drop_newer_snapshots(history, regs.cycles);
+}
+
+enum vhistory_stop_t vhistory_continue_back(vmachine_t *machine, long stop) {
+  vhistory_t *history = machine->history;
+  cpu *c = &machine->c;
+  bool moved = FALSE;
+  unsigned int i;
+
+  if (history == NULL) return VHISTORY_STOP_NONE;
+
+  while (vhistory_step_back(machine)) {
+    moved = TRUE;
+    if ((stop >= 0 && c->pc == (address)stop) ||
+        (c->breakpoints != NULL && cpu_is_breakpoint(c, c->pc))) {
+      return VHISTORY_STOP_BREAKPOINT;
+    }
+  }
+
+  /* Fall back on the newest snapshot older than the undo log reaches */
+  for (i = history->snapshot_count; i > 0; i--) {
+    if (_snapshot(history, i - 1)->regs.cycles < c->cycles) {
+      _restore_snapshot(machine, _snapshot(history, i - 1));
+      return VHISTORY_STOP_SNAPSHOT;
+    }
+  }
+  return moved ? VHISTORY_STOP_START : VHISTORY_STOP_NONE;
+}
@@ -0,0 +1,133 @@
+#ifndef _VHISTORY_H_
+#define _VHISTORY_H_
+
+/**
+ *
+ * Execution history of a vMachine, for stepping backwards.
+ *
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "vmachine.h"
+
+/*
+ * The history is an undo log kept in a fixed size ring. Before every
+ * instruction machine_tick() logs the CPU registers, and every write to
+ * memory logs the byte it overwrote. Undoing an instruction restores
+ * those bytes and registers. When the ring is full the oldest
+ * instructions are forgotten, so the log never grows.
+ *
+ * Every interval cycles a snapshot of the registers and memory is also
+ * kept, in a second small ring. Snapshots reach back further than the
+ * undo log, one snapshot at a time.
+ *
+ * Only the CPU and memory go back in time. Devices keep their current
+ * state and carry on from the rewound cycle count.
+ */
+#define VHISTORY_DEFAULT_ENTRIES   65536   /* About 1MB of undo log */
+#define VHISTORY_DEFAULT_SNAPSHOTS 4
+#define VHISTORY_DEFAULT_INTERVAL  1000000 /* Cycles between snapshots */
+
+/* Undo log entry kinds */
+#define VHISTORY_REGS  0  /* Registers before an instruction */
+#define VHISTORY_WRITE 1  /* Memory write, a holds the old value */
+
+typedef struct vhistory_entry {
+  count_t cycles;
+  address pc;     /* Program counter, or the address written */
+  byte a;
+  byte x;
+  byte y;
+  byte sr;
+  byte sp;
+  byte kind;
+} vhistory_entry_t;
+
+typedef struct vhistory_snapshot {
+  vhistory_entry_t regs;
+  byte mem[0x10000];
+} vhistory_snapshot_t;
+
+typedef struct vhistory {
+  vhistory_entry_t *ring;
+  unsigned long size;         /* Entries in the ring */
+  unsigned long head;         /* Next entry to write */
+  unsigned long count;        /* Entries in use */
+  unsigned long instructions; /* Instructions that can be undone */
+  bool broken;                /* Writes of the current instruction were lost */
+  vhistory_entry_t before;    /* Registers before the current instruction */
+
+  vhistory_snapshot_t *snapshots;
+  unsigned int snapshot_size;  /* Snapshots kept */
+  unsigned int snapshot_count; /* Snapshots taken, oldest first from snapshot_first */
+  unsigned int snapshot_first;
+  count_t interval;           /* Cycles between snapshots, 0 for none */
+  count_t next_snapshot;      /* Cycle count the next snapshot is due */
+} vhistory_t;
+
+/*
+ * Create a history with room for the given number of undo log entries
+ * and snapshots. Returns NULL if memory runs out. Attach it to a
+ * machine with machine_set_history().
+ */
+vhistory_t *vhistory_create(unsigned long entries, unsigned int snapshots, count_t interval);
+void vhistory_destroy(vhistory_t *history);
+
+/* Forget everything, starting again from the machine's current state. */
+void vhistory_clear(vhistory_t *history, vmachine_t *machine);
+
+/*
+ * Take registers changed between instructions, e.g. by the monitor, as
+ * the state the next instruction starts from. The change itself cannot
+ * be undone.
+ */
+void vhistory_sync(vhistory_t *history, vmachine_t *machine);
+
+/* Called by the machine to log an instruction and a memory write. */
+void vhistory_record_step(vhistory_t *history, vmachine_t *machine);
+void vhistory_record_write(vhistory_t *history, address a, byte old);
+
+/*
+ * Undo the last instruction. Returns FALSE if there is no history to
+ * undo.
+ */
+bool vhistory_step_back(vmachine_t *machine);
+
+/* Reasons vhistory_continue_back() stops */
+enum vhistory_stop_t {
+  VHISTORY_STOP_NONE,        /* There was no history to go back through */
+  VHISTORY_STOP_BREAKPOINT,  /* The PC reached a breakpoint or the stop address */
+  VHISTORY_STOP_SNAPSHOT,    /* The undo log ran out, a snapshot was restored */
+  VHISTORY_STOP_START        /* The oldest state in the history was reached */
+};
+
+/*
+ * Run backwards until the PC reaches a breakpoint, or stop if it is not
+ * negative. When the undo log runs out the newest older snapshot is
+ * restored instead.
+ */
+enum vhistory_stop_t vhistory_continue_back(vmachine_t *machine, long stop);
+
+#endif
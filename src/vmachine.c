@@ -29,11 +29,130 @@
  */
 
 #include "vmachine.h"
+#include "vhistory.h"
+
+/* Drive the CPU's IRQ line from every device that can interrupt. */
+static void _update_irq(vmachine_t *machine) {
+  cpu_set_irq_line(&machine->c,
+                   via_irq_pending(machine->via) ||
+                   acia_irq_pending(machine->acia1) ||
+                   acia_irq_pending(machine->acia2));
+}
+
+/* Bring the devices that keep time up to the current cycle. */
+static void _sync_devices(vmachine_t *machine) {
+  via_sync(machine->via, machine->c.cycles);
+  acia_sync(machine->acia1, machine->c.cycles);
+  acia_sync(machine->acia2, machine->c.cycles);
+}
+
+/*
+ * The next event the guest could notice: a VIA timer expiry, an ACIA
+ * frame completing or the output flush deadline.
+ */
+static count_t _next_deadline(vmachine_t *machine) {
+  count_t next = via_next_event(machine->via);
+  count_t acia;
+
+  acia = acia_next_event(machine->acia1);
+  if (acia < next) next = acia;
+  acia = acia_next_event(machine->acia2);
+  if (acia < next) next = acia;
+  if (machine->tx_deadline < next) next = machine->tx_deadline;
+  return next;
+}
+
+/* Schedule the next device event or read of host input. */
+static void _schedule(vmachine_t *machine) {
+  count_t next = _next_deadline(machine);
+
+  if (machine->rx_poll < next) next = machine->rx_poll;
+  machine->next_event = next;
+}
+
+/*
+ * Receive input for one ACIA. Input is read from the host and recorded,
+ * or taken from the log when replaying.
+ */
+static void _pump_acia(vmachine_t *machine, acia_t *dev, byte device) {
+  byte buffer[ACIA_RX_FIFO_SIZE];
+  vreplay_t *log = machine->input_log;
+  int n;
+  int i;
+
+  if (log != NULL && log->replaying) {
+    while (vreplay_due(log, machine->c.cycles, VREPLAY_INPUT) &&
+           log->device == device) {
+      for (i = 0; i < (int)log->length; i++) {
+        acia_receive(dev, log->data[i]);
+      }
+      vreplay_next(log);
+    }
+    return;
+  }
+
+  n = acia_read_input(dev, buffer, sizeof(buffer));
+  if (n > 0 && log != NULL) {
+    vreplay_write(log, machine->c.cycles, VREPLAY_INPUT, device, buffer, (unsigned int)n);
+  }
+  for (i = 0; i < n; i++) {
+    acia_receive(dev, buffer[i]);
+  }
+}
+
+/* Read waiting host input into the ACIA receive FIFOs. */
+static void _pump(vmachine_t *machine) {
+  _pump_acia(machine, machine->acia1, 1);
+  _pump_acia(machine, machine->acia2, 2);
+  machine->rx_poll = machine->c.cycles + VMACHINE_ACIA_POLL_CYCLES;
+}
+
+/* Bring devices up to the current cycle, update the IRQ line and reschedule. */
+void machine_run_events(vmachine_t *machine) {
+  _sync_devices(machine);
+  if (machine->c.cycles >= machine->rx_poll) {
+    _pump(machine);
+  }
+  if (machine->c.cycles >= machine->tx_deadline) {
+    machine_flush(machine);
+  }
+
+  /* Start the latency bound when output is first buffered */
+  if (machine->tx_deadline == VMACHINE_NO_EVENT &&
+      (acia_tx_pending(machine->acia1) || acia_tx_pending(machine->acia2))) {
+    machine->tx_deadline = machine->c.cycles + machine->tx_latency;
+  }
+  _update_irq(machine);
+  _schedule(machine);
+}
+
+/*
+ * Write out buffered ACIA output. Output that the host cannot take yet
+ * is retried after another tx_latency cycles.
+ */
+void machine_flush(vmachine_t *machine) {
+  unsigned int pending;
+
+  pending = acia_flush(machine->acia1);
+  pending += acia_flush(machine->acia2);
+  machine->tx_deadline = pending > 0 ?
+    machine->c.cycles + machine->tx_latency : VMACHINE_NO_EVENT;
+}
 
 void machine_tick(vmachine_t *machine) {
-  /* Update VIA timers */
-  if (machine->via != NULL) {
-    via_tick(machine->via);
+  if (machine->history != NULL) {
+    vhistory_record_step(machine->history, machine);
+  }
+
+  /* A CPU waiting for an interrupt skips ahead to the next event */
+  if (machine->c.waiting && machine->next_event != VMACHINE_NO_EVENT &&
+      machine->c.cycles < machine->next_event) {
+    machine->c.cycles = machine->next_event;
+  }
+
+  /* Idle devices cost a single comparison per instruction */
+  if (machine->c.cycles >= machine->next_event) {
+    machine_run_events(machine);
   }
 
   /* Call trace callback if tracing is enabled */
@@ -41,67 +160,534 @@ void machine_tick(vmachine_t *machine) {
     machine->trace_fn(machine, &machine->prevc, &machine->c);
     machine->prevc = machine->c;
   }
+
+  /* The binary trace records the next instruction before it runs */
+  if (machine->trace != NULL && !machine->c.waiting) {
+    vtrace_record(machine->trace, &machine->c);
+  }
 }
 
-byte machine_read(vmachine_t *machine, address a) {
-  /* ACIA #1: $C010-$C013 */
-  if (a >= 0xC010 && a <= 0xC013) {
-    return acia_read(machine->acia1, (byte)(a & 0x03));
+enum cpu_exit_t machine_run_cycles(vmachine_t *machine, count_t budget) {
+  count_t end = machine->c.cycles + budget;
+  count_t slice;
+  enum cpu_exit_t reason;
+
+  while (machine->c.cycles < end) {
+    if (machine->c.cycles >= machine->next_event) {
+      machine_run_events(machine);
+    }
+
+    /*
+     * Run up to the next device event, so it is handled on time. An
+     * event that is due again at once, such as a flush retry with no
+     * latency, still lets an instruction run.
+     */
+    slice = end - machine->c.cycles;
+    if (machine->next_event - machine->c.cycles < slice) {
+      slice = machine->next_event - machine->c.cycles;
+    }
+    if (slice == 0) slice = 1;
+    reason = cpu_run_cycles(&machine->c, slice);
+
+    if (reason == CPU_EXIT_WAITING) {
+      /* Nothing but a device event can end the wait */
+      if (machine->next_event == VMACHINE_NO_EVENT) return CPU_EXIT_WAITING;
+      if (machine->c.cycles < machine->next_event) {
+        machine->c.cycles = machine->next_event < end ? machine->next_event : end;
+      }
+    } else if (reason != CPU_EXIT_BUDGET && reason != CPU_EXIT_IRQ) {
+      if (machine->c.cycles >= machine->next_event) {
+        machine_run_events(machine);
+      }
+      return reason;
+    }
   }
-  /* ACIA #2: $C020-$C023 */
-  if (a >= 0xC020 && a <= 0xC023) {
-    return acia_read(machine->acia2, (byte)(a & 0x03));
+  if (machine->c.cycles >= machine->next_event) {
+    machine_run_events(machine);
   }
-  /* VIA: $C030-$C03F */
-  if (a >= 0xC030 && a <= 0xC03F) {
-    return via_read(machine->via, (byte)(a & 0x0F));
+  return CPU_EXIT_BUDGET;
+}
+
+/* Drop the machine's reference to its shared memory. */
+static void _release_shared(vmachine_t *machine) {
+  if (machine->shared != NULL && --machine->shared->refs == 0) {
+    free(machine->shared);
   }
-  /* File I/O: $C040-$C04F */
-  if (a >= 0xC040 && a <= 0xC04F) {
-    return fileio_read(machine->fio, (byte)(a & 0x0F));
+  machine->shared = NULL;
+  machine->shared_pages = 0;
+}
+
+/* Give the machine its own copy of a shared page. */
+static void _unshare_page(vmachine_t *machine, int i) {
+  vmachine_page_t *page = &machine->pages[i];
+
+  memcpy(&machine->mem[i << 8], page->mem, 0x100);
+  page->mem = &machine->mem[i << 8];
+  page->flags &= ~VMACHINE_PAGE_SHARED;
+  if (--machine->shared_pages == 0) {
+    _release_shared(machine);
   }
-  return machine->mem[a];
 }
 
-void machine_write(vmachine_t *machine, address a, byte b) {
-  /* ACIA #1: $C010-$C013 */
-  if (a >= 0xC010 && a <= 0xC013) {
-    acia_write(machine->acia1, (byte)(a & 0x03), b);
-    return;
+/* Give the machine its own copy of every shared page. */
+void machine_unshare(vmachine_t *machine) {
+  int i;
+
+  for (i = 0; i < VMACHINE_PAGES && machine->shared != NULL; i++) {
+    if (machine->pages[i].flags & VMACHINE_PAGE_SHARED) {
+      _unshare_page(machine, i);
+    }
   }
-  /* ACIA #2: $C020-$C023 */
-  if (a >= 0xC020 && a <= 0xC023) {
-    acia_write(machine->acia2, (byte)(a & 0x03), b);
-    return;
+}
+
+void machine_set_input_log(vmachine_t *machine, vreplay_t *log) {
+  machine->input_log = log;
+  if (log != NULL && machine->rx_poll == VMACHINE_NO_EVENT) {
+    machine->rx_poll = machine->c.cycles + VMACHINE_ACIA_POLL_CYCLES;
+    _schedule(machine);
   }
-  /* VIA: $C030-$C03F */
-  if (a >= 0xC030 && a <= 0xC03F) {
-    via_write(machine->via, (byte)(a & 0x0F), b);
-    return;
+}
+
+void machine_set_history(vmachine_t *machine, struct vhistory *history) {
+  int i;
+
+  if (machine->history != history) {
+    vhistory_destroy(machine->history);
   }
-  /* File I/O: $C040-$C04F */
-  if (a >= 0xC040 && a <= 0xC04F) {
-    fileio_write(machine->fio, (byte)(a & 0x0F), b);
-    return;
+  machine->history = history;
+  for (i = 0; i < VMACHINE_PAGES; i++) {
+    if (history != NULL) {
+      machine->pages[i].flags |= VMACHINE_PAGE_LOGGED;
+    } else {
+      machine->pages[i].flags &= ~VMACHINE_PAGE_LOGGED;
+    }
+  }
+  vhistory_clear(history, machine);
+}
+
+int machine_set_trace(vmachine_t *machine, vtrace_t *trace) {
+  int result = 0;
+
+  if (machine->trace != trace) {
+    result = vtrace_close(machine->trace);
+    /* Later records come from machine_tick() after each instruction */
+    if (trace != NULL && !machine->c.waiting) {
+      vtrace_record(trace, &machine->c);
+    }
+  }
+  machine->trace = trace;
+  return result;
+}
+
+void machine_set_profile(vmachine_t *machine, cpu_profile_t *profile) {
+  if (machine->c.profile != profile) {
+    free(machine->c.profile);
+  }
+  machine->c.profile = profile;
+}
+
+/* CPU call callback, set only while the call graph is profiled. */
+static void _machine_call(void *userdata, enum cpu_call_t kind) {
+  vmachine_t *machine = (vmachine_t *)userdata;
+
+  vcalls_event(machine->calls, &machine->c, kind);
+}
+
+void machine_set_calls(vmachine_t *machine, vcalls_t *calls) {
+  if (machine->calls != calls) {
+    vcalls_destroy(machine->calls);
+    if (calls != NULL) vcalls_clear(calls, &machine->c);
+  }
+  machine->calls = calls;
+  machine->c.call_ctx = calls != NULL ? _machine_call : NULL;
+}
+
+void machine_restore_byte(vmachine_t *machine, address a, byte b) {
+  vmachine_page_t *page = &machine->pages[a >> 8];
+
+  if (page->flags & VMACHINE_PAGE_SHARED) {
+    _unshare_page(machine, a >> 8);
   }
-  if (is_address_protected(&machine->protected_ranges, a)) {
+  if (page->flags & VMACHINE_PAGE_TRACKED) {
+    machine->dirty[a >> 11] |= (byte)(1 << ((a >> 8) & 0x07));
+    page->flags &= ~VMACHINE_PAGE_TRACKED;
+  }
+  machine->mem[a] = b;
+}
+
+/* Move an event time along with the clock. Events already due stay due. */
+static count_t _shift_event(count_t t, count_t from, count_t to) {
+  if (t == VMACHINE_NO_EVENT) return t;
+  return t > from ? to + (t - from) : to;
+}
+
+void machine_set_cycles(vmachine_t *machine, count_t cycles) {
+  count_t from = machine->c.cycles;
+  acia_t *acias[2];
+  int i;
+
+  _sync_devices(machine);
+  if (machine->via != NULL) {
+    machine->via->clock = cycles;
+  }
+  acias[0] = machine->acia1;
+  acias[1] = machine->acia2;
+  for (i = 0; i < 2; i++) {
+    if (acias[i] == NULL) continue;
+    acias[i]->clock = cycles;
+    acias[i]->tx_busy_until = _shift_event(acias[i]->tx_busy_until, from, cycles);
+    acias[i]->rx_next = _shift_event(acias[i]->rx_next, from, cycles);
+  }
+  machine->tx_deadline = _shift_event(machine->tx_deadline, from, cycles);
+  machine->rx_poll = _shift_event(machine->rx_poll, from, cycles);
+  machine->idle_polls = 0;
+  machine->idle_last_poll = cycles;
+  machine->c.cycles = cycles;
+  _schedule(machine);
+}
+
+void machine_checkpoint(vmachine_t *machine) {
+  int i;
+
+  memset(machine->dirty, 0, sizeof(machine->dirty));
+  for (i = 0; i < VMACHINE_PAGES; i++) {
+    machine->pages[i].flags |= VMACHINE_PAGE_TRACKED;
+  }
+}
+
+bool machine_page_dirty(vmachine_t *machine, int page) {
+  return (machine->dirty[page >> 3] & (1 << (page & 0x07))) != 0;
+}
+
+/*
+ * Share every memory page of the machine, ready to be cloned. If all
+ * pages are still shared from an earlier clone the same block is used
+ * again, otherwise memory is frozen into a new block.
+ */
+static bool _share_memory(vmachine_t *machine) {
+  vmachine_shared_t *shared;
+  int i;
+
+  if (machine->shared != NULL && machine->shared_pages == VMACHINE_PAGES - 1) {
+    return TRUE;
+  }
+  shared = (vmachine_shared_t *)malloc(sizeof(vmachine_shared_t));
+  if (shared == NULL) return FALSE;
+
+  for (i = 0; i < VMACHINE_PAGES; i++) {
+    if (i == VMACHINE_IO_PAGE) continue;
+    memcpy(&shared->mem[i << 8], machine->pages[i].mem, 0x100);
+    machine->pages[i].mem = &shared->mem[i << 8];
+    machine->pages[i].flags |= VMACHINE_PAGE_SHARED;
+  }
+  _release_shared(machine);
+  shared->refs = 1;
+  machine->shared = shared;
+  machine->shared_pages = VMACHINE_PAGES - 1;
+  return TRUE;
+}
+
+/* Write to backing memory unless the address is write-protected. */
+static void _write_memory(vmachine_t *machine, address a, byte b) {
+  vmachine_page_t *page = &machine->pages[a >> 8];
+  if ((page->flags & VMACHINE_PAGE_READONLY) ||
+      ((page->flags & VMACHINE_PAGE_PARTIAL) &&
+       is_address_in_bitmap(&machine->protected_bitmap, a))) {
     /* Address is write-protected */
     if (V6502C_VERBOSE) {
       fprintf(stderr, "Write to protected address %04X ignored\n", a);
     }
     return;
   }
+  if (page->flags & VMACHINE_PAGE_SHARED) {
+    _unshare_page(machine, a >> 8);
+  }
+  if (page->flags & VMACHINE_PAGE_TRACKED) {
+    machine->dirty[a >> 11] |= (byte)(1 << ((a >> 8) & 0x07));
+    page->flags &= ~VMACHINE_PAGE_TRACKED;
+  }
+  if (page->flags & VMACHINE_PAGE_LOGGED) {
+    vhistory_record_write(machine->history, a, machine->mem[a]);
+  }
   machine->mem[a] = b;
 }
 
+/*
+ * Replay what the host did while the guest was idle: deliver the input
+ * that arrived, or move the clock on. The guest halts once the log has
+ * run out, since nothing else can wake it.
+ */
+static void _replay_idle(vmachine_t *machine) {
+  vreplay_t *log = machine->input_log;
+  unsigned long skip;
+
+  if (log->done) {
+    cpu_halt(&machine->c);
+  } else if (vreplay_due(log, machine->c.cycles, VREPLAY_INPUT)) {
+    _pump(machine);
+  } else if (vreplay_due(log, machine->c.cycles, VREPLAY_IDLE) && log->length == 4) {
+    skip = (unsigned long)log->data[0] | ((unsigned long)log->data[1] << 8) |
+      ((unsigned long)log->data[2] << 16) | ((unsigned long)log->data[3] << 24);
+    machine->c.cycles += skip;
+    vreplay_next(log);
+  }
+}
+
+/*
+ * Sleep the host while the guest spins waiting for ACIA input. The
+ * sleep ends early when input arrives. If it runs its full length the
+ * emulated clock is moved forward by the time slept. The next read of
+ * host input does not cut the sleep short, waiting for input is what
+ * the sleep does.
+ */
+static void _host_idle(vmachine_t *machine) {
+  count_t per_ms = machine->clock_khz > 0 ? (count_t)machine->clock_khz : 1000;
+  count_t wait = (count_t)VMACHINE_IDLE_MAX_MS * per_ms;
+  count_t next = _next_deadline(machine);
+  int timeout_ms;
+  byte skip[4];
+
+  if (next != VMACHINE_NO_EVENT) {
+    if (next <= machine->c.cycles) return;
+    if (next - machine->c.cycles < wait) {
+      wait = next - machine->c.cycles;
+    }
+  }
+  timeout_ms = (int)(wait / per_ms);
+  if (timeout_ms == 0) return;
+
+  if (machine->input_log != NULL && machine->input_log->replaying) {
+    _replay_idle(machine);
+    return;
+  }
+
+  if (acia_wait_input(machine->acia1, machine->acia2, timeout_ms)) {
+    _pump(machine);
+  } else {
+    machine->c.cycles += (count_t)timeout_ms * per_ms;
+    if (machine->input_log != NULL) {
+      wait = (count_t)timeout_ms * per_ms;
+      skip[0] = (byte)(wait & 0xFF);
+      skip[1] = (byte)((wait >> 8) & 0xFF);
+      skip[2] = (byte)((wait >> 16) & 0xFF);
+      skip[3] = (byte)((wait >> 24) & 0xFF);
+      vreplay_write(machine->input_log, machine->c.cycles - wait, VREPLAY_IDLE, 0, skip, 4);
+    }
+  }
+}
+
+/*
+ * Track empty ACIA status reads. When the guest spins waiting for
+ * input, flush its output and idle the host, or halt the CPU if
+ * halt_at_eof is set and ACIA1 input will never come.
+ */
+static void _check_idle(vmachine_t *machine, byte status) {
+  if (status & ACIA_STATUS_RDRF) {
+    machine->idle_polls = 0;
+    return;
+  }
+  if (machine->idle_polls > 0 &&
+      machine->c.cycles - machine->idle_last_poll <= VMACHINE_IDLE_WINDOW) {
+    machine->idle_polls++;
+  } else {
+    machine->idle_polls = 1;
+  }
+  machine->idle_last_poll = machine->c.cycles;
+
+  if (machine->idle_polls >= VMACHINE_IDLE_POLLS) {
+    machine->idle_polls = 0;
+    if (machine->tx_deadline != VMACHINE_NO_EVENT) {
+      machine_flush(machine);
+    }
+    if (machine->halt_at_eof && machine->acia1 != NULL &&
+        machine->acia1->input_eof && machine->acia1->rx_count == 0) {
+      cpu_halt(&machine->c);
+    } else if (machine->host_idle) {
+      _host_idle(machine);
+    }
+  }
+}
+
+/*
+ * Read a file I/O register. What the device reads back depends on host
+ * files, so the value is recorded, or taken from the log when replaying.
+ */
+static byte _fileio_read(vmachine_t *machine, byte reg) {
+  vreplay_t *log = machine->input_log;
+  byte b;
+  byte event[2];
+
+  if (log != NULL && log->replaying) {
+    if (vreplay_due(log, machine->c.cycles, VREPLAY_FILEIO) &&
+        log->length == 2 && log->data[0] == reg) {
+      b = log->data[1];
+      vreplay_next(log);
+      return b;
+    }
+    return fileio_read(machine->fio, reg);
+  }
+
+  b = fileio_read(machine->fio, reg);
+  if (log != NULL) {
+    event[0] = reg;
+    event[1] = b;
+    vreplay_write(log, machine->c.cycles, VREPLAY_FILEIO, 0, event, 2);
+  }
+  return b;
+}
+
+/*
+ * Handlers for the I/O page at $C000-$C0FF. The VIA timers and ACIA
+ * frames are brought up to date lazily before a device is accessed, and the access may
+ * change interrupt or timer state, so events are rerun afterwards.
+ */
+static byte _io_read(vmachine_t *machine, address a) {
+  byte b;
+  bool acia_status = FALSE;
+
+  _sync_devices(machine);
+  if (a >= 0xC010 && a <= 0xC013) {
+    /* ACIA #1: $C010-$C013 */
+    b = acia_read(machine->acia1, (byte)(a & 0x03));
+    acia_status = (a & 0x03) == ACIA_REG_STATUS;
+  } else if (a >= 0xC020 && a <= 0xC023) {
+    /* ACIA #2: $C020-$C023 */
+    b = acia_read(machine->acia2, (byte)(a & 0x03));
+    acia_status = (a & 0x03) == ACIA_REG_STATUS;
+  } else if (a >= 0xC030 && a <= 0xC03F) {
+    /* VIA: $C030-$C03F */
+    b = via_read(machine->via, (byte)(a & 0x0F));
+  } else if (a >= 0xC040 && a <= 0xC04F) {
+    /* File I/O: $C040-$C04F */
+    b = _fileio_read(machine, (byte)(a & 0x0F));
+  } else {
+    return machine->mem[a];
+  }
+
+  if (acia_status) {
+    _check_idle(machine, b);
+  } else {
+    machine->idle_polls = 0;
+  }
+
+  machine_run_events(machine);
+  return b;
+}
+
+static void _io_write(vmachine_t *machine, address a, byte b) {
+  _sync_devices(machine);
+  machine->idle_polls = 0;
+  if (a >= 0xC010 && a <= 0xC013) {
+    /* ACIA #1: $C010-$C013 */
+    acia_write(machine->acia1, (byte)(a & 0x03), b);
+  } else if (a >= 0xC020 && a <= 0xC023) {
+    /* ACIA #2: $C020-$C023 */
+    acia_write(machine->acia2, (byte)(a & 0x03), b);
+  } else if (a >= 0xC030 && a <= 0xC03F) {
+    /* VIA: $C030-$C03F */
+    via_write(machine->via, (byte)(a & 0x0F), b);
+  } else if (a >= 0xC040 && a <= 0xC04F) {
+    /* File I/O: $C040-$C04F */
+    if (machine->input_log == NULL || !machine->input_log->replaying ||
+        (a & 0x0F) != FILEIO_REG_STATUS) {
+      /* Replayed commands would touch host files, their results are in the log */
+      fileio_write(machine->fio, (byte)(a & 0x0F), b);
+    }
+  } else {
+    _write_memory(machine, a, b);
+    return;
+  }
+
+  machine_run_events(machine);
+}
+
+byte machine_read(vmachine_t *machine, address a) {
+  vmachine_page_t *page = &machine->pages[a >> 8];
+  if (page->mem != NULL) {
+    return page->mem[a & 0xFF];
+  }
+  return page->read(machine, a);
+}
+
+void machine_write(vmachine_t *machine, address a, byte b) {
+  vmachine_page_t *page = &machine->pages[a >> 8];
+  if (page->mem == NULL) {
+    page->write(machine, a, b);
+    return;
+  }
+  if (page->flags != 0) {
+    _write_memory(machine, a, b);
+    return;
+  }
+  page->mem[a & 0xFF] = b;
+}
+
+/*
+ * Rebuild the protection bitmap from the range list and recompute
+ * the protection flags of every page.
+ */
+static void _update_protection(vmachine_t *machine) {
+  byte *bits;
+  int i, j, set, full;
+
+  build_address_bitmap(&machine->protected_ranges, &machine->protected_bitmap);
+
+  /* Each page is covered by 32 bytes of the bitmap */
+  for (i = 0; i < VMACHINE_PAGES; i++) {
+    bits = &machine->protected_bitmap.bits[i << 5];
+    set = 0;
+    full = 1;
+    for (j = 0; j < 32; j++) {
+      if (bits[j] != 0x00) set = 1;
+      if (bits[j] != 0xFF) full = 0;
+    }
+    machine->pages[i].flags &= VMACHINE_PAGE_SHARED | VMACHINE_PAGE_TRACKED | VMACHINE_PAGE_LOGGED;
+    if (full) {
+      machine->pages[i].flags |= VMACHINE_PAGE_READONLY;
+    } else if (set) {
+      machine->pages[i].flags |= VMACHINE_PAGE_PARTIAL;
+    }
+  }
+}
+
+/* Map every page to backing memory, except the I/O page. */
+static void _init_pages(vmachine_t *machine) {
+  int i;
+
+  for (i = 0; i < VMACHINE_PAGES; i++) {
+    machine->pages[i].mem = &machine->mem[i << 8];
+    machine->pages[i].flags = 0;
+    machine->pages[i].read = NULL;
+    machine->pages[i].write = NULL;
+  }
+  machine->pages[VMACHINE_IO_PAGE].mem = NULL;
+  machine->pages[VMACHINE_IO_PAGE].read = _io_read;
+  machine->pages[VMACHINE_IO_PAGE].write = _io_write;
+}
+
+/* CPU callbacks. The userdata pointer is the machine itself. */
+static void _machine_tick(void *userdata) {
+  machine_tick((vmachine_t *)userdata);
+}
+
+static byte _machine_read(void *userdata, address a) {
+  return machine_read((vmachine_t *)userdata, a);
+}
+
+static void _machine_write(void *userdata, address a, byte b) {
+  machine_write((vmachine_t *)userdata, a, b);
+}
+
 /* Add a protected memory range where writes are ignored. */
 void add_protected_range(vmachine_t *machine, address_range ar) {
   add_address_range(&machine->protected_ranges, ar);
+  _update_protection(machine);
 }
 
 /* Remove a protected memory range, allowing writes. */
 void remove_protected_range(vmachine_t *machine, address_range ar) {
   remove_address_range(&machine->protected_ranges, ar);
+  _update_protection(machine);
 }
 
 /* Check if an address is within any protected memory range. */
@@ -113,8 +699,13 @@ bool is_address_protected(address_range_list *list, address a) {
 void init_vmachine(vmachine_t *machine, vmachine_config_t *config) {
   address_range ar;
 
-  /* Initialize protected address ranges */
+  /* Initialize protected address ranges and the page table */
   init_address_range_list(&machine->protected_ranges);
+  machine->shared = NULL;
+  machine->shared_pages = 0;
+  memset(machine->dirty, 0xFF, sizeof(machine->dirty));
+  _init_pages(machine);
+  _update_protection(machine);
 
   /* Create device instances */
   machine->acia1 = acia_create(config->acia1_input, config->acia1_output);
@@ -124,6 +715,27 @@ void init_vmachine(vmachine_t *machine, vmachine_config_t *config) {
   machine->trace_fn = NULL;
 
   cpu_init(&machine->c);
+  machine->c.userdata = machine;
+  machine->c.read_ctx = _machine_read;
+  machine->c.write_ctx = _machine_write;
+  machine->c.tick_ctx = _machine_tick;
+  machine->next_event = VMACHINE_NO_EVENT;
+  machine->host_idle = TRUE;
+  machine->halt_at_eof = FALSE;
+  machine->clock_khz = 0;
+  machine->idle_polls = 0;
+  machine->idle_last_poll = 0;
+  machine->tx_latency = VMACHINE_TX_LATENCY;
+  machine->tx_deadline = VMACHINE_NO_EVENT;
+  machine->rx_poll = VMACHINE_NO_EVENT;
+  machine->input_log = NULL;
+  machine->history = NULL;
+  machine->trace = NULL;
+  machine->calls = NULL;
+  if (config->acia1_input != NULL || config->acia2_input != NULL) {
+    machine->rx_poll = VMACHINE_ACIA_POLL_CYCLES;
+  }
+  _schedule(machine);
 
   /* Load ROM into memory (up to 16KB) */
   memset(machine->mem, 0, sizeof(machine->mem));
@@ -132,7 +744,9 @@ void init_vmachine(vmachine_t *machine, vmachine_config_t *config) {
   } else if (config->rom_size > VMACHINE_ROM_SIZE) {
     config->rom_size = VMACHINE_ROM_SIZE;
   }
-  memcpy(&machine->mem[VMACHINE_ROM_START], config->rom_data, config->rom_size);
+  if (config->rom_size > 0) {
+    memcpy(&machine->mem[VMACHINE_ROM_START], config->rom_data, config->rom_size);
+  }
   
   /* Protect ROM area from writes */
   ar.start = VMACHINE_ROM_START;
@@ -149,4 +763,79 @@ void cleanup_vmachine(vmachine_t *machine) {
   fileio_destroy(machine->fio);
 
   clear_address_range_list(&machine->protected_ranges);
+  _release_shared(machine);
+  vhistory_destroy(machine->history);
+  machine->history = NULL;
+  machine_set_trace(machine, NULL);
+  machine_set_profile(machine, NULL);
+  machine_set_calls(machine, NULL);
+}
+
+vmachine_t *vmachine_clone(vmachine_t *machine) {
+  vmachine_t *clone;
+  address_range_node *node;
+  int i;
+
+  if (!_share_memory(machine)) return NULL;
+  clone = (vmachine_t *)malloc(sizeof(vmachine_t));
+  if (clone == NULL) return NULL;
+
+  /* Only the I/O page is copied, the rest of mem stays untouched */
+  memcpy(&clone->mem[VMACHINE_IO_PAGE << 8], &machine->mem[VMACHINE_IO_PAGE << 8], 0x100);
+  memcpy(clone->pages, machine->pages, sizeof(clone->pages));
+  clone->shared = machine->shared;
+  clone->shared_pages = machine->shared_pages;
+  clone->shared->refs++;
+  memcpy(clone->dirty, machine->dirty, sizeof(clone->dirty));
+
+  init_address_range_list(&clone->protected_ranges);
+  for (node = machine->protected_ranges.first; node != NULL; node = node->next) {
+    add_address_range(&clone->protected_ranges, node->range);
+  }
+  clone->protected_bitmap = machine->protected_bitmap;
+
+  clone->c = machine->c;
+  clone->c.userdata = clone;
+  clone->prevc = machine->prevc;
+  clone->prevc.userdata = clone;
+  clone->next_event = machine->next_event;
+  clone->host_idle = machine->host_idle;
+  clone->halt_at_eof = machine->halt_at_eof;
+  clone->clock_khz = machine->clock_khz;
+  clone->idle_polls = machine->idle_polls;
+  clone->idle_last_poll = machine->idle_last_poll;
+  clone->tx_latency = machine->tx_latency;
+  clone->tx_deadline = machine->tx_deadline;
+  clone->rx_poll = machine->rx_poll;
+  clone->input_log = NULL;
+  clone->history = NULL;
+  clone->trace = NULL;
+  clone->c.profile = NULL;
+  clone->c.call_ctx = NULL;
+  clone->calls = NULL;
+  for (i = 0; i < VMACHINE_PAGES; i++) {
+    clone->pages[i].flags &= ~VMACHINE_PAGE_LOGGED;
+  }
+  clone->trace_fn = machine->trace_fn;
+
+  clone->acia1 = acia_clone(machine->acia1);
+  clone->acia2 = acia_clone(machine->acia2);
+  clone->via = via_clone(machine->via);
+  clone->fio = fileio_clone(machine->fio);
+  if ((machine->acia1 != NULL && clone->acia1 == NULL) ||
+      (machine->acia2 != NULL && clone->acia2 == NULL) ||
+      (machine->via != NULL && clone->via == NULL) ||
+      (machine->fio != NULL && clone->fio == NULL)) {
+    vmachine_destroy(clone);
+    return NULL;
+  }
+
+  return clone;
+}
+
+void vmachine_destroy(vmachine_t *machine) {
+  if (machine != NULL) {
+    cleanup_vmachine(machine);
+    free(machine);
+  }
 }
@@ -37,20 +37,102 @@
 #include <v6502.h>
 #include <addrlist.h>
 #include <devices.h>
+#include <vreplay.h>
+#include <vtrace.h>
+#include <vcalls.h>
 
 #define VMACHINE_RAM_START 0x0000
 #define VMACHINE_RAM_SIZE  0xC000
 #define VMACHINE_ROM_START 0xD000
 #define VMACHINE_ROM_SIZE  0x3000
+#define VMACHINE_IO_PAGE   0xC0
+
+#define VMACHINE_PAGES     0x100
+
+/* Cycles between reads of host input into the ACIA receive FIFOs */
+#define VMACHINE_ACIA_POLL_CYCLES 1000
+
+/*
+ * Host idle detection. The guest is considered idle once it has read
+ * an ACIA status register that shows no received data this many times
+ * in a row, each read within VMACHINE_IDLE_WINDOW cycles of the last.
+ * The host then sleeps until input arrives, the next device event is
+ * due, or VMACHINE_IDLE_MAX_MS milliseconds pass. Milliseconds are
+ * converted to cycles at clock_khz, or the nominal 1MHz if it is 0. With
+ * halt_at_eof set, a guest going idle after ACIA1 input has run out is
+ * halted instead, which ends batch runs.
+ */
+#define VMACHINE_IDLE_POLLS   64
+#define VMACHINE_IDLE_WINDOW  64
+#define VMACHINE_IDLE_MAX_MS  100
+
+/* Default bound on how long transmitted ACIA output is buffered, in cycles */
+#define VMACHINE_TX_LATENCY   10000
+
+/* next_event when nothing is scheduled */
+#define VMACHINE_NO_EVENT VIA_NO_EVENT
+
+/* Page flags */
+#define VMACHINE_PAGE_READONLY 0x01  /* Every write to the page is ignored */
+#define VMACHINE_PAGE_PARTIAL  0x02  /* Some addresses in the page are protected */
+#define VMACHINE_PAGE_SHARED   0x04  /* Shared with clones, copied on the first write */
+#define VMACHINE_PAGE_TRACKED  0x08  /* Clean since the last checkpoint, marked dirty on the first write */
+#define VMACHINE_PAGE_LOGGED   0x10  /* Writes are logged to the execution history */
 
 /* Forward declaration for trace callback */
 struct vmachine;
 
+typedef byte (*PageReadFn)(struct vmachine *machine, address a);
+typedef void (*PageWriteFn)(struct vmachine *machine, address a, byte b);
+
+/*
+ * One entry per 256 byte page. Pages backed by memory are read and
+ * written directly through mem. Pages without backing memory are
+ * handled by the read and write functions.
+ */
+typedef struct vmachine_page {
+  byte *mem;
+  byte flags;
+  PageReadFn read;
+  PageWriteFn write;
+} vmachine_page_t;
+
+/*
+ * Memory shared copy-on-write between a machine and its clones. Pages
+ * flagged VMACHINE_PAGE_SHARED point into mem, which is never written.
+ */
+typedef struct vmachine_shared {
+  unsigned int refs;      /* Machines with pages in this block */
+  byte mem[0x10000];
+} vmachine_shared_t;
+
+struct vhistory;
+
 typedef struct vmachine {
   byte mem[0x10000];
+  vmachine_page_t pages[VMACHINE_PAGES];
+  vmachine_shared_t *shared;  /* Block the shared pages point into, or NULL */
+  unsigned int shared_pages;  /* Number of pages still shared */
+  byte dirty[VMACHINE_PAGES / 8]; /* Pages written since the last checkpoint */
   address_range_list protected_ranges;
+  address_bitmap protected_bitmap;  /* Compiled from protected_ranges */
   cpu c;
   cpu prevc;
+  count_t next_event;   /* CPU cycle count of the next device event */
+
+  /* Host idle detection */
+  bool host_idle;         /* Sleep the host while the guest waits for input */
+  bool halt_at_eof;       /* Halt instead once ACIA1 input has run out */
+  unsigned long clock_khz; /* Emulated clock speed, 0 for the nominal 1MHz */
+  unsigned int idle_polls; /* Consecutive empty ACIA status reads */
+  count_t idle_last_poll; /* Cycle count of the last empty status read */
+
+  /* Buffered ACIA output is flushed at the latest tx_latency cycles after it is written */
+  count_t tx_latency;
+  count_t tx_deadline;    /* Cycle count the buffered output must be flushed by */
+  count_t rx_poll;        /* Cycle count of the next read of host input */
+  vreplay_t *input_log;   /* Host input being recorded or replayed, or NULL */
+  struct vhistory *history; /* Execution history for stepping backwards, or NULL */
 
   /* Emulated devices */
   acia_t *acia1;   /* Primary serial: stdin/stdout */
@@ -58,6 +140,9 @@ typedef struct vmachine {
   via_t *via;      /* VIA with timers */
   fileio_t *fio;   /* File I/O device */
 
+  vtrace_t *trace;  /* Binary trace being written, or NULL */
+  vcalls_t *calls;  /* Call graph profile, or NULL */
+
   /* Optional trace callback - called each tick when V6502C_TRACE is set */
   void (*trace_fn)(struct vmachine *machine, cpu *prevc, cpu *c);
 } vmachine_t;
@@ -71,12 +156,110 @@ typedef struct vmachine_config {
   FILE *acia2_output;
 } vmachine_config_t;
 
-/* Machine lifecycle functions */
+/*
+ * Machine lifecycle functions.
+ * init_vmachine() points the CPU's context callbacks at the machine,
+ * so a machine must not be moved in memory once initialized.
+ */
 void init_vmachine(vmachine_t *machine, vmachine_config_t *config);
 void cleanup_vmachine(vmachine_t *machine);
 
-/* Machine I/O functions (for CPU callbacks) */
+/*
+ * Clone a machine. The clone shares memory with the original page by
+ * page, and a page is copied only when either machine first writes to
+ * it. The CPU, the devices and the protected ranges are copied. The
+ * ACIAs of the clone still use the original's host files, point
+ * acia1 and acia2 elsewhere as needed.
+ * Returns NULL if memory runs out. Free with vmachine_destroy().
+ */
+vmachine_t *vmachine_clone(vmachine_t *machine);
+void vmachine_destroy(vmachine_t *machine);
+
+/* Stop sharing memory: copy every shared page into the machine's own mem. */
+void machine_unshare(vmachine_t *machine);
+
+/*
+ * Record the machine's host input to a log, or replay it from one
+ * opened with vreplay_open(). A replayed machine reads no host input
+ * and touches no host files, and runs exactly as the recorded one did
+ * provided it starts from the same state. Pass NULL to stop. The
+ * machine does not close the log.
+ */
+void machine_set_input_log(vmachine_t *machine, vreplay_t *log);
+
+/*
+ * Keep an execution history, see vhistory.h. The machine owns the
+ * history and frees it when another is set or in cleanup_vmachine().
+ * Pass NULL to stop.
+ */
+void machine_set_history(vmachine_t *machine, struct vhistory *history);
+
+/*
+ * Write a binary trace of every instruction run through machine_tick().
+ * The machine owns the trace and closes it when another is set or in
+ * cleanup_vmachine(). Pass NULL to stop. Returns -1 if writing the
+ * previous trace failed.
+ */
+int machine_set_trace(vmachine_t *machine, vtrace_t *trace);
+
+/*
+ * Profile execution by address. profile must be a zeroed array of
+ * CPU_PROFILE_ENTRIES allocated with malloc(); the machine frees it when
+ * another is set or in cleanup_vmachine(). Pass NULL to stop.
+ */
+void machine_set_profile(vmachine_t *machine, cpu_profile_t *profile);
+
+/*
+ * Profile the call graph, see vcalls.h. The machine owns the profile and
+ * frees it when another is set or in cleanup_vmachine(). Pass NULL to
+ * stop.
+ */
+void machine_set_calls(vmachine_t *machine, vcalls_t *calls);
+
+/*
+ * Store a byte in memory bypassing protection, devices and the
+ * history, to put back memory saved earlier.
+ */
+void machine_restore_byte(vmachine_t *machine, address a, byte b);
+
+/*
+ * Move the clock to the given cycle count, backwards or forwards. The
+ * devices are not rewound, they carry on from their current state with
+ * their pending events moved along with the clock.
+ */
+void machine_set_cycles(vmachine_t *machine, count_t cycles);
+
+/*
+ * Dirty page tracking for incremental checkpoints. Every page starts
+ * out dirty. machine_checkpoint() marks all pages clean, after which
+ * the first write to a page marks it dirty again. Only that first
+ * write takes the slow path.
+ */
+void machine_checkpoint(vmachine_t *machine);
+bool machine_page_dirty(vmachine_t *machine, int page);
+
+/*
+ * Machine I/O functions (for CPU callbacks).
+ * Devices drive the CPU's level-triggered IRQ line. The line is
+ * updated after every device access and whenever a scheduled event,
+ * such as a timer expiry, is run by machine_tick() or
+ * machine_run_events().
+ */
 void machine_tick(vmachine_t *machine);
+void machine_run_events(vmachine_t *machine);
+
+/*
+ * Run the machine for a bounded slice of about budget cycles, for hosts
+ * that multiplex many machines. The CPU runs in cpu_run_cycles() slices
+ * that end at each device event, which is then run as machine_tick()
+ * would. A CPU waiting in WAI skips ahead to the next event. The
+ * per-instruction work of machine_tick(), the history, trace callback
+ * and binary trace, is not done. Returns CPU_EXIT_BUDGET, or why the
+ * CPU stopped early: halted, STP, a breakpoint, or CPU_EXIT_WAITING if
+ * no event is scheduled that could wake it.
+ */
+enum cpu_exit_t machine_run_cycles(vmachine_t *machine, count_t budget);
+void machine_flush(vmachine_t *machine);
 byte machine_read(vmachine_t *machine, address a);
 void machine_write(vmachine_t *machine, address a, byte b);
 
@@ -0,0 +1,151 @@
+/**
+ *
+ * Recording and replaying the input of a vMachine.
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vreplay.h"
+
+#define VREPLAY_HEADER_SIZE 8
+#define VREPLAY_EVENT_SIZE  12
+
+vreplay_t *vreplay_record(const char *filename) {
+  vreplay_t *log;
+  byte header[VREPLAY_HEADER_SIZE];
+
+  log = (vreplay_t *)malloc(sizeof(vreplay_t));
+  if (log == NULL) return NULL;
+  log->file = fopen(filename, "wb");
+  if (log->file == NULL) {
+    free(log);
+    return NULL;
+  }
+  log->replaying = FALSE;
+  log->done = TRUE;
+  log->error = FALSE;
+  log->events = 0;
+
+  memcpy(header, VREPLAY_MAGIC, 4);
+  header[4] = VREPLAY_VERSION & 0xFF;
+  header[5] = (VREPLAY_VERSION >> 8) & 0xFF;
+  header[6] = 0;
+  header[7] = 0;
+  if (fwrite(header, 1, sizeof(header), log->file) != sizeof(header)) {
+    log->error = TRUE;
+  }
+  return log;
+}
+
+vreplay_t *vreplay_open(const char *filename) {
+  vreplay_t *log;
+  byte header[VREPLAY_HEADER_SIZE];
+
+  log = (vreplay_t *)malloc(sizeof(vreplay_t));
+  if (log == NULL) return NULL;
+  log->file = fopen(filename, "rb");
+  if (log->file == NULL) {
+    free(log);
+    return NULL;
+  }
+  if (fread(header, 1, sizeof(header), log->file) != sizeof(header) ||
+      memcmp(header, VREPLAY_MAGIC, 4) != 0 ||
+      (header[4] | (header[5] << 8)) != VREPLAY_VERSION) {
+    fclose(log->file);
+    free(log);
+    return NULL;
+  }
+  log->replaying = TRUE;
+  log->done = FALSE;
+  log->error = FALSE;
+  log->events = 0;
+  vreplay_next(log);
+  log->events = 0;
+  return log;
+}
+
+int vreplay_close(vreplay_t *log) {
+  int result;
+
+  if (log == NULL) return 0;
+  if (fclose(log->file) != 0) log->error = TRUE;
+  result = log->error ? -1 : 0;
+  free(log);
+  return result;
+}
+
+void vreplay_write(vreplay_t *log, count_t cycle, byte kind, byte device,
+                   const byte *data, unsigned int length) {
+  byte event[VREPLAY_EVENT_SIZE];
+  int i;
+
+  if (log == NULL || log->replaying) return;
+  if (length > VREPLAY_MAX_DATA) length = VREPLAY_MAX_DATA;
+
+  for (i = 0; i < 8; i++) {
+    event[i] = (byte)(cycle & 0xFF);
+    cycle >>= 8;
+  }
+  event[8] = kind;
+  event[9] = device;
+  event[10] = (byte)(length & 0xFF);
+  event[11] = (byte)((length >> 8) & 0xFF);
+  if (fwrite(event, 1, sizeof(event), log->file) != sizeof(event) ||
+      fwrite(data, 1, length, log->file) != length) {
+    log->error = TRUE;
+  }
+  log->events++;
+}
+
+bool vreplay_due(vreplay_t *log, count_t cycle, byte kind) {
+  return log != NULL && log->replaying && !log->done &&
+         log->kind == kind && log->cycle <= cycle;
+}
+
+void vreplay_next(vreplay_t *log) {
+  byte event[VREPLAY_EVENT_SIZE];
+  int i;
+
+  if (log == NULL || !log->replaying || log->done) return;
+
+  if (fread(event, 1, sizeof(event), log->file) != sizeof(event)) {
+    log->done = TRUE;
+    return;
+  }
+  log->cycle = 0;
+  for (i = 7; i >= 0; i--) {
+    log->cycle = (log->cycle << 8) | event[i];
+  }
+  log->kind = event[8];
+  log->device = event[9];
+  log->length = event[10] | (event[11] << 8);
+  if (fread(log->data, 1, log->length, log->file) != log->length) {
+    log->done = TRUE;
+    return;
+  }
+  log->events++;
+}
@@ -0,0 +1,94 @@
+#ifndef _VREPLAY_H_
+#define _VREPLAY_H_
+
+/**
+ *
+ * Recording and replaying the input of a vMachine.
+ *
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+
+#include "vtypes.h"
+
+/*
+ * An input log records everything that reaches the machine from the
+ * host, tagged with the CPU cycle count at which it arrived. Replaying
+ * the log against the same ROM and starting state runs the guest
+ * through exactly the same instructions, without any host I/O.
+ *
+ * The log starts with an 8 byte header: VREPLAY_MAGIC, a 16 bit format
+ * version and 16 reserved bits. Each event that follows is a 64 bit
+ * cycle count, a kind, a device byte, a 16 bit length and that many
+ * bytes of data. Numbers are little endian.
+ */
+#define VREPLAY_MAGIC   "V6RL"
+#define VREPLAY_VERSION 1
+
+/* Event kinds */
+#define VREPLAY_INPUT  1  /* Bytes received by ACIA number device */
+#define VREPLAY_IDLE   2  /* Host idle moved the clock on by a 32 bit cycle count */
+#define VREPLAY_FILEIO 3  /* File I/O register device read the data byte */
+
+#define VREPLAY_MAX_DATA 0xFFFF
+
+typedef struct vreplay {
+  FILE *file;
+  bool replaying;         /* Reading events rather than writing them */
+  bool done;              /* No events left to replay */
+  bool error;             /* A write failed */
+  unsigned long events;   /* Events written or read so far */
+
+  /* The next event to replay, valid unless done */
+  count_t cycle;
+  byte kind;
+  byte device;
+  unsigned int length;
+  byte data[VREPLAY_MAX_DATA];
+} vreplay_t;
+
+/*
+ * Create a log for recording, or open one for replay with its first
+ * event loaded. Returns NULL if the file cannot be opened or is not a
+ * valid log.
+ */
+vreplay_t *vreplay_record(const char *filename);
+vreplay_t *vreplay_open(const char *filename);
+
+/* Close a log. Returns 0, or -1 if any write or the close failed. */
+int vreplay_close(vreplay_t *log);
+
+/* Append an event to a log being recorded. */
+void vreplay_write(vreplay_t *log, count_t cycle, byte kind, byte device,
+                   const byte *data, unsigned int length);
+
+/* Check whether the next event to replay is of the given kind and due. */
+bool vreplay_due(vreplay_t *log, count_t cycle, byte kind);
+
+/* Move on to the next event to replay. Sets done at the end of the log. */
+void vreplay_next(vreplay_t *log);
+
+#endif
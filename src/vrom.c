@@ -0,0 +1,336 @@
+/**
+ *
+ * Loading ROMs into a vMachine.
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vrom.h"
+
+int load_woz_rom(const char *filename, byte *buffer, size_t max_size, size_t offset) {
+  /* Woz Format: */
+  /* D000: F5 D6 FA D5 09 DC 8B D8 */
+  FILE *f = fopen(filename, "r");
+  size_t max_offset = 0;
+  if (f == NULL) {
+    fprintf(stderr, "Error: Unable to open ROM file '%s'\n", filename);
+    return -1;
+  }
+
+  /* Initialize buffer to zeros */
+  memset(buffer, 0, max_size);
+
+  {
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+      char *p = line;
+      unsigned int addr;
+      size_t buf_offset;
+
+      /* Parse the address before the colon */
+      addr = 0;
+      while (*p && *p != ':') {
+        if (*p >= '0' && *p <= '9') {
+          addr = (addr << 4) | (*p - '0');
+        } else if (*p >= 'A' && *p <= 'F') {
+          addr = (addr << 4) | (*p - 'A' + 10);
+        } else if (*p >= 'a' && *p <= 'f') {
+          addr = (addr << 4) | (*p - 'a' + 10);
+        }
+        p++;
+      }
+
+      if (*p != ':') {
+        continue; /* Skip lines without a colon */
+      }
+      p++; /* Skip the colon */
+
+      /* Calculate buffer offset */
+      if (addr < offset) {
+        continue; /* Address is below our offset, skip */
+      }
+      buf_offset = addr - offset;
+      if (buf_offset >= max_size) {
+        continue; /* Address is outside our buffer range, skip */
+      }
+
+      /* Parse hex bytes */
+      while (*p) {
+        unsigned int byte_val;
+        int nibbles = 0;
+
+        /* Skip whitespace */
+        while (*p == ' ' || *p == '\t') {
+          p++;
+        }
+
+        if (*p == '\0' || *p == '\n' || *p == '\r') {
+          break;
+        }
+
+        /* Parse a hex byte (1 or 2 nibbles) */
+        byte_val = 0;
+        while (nibbles < 2) {
+          if (*p >= '0' && *p <= '9') {
+            byte_val = (byte_val << 4) | (*p - '0');
+            nibbles++;
+            p++;
+          } else if (*p >= 'A' && *p <= 'F') {
+            byte_val = (byte_val << 4) | (*p - 'A' + 10);
+            nibbles++;
+            p++;
+          } else if (*p >= 'a' && *p <= 'f') {
+            byte_val = (byte_val << 4) | (*p - 'a' + 10);
+            nibbles++;
+            p++;
+          } else {
+            break;
+          }
+        }
+
+        if (nibbles > 0 && buf_offset < max_size) {
+          buffer[buf_offset] = (byte)byte_val;
+          buf_offset++;
+          if (buf_offset > max_offset) {
+            max_offset = buf_offset;
+          }
+        }
+      }
+    }
+  }
+  fclose(f);
+  return (int)max_offset;
+}
+
+static unsigned long _get32(const byte *p) {
+  return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+         ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static void _put32(byte *p, unsigned long v) {
+  p[0] = (byte)(v & 0xFF);
+  p[1] = (byte)((v >> 8) & 0xFF);
+  p[2] = (byte)((v >> 16) & 0xFF);
+  p[3] = (byte)((v >> 24) & 0xFF);
+}
+
+/* 32 bit FNV-1a hash, used to check ROM images. */
+static unsigned long _fnv1a(const byte *data, size_t size) {
+  unsigned long hash = 2166136261UL;
+  size_t i;
+  for (i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+  }
+  return hash;
+}
+
+/* Map a whole file read-only. Returns NULL if it is empty or cannot be mapped. */
+static void *_map_file(const char *filename, size_t *size) {
+  struct stat st;
+  void *map;
+  int fd;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+  *size = (size_t)st.st_size;
+  return map;
+}
+
+/*
+ * Check that a mapped ROM image is intact and loads at load_address.
+ * If src is not NULL the image must also have been built from a file
+ * of that size and modification time.
+ */
+static bool _check_image(const byte *map, size_t map_size,
+                         address load_address, const struct stat *src) {
+  unsigned long size;
+
+  if (map_size < ROM_IMAGE_HEADER_SIZE ||
+      memcmp(map, ROM_IMAGE_MAGIC, 4) != 0 ||
+      map[4] != ROM_IMAGE_VERSION ||
+      _get32(map + 8) != load_address) {
+    return FALSE;
+  }
+  size = _get32(map + 12);
+  if (size != map_size - ROM_IMAGE_HEADER_SIZE) return FALSE;
+  if (src != NULL &&
+      (_get32(map + 20) != ((unsigned long)src->st_size & 0xFFFFFFFFUL) ||
+       _get32(map + 24) != ((unsigned long)src->st_mtime & 0xFFFFFFFFUL))) {
+    return FALSE;
+  }
+  return _get32(map + 16) == _fnv1a(map + ROM_IMAGE_HEADER_SIZE, size);
+}
+
+/*
+ * Write a ROM image built from the file described by src. The image is
+ * written under a temporary name and renamed into place, so machines
+ * starting at the same time never see a partial image. Failures are
+ * ignored, the cache is only an optimization.
+ */
+static void _write_image(const char *filename, const byte *data, size_t size,
+                         address load_address, const struct stat *src) {
+  byte header[ROM_IMAGE_HEADER_SIZE];
+  char *tmp;
+  FILE *f;
+  bool ok;
+
+  memset(header, 0, sizeof(header));
+  memcpy(header, ROM_IMAGE_MAGIC, 4);
+  header[4] = ROM_IMAGE_VERSION;
+  _put32(header + 8, load_address);
+  _put32(header + 12, (unsigned long)size);
+  _put32(header + 16, _fnv1a(data, size));
+  _put32(header + 20, (unsigned long)src->st_size & 0xFFFFFFFFUL);
+  _put32(header + 24, (unsigned long)src->st_mtime & 0xFFFFFFFFUL);
+
+  tmp = (char *)malloc(strlen(filename) + 32);
+  if (tmp == NULL) return;
+  sprintf(tmp, "%s.%ld", filename, (long)getpid());
+
+  f = fopen(tmp, "wb");
+  if (f == NULL) {
+    free(tmp);
+    return;
+  }
+  ok = fwrite(header, 1, sizeof(header), f) == sizeof(header) &&
+       fwrite(data, 1, size, f) == size;
+  if (fclose(f) != 0) ok = FALSE;
+  if (!ok || rename(tmp, filename) != 0) {
+    remove(tmp);
+  }
+  free(tmp);
+}
+
+/* Open a Wozmon file through its image cache, rebuilding the cache if needed. */
+static int _open_woz(rom_image_t *rom, const char *filename,
+                     address load_address, size_t max_size) {
+  struct stat src;
+  char *cache;
+  int size;
+
+  if (stat(filename, &src) < 0) {
+    fprintf(stderr, "Error: Unable to open ROM file '%s'\n", filename);
+    return -1;
+  }
+  cache = (char *)malloc(strlen(filename) + sizeof(ROM_IMAGE_SUFFIX));
+  if (cache == NULL) return -1;
+  strcpy(cache, filename);
+  strcat(cache, ROM_IMAGE_SUFFIX);
+
+  rom->map = _map_file(cache, &rom->map_size);
+  if (rom->map != NULL) {
+    if (_check_image((byte *)rom->map, rom->map_size, load_address, &src)) {
+      rom->data = (byte *)rom->map + ROM_IMAGE_HEADER_SIZE;
+      rom->size = rom->map_size - ROM_IMAGE_HEADER_SIZE;
+      if (rom->size > max_size) rom->size = max_size;
+      free(cache);
+      return 0;
+    }
+    munmap(rom->map, rom->map_size);
+    rom->map = NULL;
+  }
+
+  rom->buffer = (byte *)malloc(max_size);
+  if (rom->buffer == NULL) {
+    free(cache);
+    return -1;
+  }
+  size = load_woz_rom(filename, rom->buffer, max_size, load_address);
+  if (size < 0) {
+    free(cache);
+    return -1;
+  }
+  rom->data = rom->buffer;
+  rom->size = (size_t)size;
+  _write_image(cache, rom->data, rom->size, load_address, &src);
+  free(cache);
+  return 0;
+}
+
+int rom_image_open(rom_image_t *rom, const char *filename,
+                   address load_address, size_t max_size) {
+  const char *ext = strrchr(filename, '.');
+
+  rom->map = NULL;
+  rom->map_size = 0;
+  rom->buffer = NULL;
+  rom->data = NULL;
+  rom->size = 0;
+
+  if (ext != NULL && strcmp(ext, ".woz") == 0) {
+    if (_open_woz(rom, filename, load_address, max_size) < 0) {
+      rom_image_close(rom);
+      return -1;
+    }
+    return 0;
+  }
+
+  rom->map = _map_file(filename, &rom->map_size);
+  if (rom->map == NULL) {
+    fprintf(stderr, "Error: Unable to open ROM file '%s'\n", filename);
+    return -1;
+  }
+  if (rom->map_size >= 4 && memcmp(rom->map, ROM_IMAGE_MAGIC, 4) == 0) {
+    if (!_check_image((byte *)rom->map, rom->map_size, load_address, NULL)) {
+      fprintf(stderr, "Error: Invalid ROM image '%s'\n", filename);
+      rom_image_close(rom);
+      return -1;
+    }
+    rom->data = (byte *)rom->map + ROM_IMAGE_HEADER_SIZE;
+    rom->size = rom->map_size - ROM_IMAGE_HEADER_SIZE;
+  } else {
+    /* Raw binary ROM */
+    rom->data = (byte *)rom->map;
+    rom->size = rom->map_size;
+  }
+  if (rom->size > max_size) rom->size = max_size;
+  return 0;
+}
+
+void rom_image_close(rom_image_t *rom) {
+  if (rom->map != NULL) {
+    munmap(rom->map, rom->map_size);
+  }
+  free(rom->buffer);
+  rom->map = NULL;
+  rom->buffer = NULL;
+  rom->data = NULL;
+  rom->size = 0;
+}
@@ -0,0 +1,84 @@
+#ifndef _VROM_H_
+#define _VROM_H_
+
+/**
+ *
+ * Loading ROMs into a vMachine.
+ *
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stddef.h>
+
+#include "vtypes.h"
+
+/*
+ * A ROM image is a ROM_IMAGE_HEADER_SIZE byte header followed by the
+ * ROM contents, so it can be used straight from an mmap()ed file. The
+ * header fields are little endian:
+ *   0:  ROM_IMAGE_MAGIC
+ *   4:  ROM_IMAGE_VERSION
+ *   8:  Load address
+ *   12: Length of the contents in bytes
+ *   16: FNV-1a hash of the contents
+ *   20: Size of the file the image was built from, or 0
+ *   24: Modification time of that file, or 0
+ * A Wozmon file is parsed once and cached next to itself as an image
+ * named after it with ROM_IMAGE_SUFFIX appended. The cache is rebuilt
+ * when the size or modification time of the Wozmon file changes.
+ */
+#define ROM_IMAGE_MAGIC       "V6RI"
+#define ROM_IMAGE_VERSION     1
+#define ROM_IMAGE_HEADER_SIZE 32
+#define ROM_IMAGE_SUFFIX      ".img"
+
+typedef struct rom_image {
+  void *map;        /* Mapped file, or NULL */
+  size_t map_size;  /* Size of the mapping */
+  byte *buffer;     /* Parsed contents when nothing could be mapped */
+  byte *data;       /* ROM contents, to be copied into the machine */
+  size_t size;      /* Length of the contents */
+} rom_image_t;
+
+/**
+ * Open a ROM image, a Wozmon file or a raw binary ROM to be loaded at
+ * load_address. At most max_size bytes are used.
+ * Returns 0 on success, -1 on error. Call rom_image_close() once the
+ * contents have been copied.
+ */
+int rom_image_open(rom_image_t *rom, const char *filename,
+                   address load_address, size_t max_size);
+
+/** Release a ROM opened with rom_image_open(). */
+void rom_image_close(rom_image_t *rom);
+
+/**
+ * Parse a Wozmon file into buffer, which holds max_size bytes starting
+ * at address offset. Returns the length of the contents, or -1 if the
+ * file cannot be opened.
+ */
+int load_woz_rom(const char *filename, byte *buffer, size_t max_size, size_t offset);
+
+#endif
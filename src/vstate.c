@@ -0,0 +1,654 @@
+/**
+ *
+ * Saving and restoring the complete state of a vMachine.
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "vstate.h"
+#include "vhistory.h"
+
+/* Section payload sizes, ACIA and PROT sections also carry a list */
+#define VSTATE_HEADER_SIZE 8
+#define VSTATE_CPU_SIZE    17
+#define VSTATE_MACH_SIZE   9
+#define VSTATE_VIA_SIZE    26
+#define VSTATE_ACIA_SIZE   40
+#define VSTATE_FIO_SIZE    (FILEIO_NAME_MAXLEN + 9)
+#define VSTATE_PAGE_SIZE   257
+
+/* CPU flag bits */
+#define VSTATE_CPU_HALTED   0x01
+#define VSTATE_CPU_RESET    0x02
+#define VSTATE_CPU_IRQ      0x04
+#define VSTATE_CPU_IRQ_LINE 0x08
+#define VSTATE_CPU_NMI      0x10
+#define VSTATE_CPU_STOPPED  0x20
+#define VSTATE_CPU_WAITING  0x40
+
+/* A growing output buffer. error is set if memory runs out. */
+typedef struct vstate_buf {
+  byte *data;
+  size_t len;
+  size_t cap;
+  bool error;
+} vstate_buf_t;
+
+/* A state file being read. Lengths are checked before anything is read. */
+typedef struct vstate_reader {
+  const byte *data;
+  size_t pos;
+} vstate_reader_t;
+
+/*
+ * Writing
+ */
+
+static void _put(vstate_buf_t *buf, const void *p, size_t n) {
+  byte *data;
+  size_t cap;
+
+  if (buf->error) return;
+  if (buf->len + n > buf->cap) {
+    cap = buf->cap == 0 ? 4096 : buf->cap;
+    while (cap < buf->len + n) cap *= 2;
+    data = (byte *)realloc(buf->data, cap);
+    if (data == NULL) {
+      buf->error = TRUE;
+      return;
+    }
+    buf->data = data;
+    buf->cap = cap;
+  }
+  memcpy(buf->data + buf->len, p, n);
+  buf->len += n;
+}
+
+static void _put8(vstate_buf_t *buf, unsigned int v) {
+  byte b = (byte)(v & 0xFF);
+  _put(buf, &b, 1);
+}
+
+static void _put16(vstate_buf_t *buf, unsigned int v) {
+  _put8(buf, v);
+  _put8(buf, v >> 8);
+}
+
+static void _put32(vstate_buf_t *buf, unsigned long v) {
+  _put16(buf, (unsigned int)(v & 0xFFFF));
+  _put16(buf, (unsigned int)((v >> 16) & 0xFFFF));
+}
+
+static void _put64(vstate_buf_t *buf, count_t v) {
+  _put32(buf, (unsigned long)(v & 0xFFFFFFFFUL));
+  _put32(buf, (unsigned long)((v >> 16) >> 16));
+}
+
+/* Start a section. Returns the offset of its length field. */
+static size_t _begin(vstate_buf_t *buf, const char *tag) {
+  size_t at;
+
+  _put(buf, tag, 4);
+  at = buf->len;
+  _put32(buf, 0);
+  return at;
+}
+
+/* Fill in the length of the section started at the given offset. */
+static void _end(vstate_buf_t *buf, size_t at) {
+  size_t n;
+
+  if (buf->error) return;
+  n = buf->len - at - 4;
+  buf->data[at] = (byte)(n & 0xFF);
+  buf->data[at + 1] = (byte)((n >> 8) & 0xFF);
+  buf->data[at + 2] = (byte)((n >> 16) & 0xFF);
+  buf->data[at + 3] = (byte)((n >> 24) & 0xFF);
+}
+
+static void _save_cpu(vstate_buf_t *buf, cpu *c) {
+  size_t at = _begin(buf, "CPU ");
+  unsigned int flags = 0;
+
+  if (c->halted) flags |= VSTATE_CPU_HALTED;
+  if (c->reset) flags |= VSTATE_CPU_RESET;
+  if (c->irq) flags |= VSTATE_CPU_IRQ;
+  if (c->irq_line) flags |= VSTATE_CPU_IRQ_LINE;
+  if (c->nmi) flags |= VSTATE_CPU_NMI;
+  if (c->stopped) flags |= VSTATE_CPU_STOPPED;
+  if (c->waiting) flags |= VSTATE_CPU_WAITING;
+
+  _put16(buf, c->pc);
+  _put8(buf, c->a);
+  _put8(buf, c->x);
+  _put8(buf, c->y);
+  _put8(buf, c->sr);
+  _put8(buf, c->sp);
+  _put8(buf, flags);
+  _put8(buf, (unsigned int)c->variant);
+  _put64(buf, c->cycles);
+  _end(buf, at);
+}
+
+static void _save_machine(vstate_buf_t *buf, vmachine_t *machine) {
+  size_t at = _begin(buf, "MACH");
+
+  _put8(buf, machine->host_idle ? 1 : 0);
+  _put64(buf, machine->tx_latency);
+  _end(buf, at);
+}
+
+static void _save_protection(vstate_buf_t *buf, vmachine_t *machine) {
+  size_t at = _begin(buf, "PROT");
+  address_range_node *node;
+  unsigned int count = 0;
+
+  for (node = machine->protected_ranges.first; node != NULL; node = node->next) {
+    count++;
+  }
+  _put16(buf, count);
+  for (node = machine->protected_ranges.first; node != NULL; node = node->next) {
+    _put16(buf, node->range.start);
+    _put16(buf, node->range.end);
+  }
+  _end(buf, at);
+}
+
+/* Backing memory of a page. The I/O page keeps its unclaimed addresses in mem. */
+static byte *_page_mem(vmachine_t *machine, int i) {
+  if (machine->pages[i].mem != NULL) return machine->pages[i].mem;
+  return &machine->mem[i << 8];
+}
+
+static bool _page_is_zero(const byte *mem) {
+  int i;
+
+  for (i = 0; i < 0x100; i++) {
+    if (mem[i] != 0) return FALSE;
+  }
+  return TRUE;
+}
+
+/* Save the pages that are not all zero, or for a delta the dirty pages. */
+static void _save_memory(vmachine_t *machine, vstate_buf_t *buf, bool delta) {
+  size_t at = _begin(buf, "MEM ");
+  byte *mem;
+  int i;
+
+  for (i = 0; i < VMACHINE_PAGES; i++) {
+    mem = _page_mem(machine, i);
+    if (delta ? machine_page_dirty(machine, i) : !_page_is_zero(mem)) {
+      _put8(buf, (unsigned int)i);
+      _put(buf, mem, 0x100);
+    }
+  }
+  _end(buf, at);
+}
+
+static void _save_via(vstate_buf_t *buf, via_t *dev) {
+  size_t at = _begin(buf, "VIA ");
+
+  _put8(buf, dev->port_a);
+  _put8(buf, dev->port_b);
+  _put8(buf, dev->ddr_a);
+  _put8(buf, dev->ddr_b);
+  _put16(buf, dev->t1_counter);
+  _put16(buf, dev->t1_latch);
+  _put16(buf, dev->t2_counter);
+  _put8(buf, dev->t2_latch_low);
+  _put8(buf, dev->shift_reg);
+  _put8(buf, dev->acr);
+  _put8(buf, dev->pcr);
+  _put8(buf, dev->ifr);
+  _put8(buf, dev->ier);
+  _put8(buf, dev->t1_running ? 1 : 0);
+  _put8(buf, dev->t2_running ? 1 : 0);
+  _put64(buf, dev->clock);
+  _end(buf, at);
+}
+
+static void _save_acia(vstate_buf_t *buf, const char *tag, acia_t *dev) {
+  size_t at = _begin(buf, tag);
+  unsigned int i;
+
+  _put8(buf, dev->command);
+  _put8(buf, dev->control);
+  _put8(buf, dev->rx_data);
+  _put8(buf, dev->rx_full ? 1 : 0);
+  _put8(buf, dev->rx_overrun ? 1 : 0);
+  _put8(buf, dev->rx_fifo_enabled ? 1 : 0);
+  _put8(buf, dev->tx_flush_newline ? 1 : 0);
+  _put8(buf, dev->timing ? 1 : 0);
+  _put32(buf, dev->clock_hz);
+  _put64(buf, dev->clock);
+  _put8(buf, dev->tx_data);
+  _put8(buf, dev->tx_full ? 1 : 0);
+  _put64(buf, dev->tx_busy_until);
+  _put64(buf, dev->rx_next);
+  _put16(buf, dev->rx_count);
+  for (i = 0; i < dev->rx_count; i++) {
+    _put8(buf, dev->rx_fifo[(dev->rx_head + i) % ACIA_RX_FIFO_SIZE]);
+  }
+  _end(buf, at);
+}
+
+static void _save_fileio(vstate_buf_t *buf, fileio_t *dev) {
+  size_t at = _begin(buf, "FIO ");
+  long pos = 0;
+
+  if (dev->file != NULL) {
+    fflush(dev->file);
+    pos = ftell(dev->file);
+    if (pos < 0) pos = 0;
+  }
+  _put8(buf, dev->status);
+  _put8(buf, dev->data);
+  _put8(buf, dev->name_index);
+  _put(buf, dev->filename, FILEIO_NAME_MAXLEN);
+  _put8(buf, dev->file != NULL ? 1 : 0);
+  _put8(buf, dev->writing ? 1 : 0);
+  _put32(buf, (unsigned long)pos);
+  _end(buf, at);
+}
+
+static long _save_state(vmachine_t *machine, const char *filename, bool delta) {
+  vstate_buf_t buf;
+  FILE *f;
+  long written = -1;
+
+  /* Output already produced belongs to the host, not the state */
+  machine_flush(machine);
+
+  buf.data = NULL;
+  buf.len = 0;
+  buf.cap = 0;
+  buf.error = FALSE;
+
+  _put(&buf, VSTATE_MAGIC, 4);
+  _put16(&buf, VSTATE_VERSION);
+  _put16(&buf, delta ? VSTATE_FLAG_DELTA : 0);
+  _save_cpu(&buf, &machine->c);
+  _save_machine(&buf, machine);
+  _save_protection(&buf, machine);
+  _save_memory(machine, &buf, delta);
+  if (machine->via != NULL) _save_via(&buf, machine->via);
+  if (machine->acia1 != NULL) _save_acia(&buf, "ACI1", machine->acia1);
+  if (machine->acia2 != NULL) _save_acia(&buf, "ACI2", machine->acia2);
+  if (machine->fio != NULL) _save_fileio(&buf, machine->fio);
+
+  if (!buf.error) {
+    f = fopen(filename, "wb");
+    if (f != NULL) {
+      if (fwrite(buf.data, 1, buf.len, f) == buf.len) {
+        written = (long)buf.len;
+      }
+      if (fclose(f) != 0) written = -1;
+    }
+  }
+  free(buf.data);
+
+  /* The next delta is relative to this checkpoint */
+  if (written >= 0) {
+    machine_checkpoint(machine);
+  }
+  return written;
+}
+
+long vmachine_save_state(vmachine_t *machine, const char *filename) {
+  return _save_state(machine, filename, FALSE);
+}
+
+long vmachine_save_delta(vmachine_t *machine, const char *filename) {
+  return _save_state(machine, filename, TRUE);
+}
+
+/*
+ * Reading
+ */
+
+static unsigned int _get8(vstate_reader_t *r) {
+  return r->data[r->pos++];
+}
+
+static unsigned int _get16(vstate_reader_t *r) {
+  unsigned int v = _get8(r);
+  return v | (_get8(r) << 8);
+}
+
+static unsigned long _get32(vstate_reader_t *r) {
+  unsigned long v = _get16(r);
+  return v | ((unsigned long)_get16(r) << 16);
+}
+
+static count_t _get64(vstate_reader_t *r) {
+  count_t v = _get32(r);
+  return v | (((count_t)_get32(r) << 16) << 16);
+}
+
+static unsigned long _peek32(const byte *p) {
+  return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+         ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/* Check that a known section has the right length for its contents. */
+static bool _check_section(const byte *tag, const byte *p, unsigned long len) {
+  if (!memcmp(tag, "CPU ", 4)) return len == VSTATE_CPU_SIZE;
+  if (!memcmp(tag, "MACH", 4)) {
+    /* A zero output latency would retry a blocked flush every cycle */
+    return len == VSTATE_MACH_SIZE && (_peek32(p + 1) != 0 || _peek32(p + 5) != 0);
+  }
+  if (!memcmp(tag, "VIA ", 4)) return len == VSTATE_VIA_SIZE;
+  if (!memcmp(tag, "FIO ", 4)) return len == VSTATE_FIO_SIZE;
+  if (!memcmp(tag, "MEM ", 4)) return len % VSTATE_PAGE_SIZE == 0;
+  if (!memcmp(tag, "PROT", 4)) {
+    return len >= 2 && len == 2 + 4 * ((unsigned long)p[0] | ((unsigned long)p[1] << 8));
+  }
+  if (!memcmp(tag, "ACI1", 4) || !memcmp(tag, "ACI2", 4)) {
+    unsigned long count;
+    if (len < VSTATE_ACIA_SIZE) return FALSE;
+    count = (unsigned long)p[VSTATE_ACIA_SIZE - 2] |
+            ((unsigned long)p[VSTATE_ACIA_SIZE - 1] << 8);
+    return count <= ACIA_RX_FIFO_SIZE && len == VSTATE_ACIA_SIZE + count;
+  }
+  return TRUE;
+}
+
+static bool _is_delta(const byte *data) {
+  return (data[6] & VSTATE_FLAG_DELTA) != 0;
+}
+
+/* Check the header and that every section fits and has a valid length. */
+static bool _check_state(const byte *data, size_t len) {
+  size_t pos = VSTATE_HEADER_SIZE;
+  unsigned long n;
+
+  if (len < VSTATE_HEADER_SIZE || memcmp(data, VSTATE_MAGIC, 4) != 0 ||
+      ((unsigned int)data[4] | ((unsigned int)data[5] << 8)) != VSTATE_VERSION ||
+      (data[6] & ~VSTATE_FLAG_DELTA) != 0 || data[7] != 0) {
+    return FALSE;
+  }
+  while (pos < len) {
+    if (len - pos < 8) return FALSE;
+    n = _peek32(data + pos + 4);
+    if (n > len - pos - 8) return FALSE;
+    if (!_check_section(data + pos, data + pos + 8, n)) return FALSE;
+    pos += 8 + n;
+  }
+  return TRUE;
+}
+
+static void _load_cpu(vstate_reader_t *r, cpu *c) {
+  unsigned int flags;
+
+  c->pc = (address)_get16(r);
+  c->a = (byte)_get8(r);
+  c->x = (byte)_get8(r);
+  c->y = (byte)_get8(r);
+  c->sr = (byte)_get8(r);
+  c->sp = (byte)_get8(r);
+  flags = _get8(r);
+  c->halted = (flags & VSTATE_CPU_HALTED) != 0;
+  c->reset = (flags & VSTATE_CPU_RESET) != 0;
+  c->irq = (flags & VSTATE_CPU_IRQ) != 0;
+  c->irq_line = (flags & VSTATE_CPU_IRQ_LINE) != 0;
+  c->nmi = (flags & VSTATE_CPU_NMI) != 0;
+  c->stopped = (flags & VSTATE_CPU_STOPPED) != 0;
+  c->waiting = (flags & VSTATE_CPU_WAITING) != 0;
+  cpu_set_variant(c, _get8(r) == CPU_65C02 ? CPU_65C02 : CPU_6502);
+  c->cycles = _get64(r);
+}
+
+static void _load_machine(vstate_reader_t *r, vmachine_t *machine) {
+  machine->host_idle = _get8(r) ? TRUE : FALSE;
+  machine->tx_latency = _get64(r);
+}
+
+static void _load_protection(vstate_reader_t *r, vmachine_t *machine) {
+  address_range ar;
+  unsigned int count;
+
+  /* Removing everything also rebuilds the page flags */
+  ar.start = 0x0000;
+  ar.end = 0xFFFF;
+  remove_protected_range(machine, ar);
+
+  count = _get16(r);
+  while (count-- > 0) {
+    ar.start = (address)_get16(r);
+    ar.end = (address)_get16(r);
+    add_protected_range(machine, ar);
+  }
+}
+
+static void _load_memory(vstate_reader_t *r, unsigned long len, vmachine_t *machine) {
+  int i;
+
+  for (; len > 0; len -= VSTATE_PAGE_SIZE) {
+    i = (int)_get8(r);
+    memcpy(_page_mem(machine, i), r->data + r->pos, 0x100);
+    r->pos += 0x100;
+  }
+}
+
+static void _load_via(vstate_reader_t *r, via_t *dev) {
+  dev->port_a = (byte)_get8(r);
+  dev->port_b = (byte)_get8(r);
+  dev->ddr_a = (byte)_get8(r);
+  dev->ddr_b = (byte)_get8(r);
+  dev->t1_counter = (address)_get16(r);
+  dev->t1_latch = (address)_get16(r);
+  dev->t2_counter = (address)_get16(r);
+  dev->t2_latch_low = (byte)_get8(r);
+  dev->shift_reg = (byte)_get8(r);
+  dev->acr = (byte)_get8(r);
+  dev->pcr = (byte)_get8(r);
+  dev->ifr = (byte)_get8(r);
+  dev->ier = (byte)_get8(r);
+  dev->t1_running = (int)_get8(r);
+  dev->t2_running = (int)_get8(r);
+  dev->clock = _get64(r);
+}
+
+static void _load_acia(vstate_reader_t *r, acia_t *dev) {
+  unsigned int i;
+
+  dev->command = (byte)_get8(r);
+  dev->control = (byte)_get8(r);
+  dev->rx_data = (byte)_get8(r);
+  dev->rx_full = (int)_get8(r);
+  dev->rx_overrun = (int)_get8(r);
+  dev->rx_fifo_enabled = (int)_get8(r);
+  dev->tx_flush_newline = (int)_get8(r);
+  dev->timing = (int)_get8(r);
+  dev->clock_hz = _get32(r);
+  dev->clock = _get64(r);
+  dev->tx_data = (byte)_get8(r);
+  dev->tx_full = (int)_get8(r);
+  dev->tx_busy_until = _get64(r);
+  dev->rx_next = _get64(r);
+  dev->rx_head = 0;
+  dev->rx_count = _get16(r);
+  for (i = 0; i < dev->rx_count; i++) {
+    dev->rx_fifo[i] = (byte)_get8(r);
+  }
+}
+
+static void _load_fileio(vstate_reader_t *r, fileio_t *dev) {
+  bool open;
+  long pos;
+
+  if (dev->file != NULL) {
+    fclose(dev->file);
+    dev->file = NULL;
+  }
+  dev->status = (byte)_get8(r);
+  dev->data = (byte)_get8(r);
+  dev->name_index = (byte)_get8(r);
+  memcpy(dev->filename, r->data + r->pos, FILEIO_NAME_MAXLEN);
+  dev->filename[FILEIO_NAME_MAXLEN - 1] = '\0';
+  r->pos += FILEIO_NAME_MAXLEN;
+  open = _get8(r) ? TRUE : FALSE;
+  dev->writing = (int)_get8(r);
+  pos = (long)_get32(r);
+
+  /* Reopen the file where it was left, without truncating it */
+  if (open) {
+    dev->file = fopen(dev->filename, dev->writing ? "r+b" : "rb");
+    if (dev->file == NULL || fseek(dev->file, pos, SEEK_SET) != 0) {
+      if (dev->file != NULL) {
+        fclose(dev->file);
+        dev->file = NULL;
+      }
+      dev->status = FILEIO_STATUS_READY | FILEIO_STATUS_ERR;
+    }
+  }
+}
+
+/* Load a state that has passed _check_state(). */
+static void _load_state(vmachine_t *machine, const byte *data, size_t len) {
+  vstate_reader_t r;
+  unsigned long n;
+  size_t next;
+  const byte *tag;
+
+  /* Pages left out of a full state are zero, a delta leaves them alone */
+  machine_unshare(machine);
+  if (!_is_delta(data)) {
+    memset(machine->mem, 0, sizeof(machine->mem));
+  }
+
+  /* Flush output produced before the load, it is not part of the state */
+  machine_flush(machine);
+
+  r.data = data;
+  r.pos = VSTATE_HEADER_SIZE;
+  while (r.pos < len) {
+    tag = data + r.pos;
+    n = _peek32(data + r.pos + 4);
+    r.pos += 8;
+    next = r.pos + n;
+    if (!memcmp(tag, "CPU ", 4)) {
+      _load_cpu(&r, &machine->c);
+    } else if (!memcmp(tag, "MACH", 4)) {
+      _load_machine(&r, machine);
+    } else if (!memcmp(tag, "PROT", 4)) {
+      _load_protection(&r, machine);
+    } else if (!memcmp(tag, "MEM ", 4)) {
+      _load_memory(&r, n, machine);
+    } else if (!memcmp(tag, "VIA ", 4) && machine->via != NULL) {
+      _load_via(&r, machine->via);
+    } else if (!memcmp(tag, "ACI1", 4) && machine->acia1 != NULL) {
+      _load_acia(&r, machine->acia1);
+    } else if (!memcmp(tag, "ACI2", 4) && machine->acia2 != NULL) {
+      _load_acia(&r, machine->acia2);
+    } else if (!memcmp(tag, "FIO ", 4) && machine->fio != NULL) {
+      _load_fileio(&r, machine->fio);
+    }
+    r.pos = next;
+  }
+
+  /* Start the scheduler again from the restored cycle count */
+  machine->idle_polls = 0;
+  machine->idle_last_poll = 0;
+  machine->tx_deadline = VMACHINE_NO_EVENT;
+  machine->rx_poll = VMACHINE_NO_EVENT;
+  if ((machine->acia1 != NULL && machine->acia1->input != NULL) ||
+      (machine->acia2 != NULL && machine->acia2->input != NULL)) {
+    machine->rx_poll = machine->c.cycles + VMACHINE_ACIA_POLL_CYCLES;
+  }
+  machine->prevc = machine->c;
+  machine_run_events(machine);
+}
+
+/* Read a whole state file and check it. Returns NULL if it is not valid. */
+static byte *_read_state(const char *filename, size_t *size) {
+  FILE *f;
+  byte *data;
+  long len;
+
+  f = fopen(filename, "rb");
+  if (f == NULL) return NULL;
+  if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) < 0 ||
+      fseek(f, 0, SEEK_SET) != 0) {
+    fclose(f);
+    return NULL;
+  }
+  data = (byte *)malloc(len > 0 ? (size_t)len : 1);
+  if (data != NULL && (fread(data, 1, (size_t)len, f) != (size_t)len ||
+                       !_check_state(data, (size_t)len))) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  *size = (size_t)len;
+  return data;
+}
+
+int vmachine_load_state(vmachine_t *machine, const char *filename) {
+  return vmachine_load_state_chain(machine, &filename, 1);
+}
+
+int vmachine_load_state_chain(vmachine_t *machine, const char **filenames, int count) {
+  byte **data;
+  size_t *sizes;
+  int i;
+  int result = 0;
+
+  if (count <= 0) return -1;
+  data = (byte **)malloc(count * sizeof(byte *));
+  sizes = (size_t *)malloc(count * sizeof(size_t));
+  if (data == NULL || sizes == NULL) {
+    free(data);
+    free(sizes);
+    return -1;
+  }
+
+  /* Check every file before touching the machine */
+  for (i = 0; i < count; i++) {
+    data[i] = result == 0 ? _read_state(filenames[i], &sizes[i]) : NULL;
+    if (data[i] == NULL || (i > 0 && !_is_delta(data[i]))) {
+      result = -1;
+    }
+  }
+  if (count > 1 && result == 0 && _is_delta(data[0])) {
+    result = -1;
+  }
+
+  if (result == 0) {
+    for (i = 0; i < count; i++) {
+      _load_state(machine, data[i], sizes[i]);
+    }
+    machine_checkpoint(machine);
+    vhistory_clear(machine->history, machine);
+  }
+
+  for (i = 0; i < count; i++) {
+    free(data[i]);
+  }
+  free(data);
+  free(sizes);
+  return result;
+}
@@ -0,0 +1,84 @@
+#ifndef _VSTATE_H_
+#define _VSTATE_H_
+
+/**
+ *
+ * Saving and restoring the complete state of a vMachine.
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "vmachine.h"
+
+/*
+ * A state file starts with an 8 byte header: VSTATE_MAGIC, a 16 bit
+ * format version and 16 bits of flags. It is followed by sections, each
+ * a 4 character tag, a 32 bit payload length and the payload. All
+ * numbers are little endian. Sections with unknown tags are skipped.
+ *   "CPU " registers, flags, variant and cycle count
+ *   "MACH" machine settings
+ *   "PROT" protected address ranges
+ *   "MEM " memory pages that are not all zero, each a page number
+ *          followed by its 256 bytes
+ *   "VIA " timers and registers
+ *   "ACI1" and "ACI2" registers, received data and timing
+ *   "FIO " registers, file name and position of the open file
+ * Host files are not part of the state. Buffered ACIA output is
+ * flushed before saving, and the file I/O device reopens its file by
+ * name when the state is loaded.
+ */
+#define VSTATE_MAGIC   "V6ST"
+#define VSTATE_VERSION 1
+
+/*
+ * Flag for a delta state. Its "MEM " section holds only the pages
+ * written since the previous checkpoint, zero or not, and loading it
+ * leaves the other pages alone. Every other section is complete.
+ */
+#define VSTATE_FLAG_DELTA 0x0001
+
+/*
+ * Save the machine's state to a file, in full or as a delta against
+ * the previous checkpoint. Saving makes a new checkpoint. Returns the
+ * number of bytes written, or -1 on error.
+ */
+long vmachine_save_state(vmachine_t *machine, const char *filename);
+long vmachine_save_delta(vmachine_t *machine, const char *filename);
+
+/*
+ * Replace the state of an initialized machine with the state saved in
+ * a file. A delta is applied on top of the current state. The machine
+ * keeps its host files. Returns 0 on success, or -1 if the file cannot
+ * be read or is not a valid state file, in which case the machine is
+ * unchanged. Loading makes a new checkpoint.
+ */
+int vmachine_load_state(vmachine_t *machine, const char *filename);
+
+/*
+ * Load a full state followed by the deltas saved after it, in order.
+ * Every file is checked before any is loaded.
+ */
+int vmachine_load_state_chain(vmachine_t *machine, const char **filenames, int count);
+
+#endif
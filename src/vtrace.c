@@ -0,0 +1,188 @@
+/**
+ *
+ * Binary instruction traces.
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vtrace.h"
+
+/* Write out buffers handed over by vtrace_record() until told to stop. */
+static void *_writer(void *arg) {
+  vtrace_t *trace = (vtrace_t *)arg;
+  byte *buffer;
+  size_t len;
+
+  pthread_mutex_lock(&trace->lock);
+  for (;;) {
+    while (trace->pending == 0 && !trace->stop) {
+      pthread_cond_wait(&trace->cond, &trace->lock);
+    }
+    if (trace->pending == 0) break;
+
+    buffer = trace->buffers[1 - trace->active];
+    len = trace->pending;
+    pthread_mutex_unlock(&trace->lock);
+    if (fwrite(buffer, 1, len, trace->file) != len) {
+      trace->error = TRUE;
+    }
+    pthread_mutex_lock(&trace->lock);
+    trace->pending = 0;
+    pthread_cond_broadcast(&trace->cond);
+  }
+  pthread_mutex_unlock(&trace->lock);
+  return NULL;
+}
+
+vtrace_t *vtrace_open(const char *filename, size_t buffer_size) {
+  vtrace_t *trace;
+  byte header[VTRACE_HEADER_SIZE];
+
+  buffer_size -= buffer_size % VTRACE_RECORD_SIZE;
+  if (buffer_size == 0) buffer_size = VTRACE_RECORD_SIZE;
+
+  trace = (vtrace_t *)malloc(sizeof(vtrace_t));
+  if (trace == NULL) return NULL;
+  trace->buffers[0] = (byte *)malloc(buffer_size);
+  trace->buffers[1] = (byte *)malloc(buffer_size);
+  trace->file = fopen(filename, "wb");
+  if (trace->buffers[0] == NULL || trace->buffers[1] == NULL || trace->file == NULL) {
+    if (trace->file != NULL) fclose(trace->file);
+    free(trace->buffers[0]);
+    free(trace->buffers[1]);
+    free(trace);
+    return NULL;
+  }
+  trace->size = buffer_size;
+  trace->active = 0;
+  trace->used = 0;
+  trace->records = 0;
+  trace->pending = 0;
+  trace->stop = FALSE;
+  trace->error = FALSE;
+
+  memcpy(header, VTRACE_MAGIC, 4);
+  header[4] = VTRACE_VERSION & 0xFF;
+  header[5] = (VTRACE_VERSION >> 8) & 0xFF;
+  header[6] = VTRACE_RECORD_SIZE & 0xFF;
+  header[7] = (VTRACE_RECORD_SIZE >> 8) & 0xFF;
+  if (fwrite(header, 1, sizeof(header), trace->file) != sizeof(header)) {
+    trace->error = TRUE;
+  }
+
+  pthread_mutex_init(&trace->lock, NULL);
+  pthread_cond_init(&trace->cond, NULL);
+  if (pthread_create(&trace->thread, NULL, _writer, trace) != 0) {
+    pthread_mutex_destroy(&trace->lock);
+    pthread_cond_destroy(&trace->cond);
+    fclose(trace->file);
+    free(trace->buffers[0]);
+    free(trace->buffers[1]);
+    free(trace);
+    return NULL;
+  }
+  return trace;
+}
+
+/* Hand the active buffer to the writer and switch to the other one. */
+static void _swap(vtrace_t *trace) {
+  pthread_mutex_lock(&trace->lock);
+  while (trace->pending > 0) {
+    pthread_cond_wait(&trace->cond, &trace->lock);
+  }
+  trace->pending = trace->used;
+  trace->active = 1 - trace->active;
+  trace->used = 0;
+  pthread_cond_broadcast(&trace->cond);
+  pthread_mutex_unlock(&trace->lock);
+}
+
+void vtrace_record(vtrace_t *trace, cpu *c) {
+  byte *r = trace->buffers[trace->active] + trace->used;
+  count_t cycles = c->cycles;
+  address ea;
+  int length;
+  int i;
+
+  length = cpu_decode(c, &ea);
+  for (i = 0; i < 8; i++) {
+    r[i] = (byte)(cycles & 0xFF);
+    cycles >>= 8;
+  }
+  r[8] = (byte)(c->pc & 0xFF);
+  r[9] = (byte)(c->pc >> 8);
+  r[10] = (byte)(ea & 0xFF);
+  r[11] = (byte)(ea >> 8);
+  r[12] = cpu_peek_byte(c, c->pc);
+  r[13] = length > 1 ? cpu_peek_byte(c, (address)(c->pc + 1)) : 0;
+  r[14] = length > 2 ? cpu_peek_byte(c, (address)(c->pc + 2)) : 0;
+  r[15] = c->a;
+  r[16] = c->x;
+  r[17] = c->y;
+  r[18] = c->sr;
+  r[19] = c->sp;
+
+  trace->records++;
+  trace->used += VTRACE_RECORD_SIZE;
+  if (trace->used == trace->size) {
+    _swap(trace);
+  }
+}
+
+void vtrace_flush(vtrace_t *trace) {
+  if (trace->used > 0) {
+    _swap(trace);
+  }
+  pthread_mutex_lock(&trace->lock);
+  while (trace->pending > 0) {
+    pthread_cond_wait(&trace->cond, &trace->lock);
+  }
+  pthread_mutex_unlock(&trace->lock);
+  fflush(trace->file);
+}
+
+int vtrace_close(vtrace_t *trace) {
+  int result;
+
+  if (trace == NULL) return 0;
+  vtrace_flush(trace);
+
+  pthread_mutex_lock(&trace->lock);
+  trace->stop = TRUE;
+  pthread_cond_broadcast(&trace->cond);
+  pthread_mutex_unlock(&trace->lock);
+  pthread_join(trace->thread, NULL);
+
+  pthread_mutex_destroy(&trace->lock);
+  pthread_cond_destroy(&trace->cond);
+  if (fclose(trace->file) != 0) trace->error = TRUE;
+  result = trace->error ? -1 : 0;
+  free(trace->buffers[0]);
+  free(trace->buffers[1]);
+  free(trace);
+  return result;
+}
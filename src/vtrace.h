@@ -0,0 +1,92 @@
+#ifndef _VTRACE_H_
+#define _VTRACE_H_
+
+/**
+ *
+ * Binary instruction traces.
+ *
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "vtypes.h"
+#include "v6502.h"
+
+/*
+ * A trace file starts with an 8 byte header: VTRACE_MAGIC, a 16 bit
+ * format version and the 16 bit record size. Each record describes one
+ * instruction just before it runs:
+ *   0:  cycle count (64 bits)
+ *   8:  PC
+ *   10: effective address, see cpu_decode()
+ *   12: opcode and two operand bytes, unused operand bytes are 0
+ *   15: A, X, Y, SR and SP
+ * Numbers are little endian. utils/tracedump.c prints and filters
+ * traces.
+ *
+ * Records are collected in one of two buffers. When it is full a
+ * writer thread writes it out while the other buffer fills.
+ */
+#define VTRACE_MAGIC       "V6TR"
+#define VTRACE_VERSION     1
+#define VTRACE_HEADER_SIZE 8
+#define VTRACE_RECORD_SIZE 20
+#define VTRACE_DEFAULT_BUFFER (1024L * 1024L)  /* Bytes per buffer */
+
+typedef struct vtrace {
+  FILE *file;
+  byte *buffers[2];
+  size_t size;            /* Bytes per buffer, a whole number of records */
+  int active;             /* Buffer records are added to */
+  size_t used;            /* Bytes used in the active buffer */
+  unsigned long records;  /* Records traced so far */
+
+  /* Shared with the writer thread */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  size_t pending;         /* Bytes of the other buffer waiting to be written */
+  bool stop;
+  bool error;             /* A write failed */
+} vtrace_t;
+
+/*
+ * Create a trace file. buffer_size is rounded down to whole records.
+ * Returns NULL if the file cannot be created.
+ */
+vtrace_t *vtrace_open(const char *filename, size_t buffer_size);
+
+/* Add a record for the instruction at the PC. */
+void vtrace_record(vtrace_t *trace, cpu *c);
+
+/* Write out everything traced so far. */
+void vtrace_flush(vtrace_t *trace);
+
+/* Flush and close a trace. Returns 0, or -1 if any write failed. */
+int vtrace_close(vtrace_t *trace);
+
+#endif
@@ -31,6 +31,17 @@ typedef unsigned short int address;
 
 typedef char bool;
 
+/*
+ * A 64 bit unsigned counter, used for cycle and instruction counts.
+ * ANSI C has no 64 bit integer type, so use the compiler's where it
+ * provides one and fall back to unsigned long otherwise.
+ */
+#if defined(__GNUC__)
+__extension__ typedef unsigned long long count_t;
+#else
+typedef unsigned long count_t;
+#endif
+
 #ifndef TRUE
 #define TRUE 1
 #endif
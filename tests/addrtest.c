@@ -25,6 +25,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "addrlist.h"
 
 /* ANSI color codes for terminal output */
@@ -865,6 +866,101 @@ static void test_edge_case_boundary_addresses(void) {
     pass("boundary addresses");
 }
 
+/*
+ * ============================================================================
+ * Bitmap Tests
+ * ============================================================================
+ */
+
+static address_bitmap test_bitmap;
+
+/* Helper to check that the list and its bitmap agree on every address */
+static int bitmap_matches_list(address_range_list *list, address_bitmap *bitmap) {
+    unsigned long a;
+    for (a = 0; a <= 0xFFFF; a++) {
+        if (is_address_in_range_list(list, (address)a) !=
+            is_address_in_bitmap(bitmap, (address)a)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void test_bitmap_empty(void) {
+    address_range_list list;
+
+    init_address_range_list(&list);
+    memset(test_bitmap.bits, 0xFF, sizeof(test_bitmap.bits));
+    build_address_bitmap(&list, &test_bitmap);
+
+    if (!bitmap_matches_list(&list, &test_bitmap)) {
+        fail("bitmap empty", "Empty list should produce an empty bitmap");
+        return;
+    }
+
+    build_address_bitmap(NULL, &test_bitmap);
+    if (is_address_in_bitmap(&test_bitmap, 0x0000) ||
+        is_address_in_bitmap(NULL, 0x0000)) {
+        fail("bitmap empty", "NULL list or bitmap should contain no addresses");
+        return;
+    }
+
+    pass("bitmap empty");
+}
+
+static void test_bitmap_boundaries(void) {
+    address_range_list list;
+
+    init_address_range_list(&list);
+    add_address_range(&list, make_range(0x0000, 0x0000));
+    add_address_range(&list, make_range(0x1007, 0x1008));
+    add_address_range(&list, make_range(0xD000, 0xFFFF));
+    build_address_bitmap(&list, &test_bitmap);
+
+    if (!bitmap_matches_list(&list, &test_bitmap)) {
+        fail("bitmap boundaries", "Bitmap should match list");
+        clear_address_range_list(&list);
+        return;
+    }
+
+    clear_address_range_list(&list);
+    pass("bitmap boundaries");
+}
+
+static void test_bitmap_matches_list(void) {
+    address_range_list list;
+    unsigned long seed = 12345;
+    address start, length;
+    int i;
+
+    init_address_range_list(&list);
+
+    /* Apply a fixed pseudo-random sequence of adds and removes */
+    for (i = 0; i < 200; i++) {
+        seed = (seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+        start = (address)(seed >> 8);
+        seed = (seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+        length = (address)((seed >> 8) & 0x03FF);
+        if ((unsigned long)start + length > 0xFFFF) {
+            length = (address)(0xFFFF - start);
+        }
+        if (i % 3 == 2) {
+            remove_address_range(&list, make_range(start, (address)(start + length)));
+        } else {
+            add_address_range(&list, make_range(start, (address)(start + length)));
+        }
+        build_address_bitmap(&list, &test_bitmap);
+        if (!bitmap_matches_list(&list, &test_bitmap)) {
+            fail("bitmap matches list", "Bitmap and list disagree");
+            clear_address_range_list(&list);
+            return;
+        }
+    }
+
+    clear_address_range_list(&list);
+    pass("bitmap matches list");
+}
+
 /*
  * ============================================================================
  * Main test runner
@@ -917,6 +1013,11 @@ int main(void) {
     test_edge_case_single_address();
     test_edge_case_boundary_addresses();
 
+    printf("\n--- Bitmap Tests ---\n");
+    test_bitmap_empty();
+    test_bitmap_boundaries();
+    test_bitmap_matches_list();
+
     printf("\n==============================\n");
     printf("Tests passed: %d\n", tests_passed);
     printf("Tests failed: %d\n", tests_failed);
@@ -0,0 +1,299 @@
+/**
+ * Micro-benchmarks for the CPU core, the memory bus and the devices.
+ *
+ * Usage: bench [basic.woz]
+ *
+ * Each workload is warmed up, then timed over several runs of the same
+ * number of instructions. The median run is reported with the spread
+ * between the fastest and slowest runs.
+ *
+ * Copyright (c) 2025 Andrew C. Young
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#define _XOPEN_SOURCE 600  /* clock_gettime() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vmachine.h"
+
+#define WARMUP_INSTRUCTIONS 2000000L
+#define RUN_INSTRUCTIONS    5000000L
+#define RUNS                5
+
+/* BASIC is typed in during the warm-up, which must cover booting it */
+#define BASIC_WARMUP_INSTRUCTIONS 5000000L
+
+static const char *basic_input =
+    "\r\r"
+    "10 FOR I=1 TO 30000\r"
+    "20 X=SIN(I)*SQR(I)\r"
+    "30 NEXT I\r"
+    "RUN\r";
+
+/* Tight ALU loop: CLC, LDA, ADC, EOR, ASL, ROR, AND, ORA, INX, BNE */
+static const byte alu_program[] = {
+    0x18, 0xA9, 0x11, 0x69, 0x22, 0x49, 0x55, 0x0A, 0x6A,
+    0x29, 0xF0, 0x09, 0x0F, 0xE8, 0xD0, 0xF0,
+    0x4C, 0x00, 0x02
+};
+
+/* Decimal mode ADC and SBC, with immediate and zero page operands */
+static const byte bcd_program[] = {
+    0xF8, 0x18, 0xA9, 0x25, 0x69, 0x38, 0x38, 0xE9, 0x19,
+    0x65, 0x10, 0xE5, 0x11, 0x88, 0xD0, 0xF1,
+    0x4C, 0x00, 0x02
+};
+
+/* Copy $1000-$10FF to $2000-$20FF with LDA abs,X and STA abs,X */
+static const byte copy_program[] = {
+    0xA2, 0x00, 0xBD, 0x00, 0x10, 0x9D, 0x00, 0x20, 0xE8, 0xD0, 0xF7,
+    0x4C, 0x00, 0x02
+};
+
+/* Fill $3000-$3FFF through STA ($10),Y */
+static const byte indirect_program[] = {
+    0xA9, 0x00, 0x85, 0x10, 0xA9, 0x30, 0x85, 0x11,
+    0xA0, 0x00, 0x91, 0x10, 0xC8, 0xD0, 0xFB,
+    0xE6, 0x11, 0xA5, 0x11, 0xC9, 0x40, 0xD0, 0xF1,
+    0x4C, 0x00, 0x02
+};
+
+/*
+ * Run VIA timer 1 continuously and poll its interrupt flag in IFR.
+ * Each expiry clears the flag and is counted in $10-$12.
+ */
+static const byte via_program[] = {
+    0xA9, 0x40, 0x8D, 0x3B, 0xC0, 0xA9, 0x00, 0x8D, 0x34, 0xC0,
+    0xA9, 0x01, 0x8D, 0x35, 0xC0,
+    0xAD, 0x3D, 0xC0, 0x29, 0x40, 0xF0, 0xF9,
+    0xAD, 0x34, 0xC0,
+    0xE6, 0x10, 0xD0, 0x06, 0xE6, 0x11, 0xD0, 0x02, 0xE6, 0x12,
+    0x4C, 0x0F, 0x02
+};
+
+/* Send characters out of the primary ACIA as fast as it takes them */
+static const byte acia_program[] = {
+    0xAD, 0x11, 0xC0, 0x29, 0x10, 0xF0, 0xF9,
+    0xA9, 0x58, 0x8D, 0x10, 0xC0, 0x4C, 0x00, 0x02
+};
+
+/* Write a page whose top half is protected */
+static const byte protected_program[] = {
+    0xA2, 0x00, 0x9D, 0x00, 0x30, 0xE8, 0xD0, 0xFA,
+    0x4C, 0x00, 0x02
+};
+
+typedef struct benchmark {
+    const char *name;
+    const byte *program;   /* Loaded at $0200, or NULL for MS BASIC */
+    size_t size;
+    bool bare;             /* Run on the CPU core alone, without the machine */
+    bool protect;          /* Protect $3080-$30FF */
+    bool events;           /* Counts the events it handled in $10-$12 */
+} benchmark_t;
+
+static const benchmark_t benchmarks[] = {
+    { "ALU loop (core only)",    alu_program, sizeof(alu_program), TRUE, FALSE, FALSE },
+    { "ALU loop",                alu_program, sizeof(alu_program), FALSE, FALSE, FALSE },
+    { "BCD ADC/SBC",             bcd_program, sizeof(bcd_program), FALSE, FALSE, FALSE },
+    { "Memory copy",             copy_program, sizeof(copy_program), FALSE, FALSE, FALSE },
+    { "Indirect indexed stores", indirect_program, sizeof(indirect_program), FALSE, FALSE, FALSE },
+    { "VIA timer polling",       via_program, sizeof(via_program), FALSE, FALSE, TRUE },
+    { "ACIA output flood",       acia_program, sizeof(acia_program), FALSE, FALSE, FALSE },
+    { "Protected range writes",  protected_program, sizeof(protected_program), FALSE, TRUE, FALSE },
+    { "MS BASIC SIN/SQR loop",   NULL, 0, FALSE, FALSE, FALSE }
+};
+
+static vmachine_t machine;
+static cpu bare;
+static byte bare_memory[0x10000];
+
+static byte bare_read(void *userdata, address a) {
+    return ((byte *)userdata)[a];
+}
+
+static void bare_write(void *userdata, address a, byte b) {
+    ((byte *)userdata)[a] = b;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Run instructions the way cpu_run() does, ticking the machine. */
+static void run_machine(long instructions) {
+    while (instructions-- > 0 && !machine.c.stopped && !machine.c.halted) {
+        cpu_step(&machine.c);
+        machine_tick(&machine);
+    }
+}
+
+static void run(const benchmark_t *b, long instructions) {
+    if (b->bare) {
+        cpu_run_instructions(&bare, (count_t)instructions);
+    } else {
+        run_machine(instructions);
+    }
+}
+
+/* Load a Wozmon file into a ROM image for $D000-$FFFF. */
+static int load_woz(const char *filename, byte *rom) {
+    FILE *f;
+    char line[256];
+    char *p, *end;
+    unsigned long a, value;
+
+    f = fopen(filename, "r");
+    if (f == NULL) return 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        a = strtoul(line, &p, 16);
+        if (p == line || *p != ':') continue;
+        for (p++; ; p = end, a++) {
+            value = strtoul(p, &end, 16);
+            if (end == p) break;
+            if (a >= VMACHINE_ROM_START && a < VMACHINE_ROM_START + VMACHINE_ROM_SIZE) {
+                rom[a - VMACHINE_ROM_START] = (byte)value;
+            }
+        }
+    }
+    fclose(f);
+    return 1;
+}
+
+/* Prepare the machine or bare CPU for a benchmark. */
+static int setup(const benchmark_t *b, const char *basic, FILE *output) {
+    static byte rom[VMACHINE_ROM_SIZE];
+    vmachine_config_t config;
+    address_range ar;
+    FILE *input;
+
+    if (b->bare) {
+        memset(bare_memory, 0, sizeof(bare_memory));
+        memcpy(&bare_memory[0x0200], b->program, b->size);
+        cpu_init(&bare);
+        bare.userdata = bare_memory;
+        bare.read_ctx = bare_read;
+        bare.write_ctx = bare_write;
+        bare.pc = 0x0200;
+        return 1;
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.acia1_output = output;
+    if (b->program == NULL) {
+        memset(rom, 0, sizeof(rom));
+        if (!load_woz(basic, rom)) return 0;
+        input = tmpfile();
+        if (input == NULL) return 0;
+        fputs(basic_input, input);
+        rewind(input);
+        config.rom_data = rom;
+        config.rom_size = VMACHINE_ROM_SIZE;
+        config.acia1_input = input;
+    }
+    init_vmachine(&machine, &config);
+    if (b->program == NULL) {
+        cpu_reset(&machine.c);
+    } else {
+        memcpy(&machine.mem[0x0200], b->program, b->size);
+        machine.c.pc = 0x0200;
+    }
+    if (b->protect) {
+        ar.start = 0x3080;
+        ar.end = 0x30FF;
+        add_protected_range(&machine, ar);
+    }
+    return 1;
+}
+
+static void cleanup(const benchmark_t *b) {
+    if (b->bare) return;
+    if (machine.acia1 != NULL && machine.acia1->input != NULL) {
+        fclose(machine.acia1->input);
+    }
+    cleanup_vmachine(&machine);
+}
+
+static int by_time(const void *a, const void *b) {
+    double ta = *(const double *)a;
+    double tb = *(const double *)b;
+
+    return ta < tb ? -1 : ta > tb;
+}
+
+int main(int argc, char **argv) {
+    const char *basic = argc > 1 ? argv[1] : "rom/basic.woz";
+    double times[RUNS];
+    double start, median;
+    FILE *output;
+    size_t i;
+    int r;
+    long events;
+
+    output = fopen("/dev/null", "w");
+    if (output == NULL) output = tmpfile();
+
+    printf("v6502c benchmarks, %d runs of %ld instructions after %ld warm-up\n\n",
+           RUNS, RUN_INSTRUCTIONS, WARMUP_INSTRUCTIONS);
+    printf("%-26s %12s %10s %8s %10s\n", "Workload", "Instr/sec", "ns/instr", "Spread", "Events");
+
+    for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        const benchmark_t *b = &benchmarks[i];
+
+        if (!setup(b, basic, output)) {
+            printf("%-26s skipped, cannot load %s\n", b->name, basic);
+            continue;
+        }
+        run(b, b->program == NULL ? BASIC_WARMUP_INSTRUCTIONS : WARMUP_INSTRUCTIONS);
+        for (r = 0; r < RUNS; r++) {
+            if (b->events) memset(&machine.mem[0x10], 0, 3);
+            start = now_seconds();
+            run(b, RUN_INSTRUCTIONS);
+            times[r] = now_seconds() - start;
+        }
+        events = b->events ? (long)machine.mem[0x10] | (long)machine.mem[0x11] << 8 |
+                             (long)machine.mem[0x12] << 16 : 0;
+        cleanup(b);
+
+        qsort(times, RUNS, sizeof(double), by_time);
+        median = times[RUNS / 2];
+        printf("%-26s %12.0f %10.2f %7.1f%%", b->name,
+               (double)RUN_INSTRUCTIONS / median,
+               median * 1e9 / (double)RUN_INSTRUCTIONS,
+               100.0 * (times[RUNS - 1] - times[0]) / median);
+        if (b->events) {
+            /* A workload that handled nothing did not measure its device */
+            printf(" %10ld%s", events, events == 0 ? "  (none, check the program)" : "");
+        }
+        putchar('\n');
+    }
+
+    fclose(output);
+    return 0;
+}
@@ -47,11 +47,20 @@ void fail(const char *test_name, const char *reason) {
 }
 
 /* Memory simulation functions */
-byte test_read(address a) {
+byte test_read(void *userdata, address a) {
+    return ((byte *)userdata)[a];
+}
+
+void test_write(void *userdata, address a, byte b) {
+    ((byte *)userdata)[a] = b;
+}
+
+/* Callbacks without a context pointer, for the legacy API test */
+static byte legacy_read(address a) {
     return test_memory[a];
 }
 
-void test_write(address a, byte b) {
+static void legacy_write(address a, byte b) {
     test_memory[a] = b;
 }
 
@@ -59,9 +68,10 @@ void test_write(address a, byte b) {
 void test_init(void) {
     memset(test_memory, 0, sizeof(test_memory));
     cpu_init(&test_cpu);
-    test_cpu.read = test_read;
-    test_cpu.write = test_write;
-    test_cpu.tick = NULL;
+    test_cpu.userdata = test_memory;
+    test_cpu.read_ctx = test_read;
+    test_cpu.write_ctx = test_write;
+    test_cpu.tick_ctx = NULL;
     
     /* Set reset vector to point to 0x0200 */
     test_memory[0xFFFC] = 0x00;
@@ -900,6 +910,44 @@ void test_irq_masking(void) {
     pass("IRQ masking");
 }
 
+/* Level-triggered IRQ line Tests */
+void test_irq_line(void) {
+    test_reset_cpu();
+
+    /* Handler at 0x3000 is just RTI */
+    test_memory[0xFFFE] = 0x00;
+    test_memory[0xFFFF] = 0x30;
+    test_memory[0x3000] = 0x40; /* RTI */
+    test_memory[0x0200] = 0xEA; /* NOP */
+    test_memory[0x0201] = 0xEA; /* NOP */
+    test_cpu.sr &= ~(1 << 2);
+
+    /* A held line interrupts again after RTI */
+    cpu_set_irq_line(&test_cpu, TRUE);
+    cpu_step(&test_cpu);
+    if (test_cpu.pc != 0x3000) {
+        fail("IRQ line", "Asserted line should be serviced");
+        cpu_set_irq_line(&test_cpu, FALSE);
+        return;
+    }
+    cpu_step(&test_cpu);
+    if (test_cpu.pc != 0x3000) {
+        fail("IRQ line", "Held line should be serviced again after RTI");
+        cpu_set_irq_line(&test_cpu, FALSE);
+        return;
+    }
+
+    /* Once released, RTI returns to the interrupted code */
+    cpu_set_irq_line(&test_cpu, FALSE);
+    cpu_step(&test_cpu);
+    if (test_cpu.pc != 0x0201) {
+        fail("IRQ line", "Released line should not interrupt");
+        return;
+    }
+
+    pass("IRQ line");
+}
+
 /* Interrupt Priority Tests */
 void test_interrupt_priority(void) {
     test_reset_cpu();
@@ -1133,6 +1181,424 @@ void test_pla_flags(void) {
     pass("PLA flags");
 }
 
+/* Cycle Counting Tests */
+void test_cycles(void) {
+    count_t start;
+
+    /* Immediate load takes its base cycle count */
+    test_reset_cpu();
+    start = test_cpu.cycles;
+    test_memory[0x0200] = 0xA9; /* LDA #$01 */
+    test_memory[0x0201] = 0x01;
+    if (cpu_step(&test_cpu) != 2 || test_cpu.cycles - start != 2) {
+        fail("Cycle counting", "LDA immediate should take 2 cycles");
+        return;
+    }
+
+    /* Indexed read without a page crossing */
+    test_reset_cpu();
+    test_cpu.x = 0x01;
+    test_memory[0x0200] = 0xBD; /* LDA $1000,X */
+    test_memory[0x0201] = 0x00;
+    test_memory[0x0202] = 0x10;
+    if (cpu_step(&test_cpu) != 4) {
+        fail("Cycle counting", "LDA absolute,X should take 4 cycles");
+        return;
+    }
+
+    /* Indexed read crossing a page costs one extra cycle */
+    test_reset_cpu();
+    test_cpu.x = 0x01;
+    test_memory[0x0200] = 0xBD; /* LDA $10FF,X */
+    test_memory[0x0201] = 0xFF;
+    test_memory[0x0202] = 0x10;
+    if (cpu_step(&test_cpu) != 5) {
+        fail("Cycle counting", "LDA absolute,X across a page should take 5 cycles");
+        return;
+    }
+
+    /* Indexed stores always take the same time */
+    test_reset_cpu();
+    test_cpu.x = 0x01;
+    test_memory[0x0200] = 0x9D; /* STA $10FF,X */
+    test_memory[0x0201] = 0xFF;
+    test_memory[0x0202] = 0x10;
+    if (cpu_step(&test_cpu) != 5) {
+        fail("Cycle counting", "STA absolute,X should take 5 cycles");
+        return;
+    }
+
+    /* Branch not taken */
+    test_reset_cpu();
+    test_cpu.sr |= (1 << 1); /* Set zero flag */
+    test_memory[0x0200] = 0xD0; /* BNE +$10 */
+    test_memory[0x0201] = 0x10;
+    if (cpu_step(&test_cpu) != 2) {
+        fail("Cycle counting", "BNE not taken should take 2 cycles");
+        return;
+    }
+
+    /* Branch taken within the page */
+    test_reset_cpu();
+    test_cpu.sr &= ~(1 << 1); /* Clear zero flag */
+    test_memory[0x0200] = 0xD0; /* BNE +$10 */
+    test_memory[0x0201] = 0x10;
+    if (cpu_step(&test_cpu) != 3) {
+        fail("Cycle counting", "BNE taken should take 3 cycles");
+        return;
+    }
+
+    /* Branch taken to another page */
+    test_reset_cpu();
+    test_cpu.sr &= ~(1 << 1); /* Clear zero flag */
+    test_memory[0x0200] = 0xD0; /* BNE -$10 */
+    test_memory[0x0201] = 0xF0;
+    if (cpu_step(&test_cpu) != 4) {
+        fail("Cycle counting", "BNE taken across a page should take 4 cycles");
+        return;
+    }
+
+    /* Decimal mode ADC costs an extra cycle on the 65C02 only */
+    test_reset_cpu();
+    cpu_set_variant(&test_cpu, CPU_65C02);
+    test_cpu.sr |= (1 << 3); /* Set decimal flag */
+    test_memory[0x0200] = 0x69; /* ADC #$01 */
+    test_memory[0x0201] = 0x01;
+    if (cpu_step(&test_cpu) != 3) {
+        fail("Cycle counting", "65C02 decimal ADC should take 3 cycles");
+        return;
+    }
+
+    test_reset_cpu();
+    cpu_set_variant(&test_cpu, CPU_6502);
+    test_cpu.sr |= (1 << 3); /* Set decimal flag */
+    test_memory[0x0200] = 0x69; /* ADC #$01 */
+    test_memory[0x0201] = 0x01;
+    if (cpu_step(&test_cpu) != 2) {
+        cpu_set_variant(&test_cpu, CPU_65C02);
+        fail("Cycle counting", "6502 decimal ADC should take 2 cycles");
+        return;
+    }
+    cpu_set_variant(&test_cpu, CPU_65C02);
+
+    /* Servicing an interrupt adds the interrupt entry sequence */
+    test_reset_cpu();
+    test_memory[0x0200] = 0xEA; /* NOP */
+    test_cpu.sr &= ~(1 << 2); /* Clear IRQ_DISABLE */
+    cpu_irq(&test_cpu);
+    if (cpu_step(&test_cpu) != 9) {
+        fail("Cycle counting", "NOP followed by an IRQ should take 9 cycles");
+        return;
+    }
+
+    pass("Cycle counting");
+}
+
+/* Batch Run Tests */
+void test_run_budget(void) {
+    byte breakpoints[CPU_BREAKPOINT_BYTES];
+    count_t start;
+    enum cpu_exit_t reason;
+
+    /* Instruction budget */
+    test_reset_cpu();
+    memset(&test_memory[0x0200], 0xEA, 0x100); /* NOPs */
+    reason = cpu_run_instructions(&test_cpu, 10);
+    if (reason != CPU_EXIT_BUDGET || test_cpu.pc != 0x020A) {
+        fail("Batch run", "Should execute exactly 10 instructions");
+        return;
+    }
+
+    /* Cycle budget */
+    test_reset_cpu();
+    memset(&test_memory[0x0200], 0xEA, 0x100); /* NOPs */
+    start = test_cpu.cycles;
+    reason = cpu_run_cycles(&test_cpu, 20);
+    if (reason != CPU_EXIT_BUDGET || test_cpu.cycles - start != 20 ||
+        test_cpu.pc != 0x020A) {
+        fail("Batch run", "Should execute 20 cycles of NOPs");
+        return;
+    }
+
+    /* Halted */
+    test_reset_cpu();
+    cpu_halt(&test_cpu);
+    if (cpu_run_instructions(&test_cpu, 10) != CPU_EXIT_HALTED ||
+        test_cpu.pc != 0x0200) {
+        fail("Batch run", "Halted CPU should not run");
+        return;
+    }
+
+    /* STP stops the CPU until reset */
+    test_reset_cpu();
+    test_memory[0x0200] = 0xDB; /* STP */
+    test_memory[0x0201] = 0xEA; /* NOP */
+    if (cpu_run_instructions(&test_cpu, 10) != CPU_EXIT_STOPPED ||
+        test_cpu.pc != 0x0201 || cpu_step(&test_cpu) != 0) {
+        fail("Batch run", "STP should stop the CPU");
+        return;
+    }
+
+    /* WAI waits until an interrupt arrives */
+    test_reset_cpu();
+    test_memory[0x0200] = 0xCB; /* WAI */
+    test_memory[0x0201] = 0xEA; /* NOP */
+    test_memory[0xFFFE] = 0x00;
+    test_memory[0xFFFF] = 0x30; /* IRQ handler at 0x3000 */
+    test_cpu.sr &= ~(1 << 2); /* Clear IRQ_DISABLE */
+    if (cpu_run_instructions(&test_cpu, 10) != CPU_EXIT_WAITING ||
+        test_cpu.pc != 0x0201 ||
+        cpu_run_instructions(&test_cpu, 10) != CPU_EXIT_WAITING) {
+        fail("Batch run", "WAI should wait for an interrupt");
+        return;
+    }
+    cpu_irq(&test_cpu);
+    cpu_step(&test_cpu);
+    if (test_cpu.waiting || test_cpu.pc != 0x3000) {
+        fail("Batch run", "WAI should resume into the IRQ handler");
+        return;
+    }
+
+    /* Breakpoints stop before the instruction, but not on resume */
+    test_reset_cpu();
+    memset(breakpoints, 0, sizeof(breakpoints));
+    test_cpu.breakpoints = breakpoints;
+    memset(&test_memory[0x0200], 0xEA, 0x100); /* NOPs */
+    cpu_set_breakpoint(&test_cpu, 0x0204);
+    reason = cpu_run_instructions(&test_cpu, 100);
+    if (reason != CPU_EXIT_BREAKPOINT || test_cpu.pc != 0x0204) {
+        test_cpu.breakpoints = NULL;
+        fail("Batch run", "Should stop at the breakpoint");
+        return;
+    }
+    reason = cpu_run_instructions(&test_cpu, 2);
+    cpu_clear_breakpoint(&test_cpu, 0x0204);
+    if (reason != CPU_EXIT_BUDGET || test_cpu.pc != 0x0206 ||
+        cpu_is_breakpoint(&test_cpu, 0x0204)) {
+        test_cpu.breakpoints = NULL;
+        fail("Batch run", "Should resume from the breakpoint");
+        return;
+    }
+    test_cpu.breakpoints = NULL;
+
+    pass("Batch run");
+}
+
+/* Profile Tests */
+void test_profile(void) {
+    static cpu_profile_t profile[CPU_PROFILE_ENTRIES];
+
+    /* LDX #$02, then DEX and BNE loop twice */
+    test_reset_cpu();
+    memset(profile, 0, sizeof(profile));
+    test_cpu.profile = profile;
+    test_memory[0x0200] = 0xA2; /* LDX #$02 */
+    test_memory[0x0201] = 0x02;
+    test_memory[0x0202] = 0xCA; /* DEX */
+    test_memory[0x0203] = 0xD0; /* BNE $0202 */
+    test_memory[0x0204] = 0xFD;
+    cpu_run_instructions(&test_cpu, 5);
+    test_cpu.profile = NULL;
+
+    if (profile[0x0200].instructions != 1 || profile[0x0200].cycles != 2 ||
+        profile[0x0202].instructions != 2 || profile[0x0202].cycles != 4) {
+        fail("Profile", "Should count instructions and cycles by address");
+        return;
+    }
+    if (profile[0x0203].instructions != 2 || profile[0x0203].cycles != 5) {
+        fail("Profile", "Should count the taken branch penalty");
+        return;
+    }
+    if (profile[0x0201].instructions != 0 || profile[0x0205].instructions != 0) {
+        fail("Profile", "Should only count addresses instructions start at");
+        return;
+    }
+
+    pass("Profile");
+}
+
+/* Call Callback Tests */
+static enum cpu_call_t call_kinds[8];
+static address call_pcs[8];
+static int call_count = 0;
+
+static void test_call(void *userdata, enum cpu_call_t kind) {
+    if (call_count < 8) {
+        call_kinds[call_count] = kind;
+        call_pcs[call_count] = test_cpu.pc;
+    }
+    call_count++;
+}
+
+void test_call_callback(void) {
+    /* JSR to an RTS, then BRK into an RTI */
+    test_reset_cpu();
+    test_memory[0x0200] = 0x20; /* JSR $0300 */
+    test_memory[0x0201] = 0x00;
+    test_memory[0x0202] = 0x03;
+    test_memory[0x0203] = 0x00; /* BRK */
+    test_memory[0x0300] = 0x60; /* RTS */
+    test_memory[0x0400] = 0x40; /* RTI */
+    test_memory[0xFFFE] = 0x00;
+    test_memory[0xFFFF] = 0x04;
+    call_count = 0;
+    test_cpu.call_ctx = test_call;
+    cpu_run_instructions(&test_cpu, 4);
+    test_cpu.call_ctx = NULL;
+
+    if (call_count != 4) {
+        fail("Call callback", "Should report every call and return");
+        return;
+    }
+    if (call_kinds[0] != CPU_CALL_JSR || call_pcs[0] != 0x0300 ||
+        call_kinds[1] != CPU_CALL_RTS || call_pcs[1] != 0x0203) {
+        fail("Call callback", "Should report JSR and RTS after they jump");
+        return;
+    }
+    if (call_kinds[2] != CPU_CALL_INTERRUPT || call_pcs[2] != 0x0400 ||
+        call_kinds[3] != CPU_CALL_RTI || call_pcs[3] != 0x0205) {
+        fail("Call callback", "Should report BRK and RTI");
+        return;
+    }
+
+    pass("Call callback");
+}
+
+#if defined(V6502C_STATS)
+/* Instruction Mix Tests */
+void test_stats(void) {
+    cpu_stats_t stats;
+
+    /* LDX #$02, then DEX and BNE loop twice, then STA $10 */
+    test_reset_cpu();
+    test_memory[0x0200] = 0xA2; /* LDX #$02 */
+    test_memory[0x0201] = 0x02;
+    test_memory[0x0202] = 0xCA; /* DEX */
+    test_memory[0x0203] = 0xD0; /* BNE $0202 */
+    test_memory[0x0204] = 0xFD;
+    test_memory[0x0205] = 0x85; /* STA $10 */
+    test_memory[0x0206] = 0x10;
+    cpu_clear_stats(&test_cpu);
+    cpu_run_instructions(&test_cpu, 6);
+    cpu_get_stats(&test_cpu, &stats);
+
+    if (stats.instructions != 6 || stats.opcodes[0xA2] != 1 ||
+        stats.opcodes[0xCA] != 2 || stats.opcodes[0xD0] != 2 ||
+        stats.opcodes[0x85] != 1) {
+        fail("Instruction mix", "Should count every opcode");
+        return;
+    }
+    if (stats.addressings[cpu_opcode_addressing(0xD0)] != 2 ||
+        stats.addressings[cpu_opcode_addressing(0xCA)] != 2 ||
+        strcmp(cpu_addressing_name(cpu_opcode_addressing(0xA2)), "IMM") != 0 ||
+        strcmp(cpu_opcode_name(0xD0), "BNE") != 0) {
+        fail("Instruction mix", "Should total the addressing modes");
+        return;
+    }
+    /* Six opcodes and four operands read, one byte written */
+    if (stats.reads != 10 || stats.writes != 1) {
+        fail("Instruction mix", "Should count memory reads and writes");
+        return;
+    }
+
+    pass("Instruction mix");
+}
+
+void test_stats_tracing(void) {
+    cpu_stats_t stats[2];
+    address ea;
+    int pass_no, i, length;
+
+    /* LDA ($10),Y then STA $0300,X, run bare and then decoded and
+       dumped before each step the way the tracer and monitor do */
+    for (pass_no = 0; pass_no < 2; pass_no++) {
+        test_reset_cpu();
+        test_memory[0x0200] = 0xB1; /* LDA ($10),Y */
+        test_memory[0x0201] = 0x10;
+        test_memory[0x0202] = 0x9D; /* STA $0300,X */
+        test_memory[0x0203] = 0x00;
+        test_memory[0x0204] = 0x03;
+        test_memory[0x0010] = 0x00;
+        test_memory[0x0011] = 0x04;
+        cpu_clear_stats(&test_cpu);
+        for (i = 0; i < 2; i++) {
+            if (pass_no == 1) {
+                length = cpu_decode(&test_cpu, &ea);
+                cpu_peek_byte(&test_cpu, test_cpu.pc);
+                cpu_peek_byte(&test_cpu, (address)(test_cpu.pc + length - 1));
+                cpu_peek_byte(&test_cpu, ea);
+            }
+            cpu_step(&test_cpu);
+        }
+        cpu_get_stats(&test_cpu, &stats[pass_no]);
+    }
+
+    if (stats[1].reads != stats[0].reads || stats[1].writes != stats[0].writes) {
+        fail("Instruction mix tracing", "Should not count reads made by the tracer");
+        return;
+    }
+
+    pass("Instruction mix tracing");
+}
+#endif
+
+/* Context Callback Tests */
+void test_context_callbacks(void) {
+    static byte other_memory[0x10000];
+    cpu other;
+
+    /* Two CPUs with their own memory run independently */
+    test_reset_cpu();
+    memset(other_memory, 0, sizeof(other_memory));
+    cpu_init(&other);
+    other.userdata = other_memory;
+    other.read_ctx = test_read;
+    other.write_ctx = test_write;
+    other_memory[0xFFFC] = 0x00;
+    other_memory[0xFFFD] = 0x03;
+    cpu_reset(&other);
+    cpu_step(&other);
+
+    test_memory[0x0200] = 0xA9; /* LDA #$11 */
+    test_memory[0x0201] = 0x11;
+    test_memory[0x0202] = 0x85; /* STA $10 */
+    test_memory[0x0203] = 0x10;
+    other_memory[0x0300] = 0xA9; /* LDA #$22 */
+    other_memory[0x0301] = 0x22;
+    other_memory[0x0302] = 0x85; /* STA $10 */
+    other_memory[0x0303] = 0x10;
+    cpu_run_instructions(&test_cpu, 2);
+    cpu_run_instructions(&other, 2);
+
+    if (test_memory[0x10] != 0x11 || other_memory[0x10] != 0x22) {
+        fail("Context callbacks", "Each CPU should use its own userdata");
+        return;
+    }
+
+    /* The plain callbacks still work when no context callbacks are set */
+    test_reset_cpu();
+    test_cpu.read_ctx = NULL;
+    test_cpu.write_ctx = NULL;
+    test_cpu.read = legacy_read;
+    test_cpu.write = legacy_write;
+    test_memory[0x0200] = 0xA9; /* LDA #$33 */
+    test_memory[0x0201] = 0x33;
+    test_memory[0x0202] = 0x85; /* STA $10 */
+    test_memory[0x0203] = 0x10;
+    cpu_run_instructions(&test_cpu, 2);
+    test_cpu.read = NULL;
+    test_cpu.write = NULL;
+    test_cpu.read_ctx = test_read;
+    test_cpu.write_ctx = test_write;
+
+    if (test_memory[0x10] != 0x33) {
+        fail("Context callbacks", "Plain callbacks should still be used");
+        return;
+    }
+
+    pass("Context callbacks");
+}
+
 /* Main test runner */
 int main(void) {
     printf("6502 Emulator Test Suite\n");
@@ -1169,10 +1635,20 @@ int main(void) {
     test_irq();
     test_nmi();
     test_irq_masking();
+    test_irq_line();
     test_interrupt_priority();
     test_shift_rotate_memory();
     test_zero_page_wrapping();
     test_pla_flags();
+    test_cycles();
+    test_run_budget();
+    test_profile();
+    test_call_callback();
+#if defined(V6502C_STATS)
+    test_stats();
+    test_stats_tracing();
+#endif
+    test_context_callbacks();
 
     test_cleanup();
     
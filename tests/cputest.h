@@ -46,9 +46,9 @@ void test_init(void);
 void test_cleanup(void);
 void test_reset_cpu(void);
 
-/* Memory simulation */
-byte test_read(address a);
-void test_write(address a, byte b);
+/* Memory simulation, userdata points at the memory array */
+byte test_read(void *userdata, address a);
+void test_write(void *userdata, address a, byte b);
 
 /* Individual test functions */
 void test_adc_binary(void);
@@ -24,9 +24,22 @@
  * Comprehensive tests for emulated peripheral devices
  */
 
+/* Enable POSIX functions like fdopen and pipe in strict ANSI mode */
+#define _XOPEN_SOURCE 600
+
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <utime.h>
 #include "devices.h"
+#include "vmachine.h"
+#include "vstate.h"
+#include "vreplay.h"
+#include "vhistory.h"
+#include "vrom.h"
+#include "vtrace.h"
+#include "vcalls.h"
 
 /* ANSI color codes for terminal output */
 #define COLOR_GREEN "\033[32m"
@@ -216,8 +229,9 @@ static void test_acia_data_write(void) {
         return;
     }
 
-    /* Write a character */
+    /* Write a character, output is buffered until flushed */
     acia_write(dev, ACIA_REG_DATA, 'X');
+    acia_flush(dev);
 
     /* Close the file and reopen to read */
     fclose(out);
@@ -245,6 +259,355 @@ static void test_acia_data_write(void) {
     pass("ACIA data write");
 }
 
+/* Helper to read back the size of a file */
+static long file_size(FILE *f) {
+    fflush(f);
+    fseek(f, 0, SEEK_END);
+    return ftell(f);
+}
+
+/* Test ACIA transmit buffering */
+static void test_acia_tx_buffer(void) {
+    acia_t *dev;
+    FILE *out;
+    int i;
+
+    out = tmpfile();
+    if (out == NULL) {
+        fail("ACIA TX buffer", "Failed to create temp file");
+        return;
+    }
+    dev = acia_create(NULL, out);
+    if (dev == NULL) {
+        fail("ACIA TX buffer", "Failed to create ACIA");
+        fclose(out);
+        return;
+    }
+
+    /* Bytes are queued, not written */
+    acia_write(dev, ACIA_REG_DATA, 'A');
+    acia_write(dev, ACIA_REG_DATA, 'B');
+    if (acia_tx_pending(dev) != 2 || file_size(out) != 0) {
+        fail("ACIA TX buffer", "Bytes should be queued until flushed");
+        acia_destroy(dev);
+        fclose(out);
+        return;
+    }
+
+    /* A line ending flushes the line */
+    acia_write(dev, ACIA_REG_DATA, '\r');
+    if (acia_tx_pending(dev) != 0 || file_size(out) != 3) {
+        fail("ACIA TX buffer", "Line ending should flush the buffer");
+        acia_destroy(dev);
+        fclose(out);
+        return;
+    }
+
+    /* A full buffer is flushed to make room */
+    dev->tx_flush_newline = 0;
+    for (i = 0; i < ACIA_TX_BUFFER_SIZE + 10; i++) {
+        acia_write(dev, ACIA_REG_DATA, '\n');
+    }
+    if (acia_tx_pending(dev) != 10 ||
+        file_size(out) != 3 + ACIA_TX_BUFFER_SIZE) {
+        fail("ACIA TX buffer", "Full buffer should be flushed");
+        acia_destroy(dev);
+        fclose(out);
+        return;
+    }
+
+    /* Destroying the ACIA writes out what is left */
+    acia_destroy(dev);
+    if (file_size(out) != 3 + ACIA_TX_BUFFER_SIZE + 10) {
+        fail("ACIA TX buffer", "Destroy should flush the buffer");
+        fclose(out);
+        return;
+    }
+
+    fclose(out);
+    pass("ACIA TX buffer");
+}
+
+/* Helper to open a pipe as a FILE pair with some data already written */
+static int open_input_pipe(FILE **in, int *write_fd, const char *data) {
+    int fds[2];
+
+    if (pipe(fds) != 0) return 0;
+    *in = fdopen(fds[0], "r");
+    if (*in == NULL) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    *write_fd = fds[1];
+    if (write(fds[1], data, strlen(data)) != (ssize_t)strlen(data)) {
+        fclose(*in);
+        close(fds[1]);
+        return 0;
+    }
+    return 1;
+}
+
+/* Test the ACIA receive FIFO */
+static void test_acia_rx_fifo(void) {
+    acia_t *dev;
+    FILE *in;
+    int write_fd;
+    byte status;
+
+    if (!open_input_pipe(&in, &write_fd, "HELLO")) {
+        fail("ACIA RX FIFO", "Failed to create pipe");
+        return;
+    }
+    dev = acia_create(in, NULL);
+    if (dev == NULL) {
+        fail("ACIA RX FIFO", "Failed to create ACIA");
+        fclose(in);
+        close(write_fd);
+        return;
+    }
+
+    /* Input is not seen until it is pumped */
+    status = acia_read(dev, ACIA_REG_STATUS);
+    if (status & ACIA_STATUS_RDRF) {
+        fail("ACIA RX FIFO", "Status should not read the input itself");
+        acia_destroy(dev);
+        fclose(in);
+        close(write_fd);
+        return;
+    }
+
+    /* One pump reads everything waiting */
+    if (acia_pump(dev) != 5 || !dev->rx_full || dev->rx_count != 4) {
+        fail("ACIA RX FIFO", "Pump should read all waiting input");
+        acia_destroy(dev);
+        fclose(in);
+        close(write_fd);
+        return;
+    }
+
+    /* Bytes come out in order without overruns */
+    if (acia_read(dev, ACIA_REG_DATA) != 'H' ||
+        acia_read(dev, ACIA_REG_DATA) != 'E' ||
+        acia_read(dev, ACIA_REG_DATA) != 'L' ||
+        acia_read(dev, ACIA_REG_DATA) != 'L' ||
+        acia_read(dev, ACIA_REG_DATA) != 'O' ||
+        (acia_read(dev, ACIA_REG_STATUS) & (ACIA_STATUS_RDRF | ACIA_STATUS_OVR))) {
+        fail("ACIA RX FIFO", "FIFO should deliver every byte in order");
+        acia_destroy(dev);
+        fclose(in);
+        close(write_fd);
+        return;
+    }
+
+    acia_destroy(dev);
+    fclose(in);
+    close(write_fd);
+    pass("ACIA RX FIFO");
+}
+
+/* Test ACIA overrun with the FIFO disabled */
+static void test_acia_overrun(void) {
+    acia_t *dev;
+    FILE *in;
+    int write_fd;
+
+    if (!open_input_pipe(&in, &write_fd, "XYZ")) {
+        fail("ACIA overrun", "Failed to create pipe");
+        return;
+    }
+    dev = acia_create(in, NULL);
+    if (dev == NULL) {
+        fail("ACIA overrun", "Failed to create ACIA");
+        fclose(in);
+        close(write_fd);
+        return;
+    }
+    dev->rx_fifo_enabled = 0;
+
+    /* Only the first byte fits in the data register */
+    acia_pump(dev);
+    if (!(acia_read(dev, ACIA_REG_STATUS) & ACIA_STATUS_OVR) ||
+        dev->rx_lost != 2) {
+        fail("ACIA overrun", "Bytes arriving while full should overrun");
+        acia_destroy(dev);
+        fclose(in);
+        close(write_fd);
+        return;
+    }
+
+    /* Reading the data register returns the first byte and clears OVR */
+    if (acia_read(dev, ACIA_REG_DATA) != 'X' ||
+        (acia_read(dev, ACIA_REG_STATUS) & (ACIA_STATUS_OVR | ACIA_STATUS_RDRF))) {
+        fail("ACIA overrun", "Data read should clear the overrun");
+        acia_destroy(dev);
+        fclose(in);
+        close(write_fd);
+        return;
+    }
+
+    acia_destroy(dev);
+    fclose(in);
+    close(write_fd);
+    pass("ACIA overrun");
+}
+
+/* Test the frame length derived from the control and command registers */
+static void test_acia_frame_cycles(void) {
+    acia_t *dev = acia_create(NULL, NULL);
+    if (dev == NULL) {
+        fail("ACIA frame cycles", "Failed to create ACIA");
+        return;
+    }
+
+    /* External clock: no timing */
+    if (acia_frame_cycles(dev) != 0) {
+        fail("ACIA frame cycles", "External clock should not be timed");
+        acia_destroy(dev);
+        return;
+    }
+
+    /* 9600 baud 8N1 is 10 bits */
+    acia_write(dev, ACIA_REG_CONTROL, 0x0E);
+    if (acia_frame_cycles(dev) != 1042) {
+        fail("ACIA frame cycles", "9600 8N1 should take 1042 cycles at 1 MHz");
+        acia_destroy(dev);
+        return;
+    }
+
+    /* 300 baud, 7 data bits, parity, 2 stop bits is 11 bits */
+    acia_write(dev, ACIA_REG_CONTROL, 0xA6);
+    acia_write(dev, ACIA_REG_COMMAND, ACIA_CMD_PME | ACIA_CMD_DTR);
+    if (acia_frame_cycles(dev) != 36667) {
+        fail("ACIA frame cycles", "300 7E2 should take 36667 cycles at 1 MHz");
+        acia_destroy(dev);
+        return;
+    }
+
+    acia_destroy(dev);
+    pass("ACIA frame cycles");
+}
+
+/* Test transmit timing: TDRE stays clear while a byte waits */
+static void test_acia_tx_timing(void) {
+    acia_t *dev;
+    FILE *out;
+
+    out = tmpfile();
+    if (out == NULL) {
+        fail("ACIA TX timing", "Failed to create temp file");
+        return;
+    }
+    dev = acia_create(NULL, out);
+    if (dev == NULL) {
+        fail("ACIA TX timing", "Failed to create ACIA");
+        fclose(out);
+        return;
+    }
+    dev->timing = 1;
+    acia_write(dev, ACIA_REG_CONTROL, 0x0E);
+
+    /* The first byte goes straight to the shift register */
+    acia_sync(dev, 100);
+    acia_write(dev, ACIA_REG_DATA, 'A');
+    if (acia_tx_pending(dev) != 1 ||
+        !(acia_read(dev, ACIA_REG_STATUS) & ACIA_STATUS_TDRE)) {
+        fail("ACIA TX timing", "Idle transmitter should take the byte at once");
+        acia_destroy(dev);
+        fclose(out);
+        return;
+    }
+
+    /* The second waits for the first frame to finish */
+    acia_write(dev, ACIA_REG_DATA, 'B');
+    if (acia_tx_pending(dev) != 1 ||
+        (acia_read(dev, ACIA_REG_STATUS) & ACIA_STATUS_TDRE) ||
+        acia_next_event(dev) != 100 + 1042) {
+        fail("ACIA TX timing", "Busy transmitter should hold the byte");
+        acia_destroy(dev);
+        fclose(out);
+        return;
+    }
+
+    /* Writing again overwrites the waiting byte */
+    acia_write(dev, ACIA_REG_DATA, 'C');
+    acia_sync(dev, 100 + 1041);
+    if (acia_tx_pending(dev) != 1 || dev->tx_overwritten != 1) {
+        fail("ACIA TX timing", "Byte should wait for the whole frame");
+        acia_destroy(dev);
+        fclose(out);
+        return;
+    }
+
+    acia_sync(dev, 100 + 1042);
+    acia_flush(dev);
+    if (acia_tx_pending(dev) != 0 || file_size(out) != 2 ||
+        !(acia_read(dev, ACIA_REG_STATUS) & ACIA_STATUS_TDRE) ||
+        acia_next_event(dev) != ACIA_NO_EVENT) {
+        fail("ACIA TX timing", "Waiting byte should be sent after the frame");
+        acia_destroy(dev);
+        fclose(out);
+        return;
+    }
+
+    acia_destroy(dev);
+    fclose(out);
+    pass("ACIA TX timing");
+}
+
+/* Test receive timing: bytes arrive one frame apart */
+static void test_acia_rx_timing(void) {
+    acia_t *dev = acia_create(NULL, NULL);
+    if (dev == NULL) {
+        fail("ACIA RX timing", "Failed to create ACIA");
+        return;
+    }
+    dev->timing = 1;
+    acia_write(dev, ACIA_REG_CONTROL, 0x0E);
+
+    acia_sync(dev, 1000);
+    acia_receive(dev, 'A');
+    acia_receive(dev, 'B');
+    acia_receive(dev, 'C');
+    if ((acia_read(dev, ACIA_REG_STATUS) & ACIA_STATUS_RDRF) ||
+        acia_next_event(dev) != 1000 + 1042) {
+        fail("ACIA RX timing", "First byte should arrive after one frame");
+        acia_destroy(dev);
+        return;
+    }
+
+    acia_sync(dev, 1000 + 1042);
+    if (!(acia_read(dev, ACIA_REG_STATUS) & ACIA_STATUS_RDRF) ||
+        acia_next_event(dev) != ACIA_NO_EVENT) {
+        fail("ACIA RX timing", "Sender should wait while the data register is full");
+        acia_destroy(dev);
+        return;
+    }
+
+    /* Reading lets the sender start the next frame */
+    acia_sync(dev, 5000);
+    if (acia_read(dev, ACIA_REG_DATA) != 'A' ||
+        acia_next_event(dev) != 5000 + 1042) {
+        fail("ACIA RX timing", "Next byte should start when the data is read");
+        acia_destroy(dev);
+        return;
+    }
+
+    /* With the FIFO disabled a byte arriving while full is an overrun */
+    dev->rx_fifo_enabled = 0;
+    acia_sync(dev, 5000 + 1042);
+    acia_sync(dev, 5000 + 2084);
+    if (!(acia_read(dev, ACIA_REG_STATUS) & ACIA_STATUS_OVR) ||
+        dev->rx_lost != 1 || acia_read(dev, ACIA_REG_DATA) != 'B') {
+        fail("ACIA RX timing", "Unread data should be overrun by the next byte");
+        acia_destroy(dev);
+        return;
+    }
+
+    acia_destroy(dev);
+    pass("ACIA RX timing");
+}
+
 /* Test ACIA command and control registers */
 static void test_acia_command_control(void) {
     acia_t *dev;
@@ -285,6 +648,54 @@ static void test_acia_command_control(void) {
     pass("ACIA command/control");
 }
 
+/* Test the ACIA receiver interrupt */
+static void test_acia_irq(void) {
+    acia_t *dev;
+
+    dev = acia_create(NULL, NULL);
+    if (dev == NULL) {
+        fail("ACIA IRQ", "Failed to create ACIA");
+        return;
+    }
+
+    /* Interrupts are disabled after reset */
+    dev->rx_full = 1;
+    if (acia_irq_enabled(dev) || acia_irq_pending(dev)) {
+        fail("ACIA IRQ", "IRQ should be disabled after reset");
+        acia_destroy(dev);
+        return;
+    }
+
+    /* DTR with IRD clear enables the receiver interrupt */
+    acia_write(dev, ACIA_REG_COMMAND, ACIA_CMD_DTR);
+    if (!acia_irq_pending(dev) ||
+        !(acia_read(dev, ACIA_REG_STATUS) & ACIA_STATUS_IRQ)) {
+        fail("ACIA IRQ", "IRQ should be pending with data received");
+        acia_destroy(dev);
+        return;
+    }
+
+    /* Reading the data register releases the interrupt */
+    acia_read(dev, ACIA_REG_DATA);
+    if (acia_irq_pending(dev)) {
+        fail("ACIA IRQ", "IRQ should clear after reading data");
+        acia_destroy(dev);
+        return;
+    }
+
+    /* IRD disables the receiver interrupt */
+    acia_write(dev, ACIA_REG_COMMAND, ACIA_CMD_DTR | ACIA_CMD_IRD);
+    dev->rx_full = 1;
+    if (acia_irq_pending(dev)) {
+        fail("ACIA IRQ", "IRQ should be disabled when IRD is set");
+        acia_destroy(dev);
+        return;
+    }
+
+    acia_destroy(dev);
+    pass("ACIA IRQ");
+}
+
 /* Test ACIA with NULL device pointer */
 static void test_acia_null_device(void) {
     byte result;
@@ -619,6 +1030,112 @@ static void test_via_timer2(void) {
     pass("VIA Timer 2");
 }
 
+/* Test that advancing by many cycles matches ticking one at a time */
+static void test_via_advance(void) {
+    via_t *ticked;
+    via_t *advanced;
+    unsigned long steps[] = { 1, 3, 7, 0, 20, 5, 100, 2 };
+    unsigned long i, j;
+
+    ticked = via_create();
+    advanced = via_create();
+    if (ticked == NULL || advanced == NULL) {
+        fail("VIA advance", "Failed to create VIA");
+        via_destroy(ticked);
+        via_destroy(advanced);
+        return;
+    }
+
+    /* Timer 1 continuous with a short period, Timer 2 one-shot */
+    via_write(ticked, VIA_REG_ACR, VIA_ACR_T1_CONTINUOUS);
+    via_write(advanced, VIA_REG_ACR, VIA_ACR_T1_CONTINUOUS);
+    via_write(ticked, VIA_REG_T1CL, 0x05);
+    via_write(advanced, VIA_REG_T1CL, 0x05);
+    via_write(ticked, VIA_REG_T1CH, 0x00);
+    via_write(advanced, VIA_REG_T1CH, 0x00);
+    via_write(ticked, VIA_REG_T2CL, 0x30);
+    via_write(advanced, VIA_REG_T2CL, 0x30);
+    via_write(ticked, VIA_REG_T2CH, 0x00);
+    via_write(advanced, VIA_REG_T2CH, 0x00);
+
+    for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        for (j = 0; j < steps[i]; j++) {
+            via_tick(ticked);
+        }
+        via_advance(advanced, steps[i]);
+
+        if (ticked->t1_counter != advanced->t1_counter ||
+            ticked->t2_counter != advanced->t2_counter ||
+            ticked->t1_running != advanced->t1_running ||
+            ticked->t2_running != advanced->t2_running ||
+            ticked->ifr != advanced->ifr) {
+            fail("VIA advance", "State differs from ticking one cycle at a time");
+            via_destroy(ticked);
+            via_destroy(advanced);
+            return;
+        }
+
+        /* Acknowledge interrupts so later expiries are visible */
+        via_write(ticked, VIA_REG_IFR, 0x7F);
+        via_write(advanced, VIA_REG_IFR, 0x7F);
+    }
+
+    via_destroy(ticked);
+    via_destroy(advanced);
+    pass("VIA advance");
+}
+
+/* Test syncing to a cycle count and predicting the next expiry */
+static void test_via_sync(void) {
+    via_t *dev;
+
+    dev = via_create();
+    if (dev == NULL) {
+        fail("VIA sync", "Failed to create VIA");
+        return;
+    }
+
+    if (via_next_event(dev) != VIA_NO_EVENT) {
+        fail("VIA sync", "Idle VIA should have no event");
+        via_destroy(dev);
+        return;
+    }
+
+    /* Start Timer 1 with a count of 0x0100 at cycle 1000 */
+    via_sync(dev, 1000);
+    via_write(dev, VIA_REG_T1CL, 0x00);
+    via_write(dev, VIA_REG_T1CH, 0x01);
+    if (via_next_event(dev) != 1000 + 0x0100 + 1) {
+        fail("VIA sync", "Timer 1 expiry should be scheduled at write time");
+        via_destroy(dev);
+        return;
+    }
+
+    /* Counter is derived from the cycle count */
+    via_sync(dev, 1010);
+    if (dev->t1_counter != 0x0100 - 10) {
+        fail("VIA sync", "Counter should count down by elapsed cycles");
+        via_destroy(dev);
+        return;
+    }
+
+    via_sync(dev, via_next_event(dev));
+    if (!(dev->ifr & VIA_INT_T1) || dev->t1_running) {
+        fail("VIA sync", "Timer 1 should expire at the scheduled cycle");
+        via_destroy(dev);
+        return;
+    }
+
+    if (via_next_event(dev) != VIA_NO_EVENT) {
+        fail("VIA sync", "Expired one-shot timer should have no event");
+        via_destroy(dev);
+        return;
+    }
+
+    via_destroy(dev);
+    pass("VIA sync");
+}
+
 /* Test VIA interrupt enable register */
 static void test_via_ier(void) {
     via_t *dev;
@@ -1197,32 +1714,1411 @@ static void test_fileio_null_device(void) {
 
 /*
  * ============================================================================
- * Main test runner
+ * vMachine Memory Map Tests
  * ============================================================================
  */
 
-int main(void) {
-    printf("Device Emulation Test Suite\n");
-    printf("============================\n\n");
+static vmachine_t test_machine;
 
-    printf("--- ACIA (6551) Tests ---\n");
-    test_acia_create_destroy();
-    test_acia_reset();
-    test_acia_status();
-    test_acia_data_read();
-    test_acia_data_write();
-    test_acia_command_control();
-    test_acia_null_device();
+/* Test RAM, ROM and I/O page dispatch through the page table */
+static void test_machine_memory_map(void) {
+    vmachine_config_t config;
+    byte rom[4] = { 0x11, 0x22, 0x33, 0x44 };
 
-    printf("\n--- VIA (6522) Tests ---\n");
-    test_via_create_destroy();
-    test_via_reset();
-    test_via_ports();
-    test_via_timer1();
-    test_via_timer1_continuous();
-    test_via_timer2();
-    test_via_ier();
-    test_via_ifr();
+    memset(&config, 0, sizeof(config));
+    config.rom_data = rom;
+    config.rom_size = sizeof(rom);
+    init_vmachine(&test_machine, &config);
+
+    /* RAM is readable and writable */
+    machine_write(&test_machine, 0x1234, 0x5A);
+    if (machine_read(&test_machine, 0x1234) != 0x5A ||
+        test_machine.mem[0x1234] != 0x5A) {
+        fail("Machine memory map", "RAM write should be read back");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* ROM is readable but writes are ignored */
+    machine_write(&test_machine, VMACHINE_ROM_START + 1, 0xFF);
+    if (machine_read(&test_machine, VMACHINE_ROM_START + 1) != 0x22) {
+        fail("Machine memory map", "ROM write should be ignored");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* Device registers are routed to the VIA */
+    machine_write(&test_machine, 0xC030 + VIA_REG_DDRA, 0xA5);
+    if (test_machine.mem[0xC030 + VIA_REG_DDRA] != 0x00 ||
+        machine_read(&test_machine, 0xC030 + VIA_REG_DDRA) != 0xA5) {
+        fail("Machine memory map", "VIA register should be handled by the VIA");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* Unmapped addresses in the I/O page fall through to memory */
+    machine_write(&test_machine, 0xC080, 0x77);
+    if (machine_read(&test_machine, 0xC080) != 0x77) {
+        fail("Machine memory map", "Unmapped I/O address should act as RAM");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    pass("Machine memory map");
+}
+
+/* Test that VIA timers follow the CPU cycle count */
+static void test_machine_via_events(void) {
+    vmachine_config_t config;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+
+    if (test_machine.next_event != VIA_NO_EVENT) {
+        fail("Machine VIA events", "Idle machine should have no event");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* Start Timer 1 with a count of 0x0040 */
+    test_machine.c.cycles = 500;
+    machine_write(&test_machine, 0xC030 + VIA_REG_T1CL, 0x40);
+    machine_write(&test_machine, 0xC030 + VIA_REG_T1CH, 0x00);
+    if (test_machine.next_event != 500 + 0x40 + 1) {
+        fail("Machine VIA events", "Starting a timer should schedule an event");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* Reading the counter brings the timer up to date */
+    test_machine.c.cycles = 516;
+    if (machine_read(&test_machine, 0xC030 + VIA_REG_T1CL) != 0x30) {
+        fail("Machine VIA events", "Counter should be derived from the cycle count");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* Ticking before the event leaves the VIA alone */
+    test_machine.c.cycles = 520;
+    machine_tick(&test_machine);
+    if (test_machine.via->clock != 516) {
+        fail("Machine VIA events", "Tick before the event should not sync the VIA");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* Ticking at the event expires the timer */
+    test_machine.c.cycles = 500 + 0x40 + 1;
+    machine_tick(&test_machine);
+    if (!(test_machine.via->ifr & VIA_INT_T1) ||
+        test_machine.next_event != VIA_NO_EVENT) {
+        fail("Machine VIA events", "Tick at the event should expire the timer");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    pass("Machine VIA events");
+}
+
+/* Test that a VIA timer interrupt wakes a CPU waiting in WAI */
+static void test_machine_irq(void) {
+    vmachine_config_t config;
+    byte program[] = {
+        0xA9, 0xC0,       /* LDA #$C0   */
+        0x8D, 0x3E, 0xC0, /* STA $C03E  enable T1 interrupt */
+        0xA9, 0x20,       /* LDA #$20   */
+        0x8D, 0x34, 0xC0, /* STA $C034  */
+        0xA9, 0x00,       /* LDA #$00   */
+        0x8D, 0x35, 0xC0, /* STA $C035  start T1 */
+        0x58,             /* CLI        */
+        0xCB,             /* WAI        */
+        0xDB              /* STP        */
+    };
+    byte handler[] = {
+        0xAD, 0x34, 0xC0, /* LDA $C034  acknowledge T1 */
+        0xE6, 0x10,       /* INC $10    */
+        0x40              /* RTI        */
+    };
+    int i;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+    memcpy(&test_machine.mem[0x0200], program, sizeof(program));
+    memcpy(&test_machine.mem[0x0300], handler, sizeof(handler));
+    test_machine.mem[0xFFFC] = 0x00;
+    test_machine.mem[0xFFFD] = 0x02;
+    test_machine.mem[0xFFFE] = 0x00;
+    test_machine.mem[0xFFFF] = 0x03;
+    cpu_reset(&test_machine.c);
+
+    for (i = 0; i < 100 && !test_machine.c.stopped; i++) {
+        cpu_step(&test_machine.c);
+        machine_tick(&test_machine);
+    }
+
+    if (test_machine.mem[0x10] != 1) {
+        fail("Machine IRQ", "Timer interrupt should run the handler once");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+    if (!test_machine.c.stopped || test_machine.c.irq_line) {
+        fail("Machine IRQ", "CPU should resume after WAI with the IRQ line released");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    pass("Machine IRQ");
+}
+
+/* Test that bounded machine slices run VIA timer interrupts on time */
+static void test_machine_run_cycles(void) {
+    vmachine_config_t config;
+    byte program[] = {
+        0xA9, 0x40,       /* LDA #$40   */
+        0x8D, 0x3B, 0xC0, /* STA $C03B  T1 free-running */
+        0xA9, 0xC0,       /* LDA #$C0   */
+        0x8D, 0x3E, 0xC0, /* STA $C03E  enable T1 interrupt */
+        0xA9, 0x00,       /* LDA #$00   */
+        0x8D, 0x34, 0xC0, /* STA $C034  */
+        0xA9, 0x10,       /* LDA #$10   */
+        0x8D, 0x35, 0xC0, /* STA $C035  start T1, $1000 cycles */
+        0x58,             /* CLI        */
+        0xE8,             /* INX        spin without touching I/O */
+        0x4C, 0x15, 0x02  /* JMP $0215  */
+    };
+    byte handler[] = {
+        0xAD, 0x34, 0xC0, /* LDA $C034  acknowledge T1 */
+        0xE6, 0x10,       /* INC $10    */
+        0x40              /* RTI        */
+    };
+    byte wait_program[] = {
+        0xA9, 0xC0,       /* LDA #$C0   */
+        0x8D, 0x3E, 0xC0, /* STA $C03E  enable T1 interrupt */
+        0xA9, 0x00,       /* LDA #$00   */
+        0x8D, 0x34, 0xC0, /* STA $C034  */
+        0xA9, 0x40,       /* LDA #$40   */
+        0x8D, 0x35, 0xC0, /* STA $C035  start T1, $4000 cycles */
+        0x58,             /* CLI        */
+        0xCB,             /* WAI        */
+        0xDB              /* STP        */
+    };
+    enum cpu_exit_t reason;
+    count_t start;
+    int i;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+    memcpy(&test_machine.mem[0x0200], program, sizeof(program));
+    memcpy(&test_machine.mem[0x0300], handler, sizeof(handler));
+    test_machine.mem[0xFFFC] = 0x00;
+    test_machine.mem[0xFFFD] = 0x02;
+    test_machine.mem[0xFFFE] = 0x00;
+    test_machine.mem[0xFFFF] = 0x03;
+    cpu_reset(&test_machine.c);
+
+    /* 40 slices of 1000 cycles cover about ten timer periods */
+    for (i = 0; i < 40; i++) {
+        reason = machine_run_cycles(&test_machine, 1000);
+        if (reason != CPU_EXIT_BUDGET) {
+            fail("Machine run cycles", "Slices should end with the budget used up");
+            cleanup_vmachine(&test_machine);
+            return;
+        }
+    }
+    if (test_machine.mem[0x10] < 8 || test_machine.mem[0x10] > 10) {
+        fail("Machine run cycles", "Timer interrupts should run without guest I/O");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+    cleanup_vmachine(&test_machine);
+
+    /* A CPU waiting for the timer skips ahead to it */
+    init_vmachine(&test_machine, &config);
+    memcpy(&test_machine.mem[0x0200], wait_program, sizeof(wait_program));
+    memcpy(&test_machine.mem[0x0300], handler, sizeof(handler));
+    test_machine.mem[0xFFFC] = 0x00;
+    test_machine.mem[0xFFFD] = 0x02;
+    test_machine.mem[0xFFFE] = 0x00;
+    test_machine.mem[0xFFFF] = 0x03;
+    cpu_reset(&test_machine.c);
+    start = test_machine.c.cycles;
+    reason = machine_run_cycles(&test_machine, 100000);
+    if (reason != CPU_EXIT_STOPPED || test_machine.mem[0x10] != 1 ||
+        test_machine.c.cycles - start < 0x4000 ||
+        test_machine.c.cycles - start > 0x4000 + 100) {
+        fail("Machine run cycles", "WAI should skip ahead to the timer interrupt");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    pass("Machine run cycles");
+}
+
+/* Test that slices make progress while blocked output is retried at once */
+static void test_machine_run_cycles_blocked(void) {
+    vmachine_config_t config;
+    byte program[] = {
+        0xA9, 0x58,       /* LDA #'X'   */
+        0x8D, 0x10, 0xC0, /* STA $C010  */
+        0x4C, 0x00, 0x02  /* JMP $0200  */
+    };
+    byte fill[512];
+    FILE *out;
+    int fds[2];
+    count_t start;
+    int i;
+
+    if (pipe(fds) != 0) {
+        fail("Machine run cycles blocked", "Failed to create pipe");
+        return;
+    }
+    /* Fill the pipe so every flush fails with EAGAIN */
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    memset(fill, 'F', sizeof(fill));
+    while (write(fds[1], fill, sizeof(fill)) > 0) {
+    }
+    out = fdopen(fds[1], "w");
+    if (out == NULL) {
+        fail("Machine run cycles blocked", "Failed to open pipe");
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.acia1_output = out;
+    init_vmachine(&test_machine, &config);
+    memcpy(&test_machine.mem[0x0200], program, sizeof(program));
+    test_machine.c.pc = 0x0200;
+    test_machine.tx_latency = 0;
+
+    /* Each slice after the first starts with the retry already due */
+    start = test_machine.c.cycles;
+    for (i = 0; i < 10; i++) {
+        if (machine_run_cycles(&test_machine, 1000) != CPU_EXIT_BUDGET) break;
+    }
+    if (i < 10 || test_machine.c.cycles - start < 10000) {
+        fail("Machine run cycles blocked", "Slices should run their budget");
+    } else {
+        pass("Machine run cycles blocked");
+    }
+
+    cleanup_vmachine(&test_machine);
+    fclose(out);
+    close(fds[0]);
+}
+
+/* Test that a guest spinning on ACIA status idles the host */
+static void test_machine_host_idle(void) {
+    vmachine_config_t config;
+    byte program[] = {
+        0xAD, 0x11, 0xC0, /* LDA $C011 */
+        0x29, 0x08,       /* AND #$08  */
+        0xF0, 0xF9        /* BEQ $0200 */
+    };
+    count_t start;
+    int i;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+    memcpy(&test_machine.mem[0x0200], program, sizeof(program));
+    test_machine.c.pc = 0x0200;
+
+    /* Without idle detection the clock only advances by instructions */
+    test_machine.host_idle = FALSE;
+    start = test_machine.c.cycles;
+    for (i = 0; i < 3 * VMACHINE_IDLE_POLLS; i++) {
+        cpu_step(&test_machine.c);
+    }
+    if (test_machine.c.cycles - start > 3 * 9 * VMACHINE_IDLE_POLLS) {
+        fail("Machine host idle", "Clock should not skip with idle detection off");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* With it, the host sleeps and the clock moves forward by the time slept */
+    test_machine.host_idle = TRUE;
+    start = test_machine.c.cycles;
+    for (i = 0; i < 3 * VMACHINE_IDLE_POLLS; i++) {
+        cpu_step(&test_machine.c);
+    }
+    if (test_machine.c.cycles - start < (count_t)VMACHINE_IDLE_MAX_MS * 1000) {
+        fail("Machine host idle", "Spinning guest should idle the host");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* At 500kHz a millisecond slept is 500 cycles */
+    test_machine.clock_khz = 500;
+    start = test_machine.c.cycles;
+    for (i = 0; i < 3 * VMACHINE_IDLE_POLLS; i++) {
+        cpu_step(&test_machine.c);
+    }
+    if (test_machine.c.cycles - start < (count_t)VMACHINE_IDLE_MAX_MS * 500 ||
+        test_machine.c.cycles - start > (count_t)VMACHINE_IDLE_MAX_MS * 500 + 9 * VMACHINE_IDLE_POLLS) {
+        fail("Machine host idle", "Time slept should be counted at the clock speed");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    pass("Machine host idle");
+}
+
+/* Test that the host idles while host input is attached and polled */
+static void test_machine_host_idle_input(void) {
+    vmachine_config_t config;
+    byte program[] = {
+        0xAD, 0x11, 0xC0, /* LDA $C011 */
+        0x29, 0x08,       /* AND #$08  */
+        0xF0, 0xF9        /* BEQ $0200 */
+    };
+    FILE *in;
+    int write_fd;
+    count_t start;
+    int i;
+
+    if (!open_input_pipe(&in, &write_fd, "")) {
+        fail("Machine host idle with input", "Failed to create pipe");
+        return;
+    }
+    memset(&config, 0, sizeof(config));
+    config.acia1_input = in;
+    init_vmachine(&test_machine, &config);
+    memcpy(&test_machine.mem[0x0200], program, sizeof(program));
+    test_machine.c.pc = 0x0200;
+    test_machine.host_idle = TRUE;
+
+    /* The input poll is always due soon, it must not cut the sleep short */
+    start = test_machine.c.cycles;
+    for (i = 0; i < 3 * VMACHINE_IDLE_POLLS; i++) {
+        cpu_step(&test_machine.c);
+        machine_tick(&test_machine);
+    }
+    if (test_machine.c.cycles - start < (count_t)VMACHINE_IDLE_MAX_MS * 1000) {
+        fail("Machine host idle with input", "Spinning guest should idle the host");
+    } else {
+        pass("Machine host idle with input");
+    }
+
+    cleanup_vmachine(&test_machine);
+    fclose(in);
+    close(write_fd);
+}
+
+/* Test that a guest waiting for input that has run out is halted */
+static void test_machine_halt_at_eof(void) {
+    vmachine_config_t config;
+    byte program[] = {
+        0xAD, 0x11, 0xC0, /* LDA $C011 */
+        0x29, 0x08,       /* AND #$08  */
+        0xF0, 0xF9,       /* BEQ $0200 */
+        0xAD, 0x10, 0xC0, /* LDA $C010 */
+        0x8D, 0x00, 0x03, /* STA $0300 */
+        0x4C, 0x00, 0x02  /* JMP $0200 */
+    };
+    FILE *in;
+    long i;
+
+    in = tmpfile();
+    if (in == NULL) {
+        fail("Machine halt at EOF", "Failed to create temp file");
+        return;
+    }
+    fputs("AB", in);
+    rewind(in);
+
+    memset(&config, 0, sizeof(config));
+    config.acia1_input = in;
+    init_vmachine(&test_machine, &config);
+    memcpy(&test_machine.mem[0x0200], program, sizeof(program));
+    test_machine.c.pc = 0x0200;
+    test_machine.host_idle = FALSE;
+    test_machine.halt_at_eof = TRUE;
+
+    for (i = 0; i < 100000 && !test_machine.c.halted; i++) {
+        cpu_step(&test_machine.c);
+        machine_tick(&test_machine);
+    }
+    if (!test_machine.c.halted) {
+        fail("Machine halt at EOF", "CPU should halt once the input has run out");
+    } else if (test_machine.mem[0x0300] != 'B') {
+        fail("Machine halt at EOF", "CPU should read all of the input first");
+    } else if (!test_machine.acia1->input_eof) {
+        fail("Machine halt at EOF", "ACIA should report the end of the input");
+    } else {
+        pass("Machine halt at EOF");
+    }
+
+    cleanup_vmachine(&test_machine);
+    fclose(in);
+}
+
+/* Test that buffered output is flushed within the latency bound */
+static void test_machine_tx_latency(void) {
+    vmachine_config_t config;
+    FILE *out;
+
+    out = tmpfile();
+    if (out == NULL) {
+        fail("Machine TX latency", "Failed to create temp file");
+        return;
+    }
+    memset(&config, 0, sizeof(config));
+    config.acia1_output = out;
+    init_vmachine(&test_machine, &config);
+
+    test_machine.c.cycles = 100;
+    machine_write(&test_machine, 0xC010 + ACIA_REG_DATA, 'Z');
+    if (test_machine.next_event != 100 + VMACHINE_TX_LATENCY) {
+        fail("Machine TX latency", "Buffered output should schedule a flush");
+        cleanup_vmachine(&test_machine);
+        fclose(out);
+        return;
+    }
+
+    test_machine.c.cycles = 100 + VMACHINE_TX_LATENCY - 1;
+    machine_tick(&test_machine);
+    if (acia_tx_pending(test_machine.acia1) != 1) {
+        fail("Machine TX latency", "Output should stay buffered before the deadline");
+        cleanup_vmachine(&test_machine);
+        fclose(out);
+        return;
+    }
+
+    test_machine.c.cycles = 100 + VMACHINE_TX_LATENCY;
+    machine_tick(&test_machine);
+    if (acia_tx_pending(test_machine.acia1) != 0 || file_size(out) != 1 ||
+        test_machine.next_event != VMACHINE_NO_EVENT) {
+        fail("Machine TX latency", "Output should be flushed at the deadline");
+        cleanup_vmachine(&test_machine);
+        fclose(out);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    fclose(out);
+    pass("Machine TX latency");
+}
+
+/* Test that a waiting ACIA byte is sent when its frame is due */
+static void test_machine_acia_timing(void) {
+    vmachine_config_t config;
+    FILE *out;
+
+    out = tmpfile();
+    if (out == NULL) {
+        fail("Machine ACIA timing", "Failed to create temp file");
+        return;
+    }
+    memset(&config, 0, sizeof(config));
+    config.acia1_output = out;
+    init_vmachine(&test_machine, &config);
+    test_machine.acia1->timing = 1;
+
+    test_machine.c.cycles = 100;
+    machine_write(&test_machine, 0xC010 + ACIA_REG_CONTROL, 0x0E);
+    machine_write(&test_machine, 0xC010 + ACIA_REG_DATA, 'A');
+    machine_write(&test_machine, 0xC010 + ACIA_REG_DATA, 'B');
+    if (test_machine.next_event != 100 + 1042 ||
+        acia_tx_pending(test_machine.acia1) != 1) {
+        fail("Machine ACIA timing", "End of the frame should be scheduled");
+        cleanup_vmachine(&test_machine);
+        fclose(out);
+        return;
+    }
+
+    test_machine.c.cycles = 100 + 1042;
+    machine_tick(&test_machine);
+    if (acia_tx_pending(test_machine.acia1) != 2 ||
+        test_machine.next_event != 100 + VMACHINE_TX_LATENCY) {
+        fail("Machine ACIA timing", "Waiting byte should be sent on schedule");
+        cleanup_vmachine(&test_machine);
+        fclose(out);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    fclose(out);
+    pass("Machine ACIA timing");
+}
+
+/* Test that host input is pumped into the ACIA on schedule */
+static void test_machine_rx_pump(void) {
+    vmachine_config_t config;
+    FILE *in;
+    int write_fd;
+
+    if (!open_input_pipe(&in, &write_fd, "K")) {
+        fail("Machine RX pump", "Failed to create pipe");
+        return;
+    }
+    memset(&config, 0, sizeof(config));
+    config.acia1_input = in;
+    init_vmachine(&test_machine, &config);
+
+    if (test_machine.next_event != VMACHINE_ACIA_POLL_CYCLES) {
+        fail("Machine RX pump", "Input should be polled on a schedule");
+        cleanup_vmachine(&test_machine);
+        fclose(in);
+        close(write_fd);
+        return;
+    }
+
+    test_machine.c.cycles = VMACHINE_ACIA_POLL_CYCLES;
+    machine_tick(&test_machine);
+    if (!(machine_read(&test_machine, 0xC010 + ACIA_REG_STATUS) & ACIA_STATUS_RDRF) ||
+        machine_read(&test_machine, 0xC010 + ACIA_REG_DATA) != 'K') {
+        fail("Machine RX pump", "Pumped input should be received");
+        cleanup_vmachine(&test_machine);
+        fclose(in);
+        close(write_fd);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    fclose(in);
+    close(write_fd);
+    pass("Machine RX pump");
+}
+
+/* Test that clones share memory until either side writes to it */
+static void test_machine_clone(void) {
+    vmachine_config_t config;
+    vmachine_t *clone;
+    vmachine_t *grandchild;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+    machine_write(&test_machine, 0x1234, 0x11);
+    machine_write(&test_machine, 0xC030 + VIA_REG_T1CL, 0x34);
+    test_machine.c.pc = 0x0400;
+
+    clone = vmachine_clone(&test_machine);
+    if (clone == NULL) {
+        fail("Machine clone", "Failed to clone machine");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+    if (machine_read(clone, 0x1234) != 0x11 || clone->c.pc != 0x0400 ||
+        clone->c.userdata != clone || clone->via == test_machine.via ||
+        machine_read(clone, 0xC030 + VIA_REG_T1LL) != 0x34) {
+        fail("Machine clone", "Clone should start as a copy of the original");
+        vmachine_destroy(clone);
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* Writes on either side are private */
+    machine_write(clone, 0x1234, 0x22);
+    machine_write(&test_machine, 0x2000, 0x33);
+    if (machine_read(&test_machine, 0x1234) != 0x11 ||
+        machine_read(clone, 0x1234) != 0x22 ||
+        machine_read(clone, 0x2000) != 0x00 ||
+        clone->shared_pages != VMACHINE_PAGES - 2) {
+        fail("Machine clone", "A written page should be copied");
+        vmachine_destroy(clone);
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* Protection is copied, and outlives the original */
+    grandchild = vmachine_clone(clone);
+    cleanup_vmachine(&test_machine);
+    vmachine_destroy(clone);
+    if (grandchild == NULL) {
+        fail("Machine clone", "Failed to clone a clone");
+        return;
+    }
+    machine_write(grandchild, 0xE000, 0x44);
+    if (machine_read(grandchild, 0xE000) != 0x00 ||
+        machine_read(grandchild, 0x1234) != 0x22 ||
+        grandchild->shared->refs != 1) {
+        fail("Machine clone", "Clone of a clone should keep memory and protection");
+        vmachine_destroy(grandchild);
+        return;
+    }
+
+    vmachine_destroy(grandchild);
+    pass("Machine clone");
+}
+
+/* Test saving and loading the machine state */
+static void test_machine_state(void) {
+    const char *filename = "/tmp/v6502c_state_test.bin";
+    vmachine_config_t config;
+    address_range ar;
+    vmachine_t *clone;
+    long size;
+    FILE *f;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+    machine_write(&test_machine, 0x0300, 0xAB);
+    machine_write(&test_machine, 0xC0F0, 0xCD);
+    machine_write(&test_machine, 0xC030 + VIA_REG_T1LL, 0x34);
+    machine_write(&test_machine, 0xC030 + VIA_REG_T1CH, 0x12);
+    acia_receive(test_machine.acia1, 'Q');
+    acia_receive(test_machine.acia1, 'R');
+    ar.start = 0x0300;
+    ar.end = 0x03FF;
+    add_protected_range(&test_machine, ar);
+    test_machine.c.pc = 0x0456;
+    test_machine.c.a = 0x78;
+    test_machine.c.cycles = 1000;
+
+    /* Only pages with data are saved */
+    size = vmachine_save_state(&test_machine, filename);
+    if (size <= 0 || size > 3 * 257 + 1024) {
+        fail("Machine state", "State should be saved sparsely");
+        cleanup_vmachine(&test_machine);
+        remove(filename);
+        return;
+    }
+
+    /* Load into a clone that has diverged */
+    clone = vmachine_clone(&test_machine);
+    cleanup_vmachine(&test_machine);
+    if (clone == NULL) {
+        fail("Machine state", "Failed to clone machine");
+        remove(filename);
+        return;
+    }
+    ar.start = 0x0000;
+    ar.end = 0xFFFF;
+    remove_protected_range(clone, ar);
+    machine_write(clone, 0x0300, 0x00);
+    machine_write(clone, 0x0400, 0x99);
+    acia_read(clone->acia1, ACIA_REG_DATA);
+    clone->c.pc = 0x0000;
+    clone->c.cycles = 5000;
+
+    if (vmachine_load_state(clone, filename) != 0) {
+        fail("Machine state", "Failed to load state");
+        vmachine_destroy(clone);
+        remove(filename);
+        return;
+    }
+    machine_write(clone, 0x0300, 0x00);
+    if (clone->c.pc != 0x0456 || clone->c.a != 0x78 || clone->c.cycles != 1000 ||
+        machine_read(clone, 0x0300) != 0xAB || machine_read(clone, 0x0400) != 0x00 ||
+        machine_read(clone, 0xC0F0) != 0xCD || machine_read(clone, 0xE000) != 0x00 ||
+        clone->via->t1_latch != 0x1234 || !clone->via->t1_running ||
+        machine_read(clone, 0xC010 + ACIA_REG_DATA) != 'Q' ||
+        machine_read(clone, 0xC010 + ACIA_REG_DATA) != 'R') {
+        fail("Machine state", "Loaded state should match the saved state");
+        vmachine_destroy(clone);
+        remove(filename);
+        return;
+    }
+
+    /* So is one with no output latency */
+    clone->tx_latency = 0;
+    if (vmachine_save_state(clone, filename) <= 0) {
+        fail("Machine state", "Failed to save state");
+        vmachine_destroy(clone);
+        remove(filename);
+        return;
+    }
+    clone->tx_latency = VMACHINE_TX_LATENCY;
+    clone->c.pc = 0x1111;
+    if (vmachine_load_state(clone, filename) != -1 || clone->c.pc != 0x1111 ||
+        clone->tx_latency != VMACHINE_TX_LATENCY) {
+        fail("Machine state", "State without output latency should be rejected");
+        vmachine_destroy(clone);
+        remove(filename);
+        return;
+    }
+    clone->c.pc = 0x0456;
+    vmachine_save_state(clone, filename);
+
+    /* A damaged file is rejected and leaves the machine alone */
+    f = fopen(filename, "r+b");
+    if (f != NULL) {
+        fseek(f, 12, SEEK_SET);
+        fputc(0xFF, f);
+        fclose(f);
+    }
+    clone->c.pc = 0x1111;
+    if (vmachine_load_state(clone, filename) != -1 || clone->c.pc != 0x1111) {
+        fail("Machine state", "Damaged state should be rejected");
+        vmachine_destroy(clone);
+        remove(filename);
+        return;
+    }
+
+    vmachine_destroy(clone);
+    remove(filename);
+    pass("Machine state");
+}
+
+/* Test dirty page tracking and delta checkpoints */
+static void test_machine_delta_state(void) {
+    const char *files[3] = {
+        "/tmp/v6502c_state_base.bin",
+        "/tmp/v6502c_state_delta1.bin",
+        "/tmp/v6502c_state_delta2.bin"
+    };
+    vmachine_config_t config;
+    long size;
+    int i;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+    for (i = 0; i < 0x4000; i++) {
+        machine_write(&test_machine, (address)(0x1000 + i), (byte)i);
+    }
+    if (!machine_page_dirty(&test_machine, 0x00) ||
+        vmachine_save_state(&test_machine, files[0]) < 0 ||
+        machine_page_dirty(&test_machine, 0x10)) {
+        fail("Machine delta state", "Saving should start a new checkpoint");
+        cleanup_vmachine(&test_machine);
+        remove(files[0]);
+        return;
+    }
+
+    /* A delta holds just the written pages, including zeroed ones */
+    machine_write(&test_machine, 0x1000, 0x00);
+    machine_write(&test_machine, 0x2345, 0x77);
+    machine_write(&test_machine, 0xE000, 0x55);
+    size = vmachine_save_delta(&test_machine, files[1]);
+    if (size < 0 || size > 1024 + 2 * 257 || machine_page_dirty(&test_machine, 0x10)) {
+        fail("Machine delta state", "Delta should hold only dirty pages");
+        cleanup_vmachine(&test_machine);
+        remove(files[0]);
+        remove(files[1]);
+        return;
+    }
+    for (i = 0; i < 0x100; i++) {
+        machine_write(&test_machine, (address)(0x1000 + i), 0x00);
+    }
+    test_machine.c.pc = 0x3456;
+    vmachine_save_delta(&test_machine, files[2]);
+    cleanup_vmachine(&test_machine);
+
+    /* A chain must start with a full state */
+    init_vmachine(&test_machine, &config);
+    if (vmachine_load_state_chain(&test_machine, &files[1], 2) != -1 ||
+        vmachine_load_state_chain(&test_machine, files, 3) != 0) {
+        fail("Machine delta state", "Chain should load from a full state only");
+        cleanup_vmachine(&test_machine);
+        for (i = 0; i < 3; i++) remove(files[i]);
+        return;
+    }
+    if (test_machine.c.pc != 0x3456 ||
+        machine_read(&test_machine, 0x1000) != 0x00 ||
+        machine_read(&test_machine, 0x10FF) != 0x00 ||
+        machine_read(&test_machine, 0x1100) != 0x00 ||
+        machine_read(&test_machine, 0x1101) != 0x01 ||
+        machine_read(&test_machine, 0x2345) != 0x77 ||
+        machine_read(&test_machine, 0x4FFF) != 0xFF ||
+        machine_read(&test_machine, 0xE000) != 0x00) {
+        fail("Machine delta state", "Chain should replay every delta");
+        cleanup_vmachine(&test_machine);
+        for (i = 0; i < 3; i++) remove(files[i]);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    for (i = 0; i < 3; i++) remove(files[i]);
+    pass("Machine delta state");
+}
+
+/* Guest that reads three bytes from ACIA 1, counting its polls */
+static const byte replay_program[] = {
+    0xAD, 0x40, 0xC0, /* LDA $C040   */
+    0x85, 0x11,       /* STA $11     */
+    0xA2, 0x00,       /* LDX #$00    */
+    0xE6, 0x10,       /* INC $10     */
+    0xAD, 0x11, 0xC0, /* LDA $C011   */
+    0x29, 0x08,       /* AND #$08    */
+    0xF0, 0xF7,       /* BEQ $0207   */
+    0xAD, 0x10, 0xC0, /* LDA $C010   */
+    0x9D, 0x00, 0x03, /* STA $0300,X */
+    0xE8,             /* INX         */
+    0xE0, 0x03,       /* CPX #$03    */
+    0xD0, 0xEC        /* BNE $0207   */
+};
+
+/*
+ * Run the replay program until it has read its input. When write_fd is
+ * open the last byte is sent only after the host has idled.
+ */
+static int run_replay_program(vmachine_t *machine, int write_fd) {
+    address done = (address)(0x0200 + sizeof(replay_program));
+    count_t before;
+    bool sent = FALSE;
+    long steps;
+
+    memcpy(&machine->mem[0x0200], replay_program, sizeof(replay_program));
+    machine->c.pc = 0x0200;
+    for (steps = 0; steps < 1000000L && machine->c.pc != done; steps++) {
+        before = machine->c.cycles;
+        cpu_step(&machine->c);
+        if (machine->c.halted) return 0;
+        if (write_fd >= 0 && !sent && machine->c.cycles - before > 1000) {
+            if (write(write_fd, "C", 1) != 1) return 0;
+            sent = TRUE;
+        }
+    }
+    return machine->c.pc == done;
+}
+
+/* Test that a recorded run replays identically without host input */
+static void test_machine_replay(void) {
+    const char *filename = "/tmp/v6502c_input.log";
+    vmachine_config_t config;
+    vmachine_t replayed;
+    vreplay_t *log;
+    FILE *in;
+    int write_fd;
+    int ok;
+
+    if (!open_input_pipe(&in, &write_fd, "AB")) {
+        fail("Machine replay", "Failed to create pipe");
+        return;
+    }
+    memset(&config, 0, sizeof(config));
+    config.acia1_input = in;
+    init_vmachine(&test_machine, &config);
+    log = vreplay_record(filename);
+    machine_set_input_log(&test_machine, log);
+    ok = run_replay_program(&test_machine, write_fd);
+    if (vreplay_close(log) != 0) ok = 0;
+    fclose(in);
+    close(write_fd);
+    if (!ok || memcmp(&test_machine.mem[0x0300], "ABC", 3) != 0) {
+        fail("Machine replay", "Recorded run should read its input");
+        cleanup_vmachine(&test_machine);
+        remove(filename);
+        return;
+    }
+
+    /* The replay has no input of its own */
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&replayed, &config);
+    log = vreplay_open(filename);
+    if (log == NULL) {
+        fail("Machine replay", "Failed to open the input log");
+        cleanup_vmachine(&test_machine);
+        cleanup_vmachine(&replayed);
+        remove(filename);
+        return;
+    }
+    machine_set_input_log(&replayed, log);
+    ok = run_replay_program(&replayed, -1);
+    if (!ok || replayed.c.cycles != test_machine.c.cycles ||
+        memcmp(replayed.mem, test_machine.mem, sizeof(replayed.mem)) != 0 ||
+        !log->done) {
+        fail("Machine replay", "Replay should match the recorded run");
+        vreplay_close(log);
+        cleanup_vmachine(&test_machine);
+        cleanup_vmachine(&replayed);
+        remove(filename);
+        return;
+    }
+
+    /* Once the log runs out a waiting guest halts */
+    replayed.c.pc = 0x0207;
+    while (!replayed.c.halted && replayed.c.cycles - test_machine.c.cycles < 1000000) {
+        cpu_step(&replayed.c);
+    }
+    vreplay_close(log);
+    if (!replayed.c.halted) {
+        fail("Machine replay", "Guest should halt at the end of the log");
+        cleanup_vmachine(&test_machine);
+        cleanup_vmachine(&replayed);
+        remove(filename);
+        return;
+    }
+
+    /* A log that cannot be written reports it when closed */
+    log = vreplay_record("/dev/full");
+    if (log != NULL) {
+        vreplay_write(log, 0, VREPLAY_INPUT, 0, (const byte *)"A", 1);
+        if (vreplay_close(log) == 0) {
+            fail("Machine replay", "Closing a log that failed to write should fail");
+            cleanup_vmachine(&test_machine);
+            cleanup_vmachine(&replayed);
+            remove(filename);
+            return;
+        }
+    }
+
+    pass("Machine replay");
+    cleanup_vmachine(&test_machine);
+    cleanup_vmachine(&replayed);
+    remove(filename);
+}
+
+/* Step the test machine as cpu_run() does */
+static void machine_step(vmachine_t *machine) {
+    cpu_step(&machine->c);
+    machine_tick(machine);
+}
+
+/* Test stepping and running backwards through the history */
+static void test_machine_history(void) {
+    vmachine_config_t config;
+    byte program[] = {
+        0xA2, 0x00,       /* LDX #$00    */
+        0x8A,             /* TXA         */
+        0x9D, 0x00, 0x03, /* STA $0300,X */
+        0xE8,             /* INX         */
+        0xD0, 0xF9        /* BNE $0202   */
+    };
+    address pcs[8];
+    count_t cycles[8];
+    count_t now;
+    int i;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+    memcpy(&test_machine.mem[0x0200], program, sizeof(program));
+    test_machine.c.pc = 0x0200;
+    machine_set_history(&test_machine, vhistory_create(64, 2, 200));
+
+    for (i = 0; i < 8; i++) {
+        pcs[i] = test_machine.c.pc;
+        cycles[i] = test_machine.c.cycles;
+        machine_step(&test_machine);
+    }
+    /* STA $0300,X was the 3rd and 7th instruction */
+    if (test_machine.mem[0x0301] != 0x01 || test_machine.history->instructions != 8) {
+        fail("Machine history", "Every instruction should be logged");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    for (i = 7; i >= 5; i--) {
+        if (!vhistory_step_back(&test_machine) || test_machine.c.pc != pcs[i] ||
+            test_machine.c.cycles != cycles[i]) {
+            fail("Machine history", "Stepping back should restore the registers");
+            cleanup_vmachine(&test_machine);
+            return;
+        }
+    }
+    if (test_machine.mem[0x0301] != 0x00 || test_machine.c.x != 0x01) {
+        fail("Machine history", "Stepping back should restore memory");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+    if (vhistory_continue_back(&test_machine, 0x0202) != VHISTORY_STOP_BREAKPOINT ||
+        test_machine.c.pc != 0x0202 || test_machine.c.x != 0x00) {
+        fail("Machine history", "Running back should stop at the address");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* The undo log stays bounded, and snapshots reach back past it */
+    for (i = 0; i < 1000; i++) {
+        machine_step(&test_machine);
+    }
+    if (test_machine.history->count > 64 || test_machine.history->instructions > 64 ||
+        test_machine.history->snapshot_count != 2) {
+        fail("Machine history", "History should stay within its bounds");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+    now = test_machine.c.cycles;
+    if (vhistory_continue_back(&test_machine, -1) != VHISTORY_STOP_SNAPSHOT ||
+        test_machine.c.cycles >= now - 64 * 2 ||
+        test_machine.mem[0x0301 + test_machine.c.x] != 0x00 ||
+        test_machine.mem[0x0300 + test_machine.c.x - 1] != test_machine.c.x - 1 ||
+        test_machine.via->clock != test_machine.c.cycles) {
+        fail("Machine history", "Running out of undo log should restore a snapshot");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    pass("Machine history");
+}
+
+/* Test the binary instruction trace */
+static void test_machine_trace(void) {
+    vmachine_config_t config;
+    const char *filename = "/tmp/v6502c_trace_test.bin";
+    byte program[] = {
+        0xA2, 0x00,       /* LDX #$00    */
+        0x8A,             /* TXA         */
+        0x9D, 0x00, 0x03, /* STA $0300,X */
+        0xE8,             /* INX         */
+        0xD0, 0xF9        /* BNE $0202   */
+    };
+    byte header[VTRACE_HEADER_SIZE];
+    byte records[10][VTRACE_RECORD_SIZE];
+    count_t cycles[8];
+    vtrace_t *trace;
+    FILE *in;
+    size_t count;
+    int i;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+    memcpy(&test_machine.mem[0x0200], program, sizeof(program));
+    test_machine.c.pc = 0x0200;
+
+    /* A three record buffer makes the writer thread swap buffers */
+    trace = vtrace_open(filename, 3 * VTRACE_RECORD_SIZE);
+    if (trace == NULL) {
+        fail("Machine trace", "Could not create the trace file");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+    machine_set_trace(&test_machine, trace);
+    for (i = 0; i < 8; i++) {
+        cycles[i] = test_machine.c.cycles;
+        machine_step(&test_machine);
+    }
+    if (trace->records != 9 || machine_set_trace(&test_machine, NULL) != 0) {
+        fail("Machine trace", "Every instruction should be traced");
+        cleanup_vmachine(&test_machine);
+        remove(filename);
+        return;
+    }
+    cleanup_vmachine(&test_machine);
+
+    in = fopen(filename, "rb");
+    if (in == NULL) {
+        fail("Machine trace", "Could not open the trace file");
+        remove(filename);
+        return;
+    }
+    count = fread(header, 1, sizeof(header), in);
+    if (count != sizeof(header) || memcmp(header, VTRACE_MAGIC, 4) != 0 ||
+        header[4] != VTRACE_VERSION || header[6] != VTRACE_RECORD_SIZE) {
+        fail("Machine trace", "The trace should start with a header");
+        fclose(in);
+        remove(filename);
+        return;
+    }
+    count = fread(records, VTRACE_RECORD_SIZE, 10, in);
+    fclose(in);
+    remove(filename);
+    /* The last record is the instruction the CPU stopped at */
+    if (count != 9) {
+        fail("Machine trace", "The trace should hold one record per instruction");
+        return;
+    }
+
+    for (i = 0; i < 8; i++) {
+        if (records[i][0] != (cycles[i] & 0xFF) || records[i][1] != 0) {
+            fail("Machine trace", "Records should hold the cycle count");
+            return;
+        }
+    }
+    /* STA $0300,X on the second pass, after INX */
+    if (records[6][8] != 0x03 || records[6][9] != 0x02 ||
+        records[6][10] != 0x01 || records[6][11] != 0x03 ||
+        records[6][12] != 0x9D || records[6][13] != 0x00 || records[6][14] != 0x03 ||
+        records[6][15] != 0x01 || records[6][16] != 0x01) {
+        fail("Machine trace", "Records should decode the instruction");
+        return;
+    }
+    /* BNE records its branch target and no third byte */
+    if (records[4][10] != 0x02 || records[4][11] != 0x02 || records[4][14] != 0x00) {
+        fail("Machine trace", "Branches should record their target");
+        return;
+    }
+
+    pass("Machine trace");
+}
+
+/* Test call graph profiling through the stack tricks msbasic uses */
+static void test_machine_calls(void) {
+    vmachine_config_t config;
+    byte main_program[] = {
+        0x20, 0x00, 0x03, /* JSR $0300   */
+        0x20, 0x00, 0x05, /* JSR $0500   */
+        0xDB              /* STP         */
+    };
+    byte a_program[] = {
+        0x20, 0x00, 0x04, /* JSR $0400   */
+        0xEA,             /* NOP         */
+        0x60              /* RTS         */
+    };
+    byte b_program[] = {
+        0x68,             /* PLA         */
+        0x68,             /* PLA         */
+        0x60              /* RTS         */
+    };
+    byte c_program[] = {
+        0xA9, 0x05,       /* LDA #$05    */
+        0x48,             /* PHA         */
+        0xA9, 0x0F,       /* LDA #$0F    */
+        0x48,             /* PHA         */
+        0x60              /* RTS         */
+    };
+    vcalls_total_t *totals;
+    char line[64];
+    FILE *out;
+    long count;
+    int found = 0;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+    memcpy(&test_machine.mem[0x0200], main_program, sizeof(main_program));
+    memcpy(&test_machine.mem[0x0300], a_program, sizeof(a_program));
+    memcpy(&test_machine.mem[0x0400], b_program, sizeof(b_program));
+    memcpy(&test_machine.mem[0x0500], c_program, sizeof(c_program));
+    test_machine.mem[0x0510] = 0xEA; /* NOP */
+    test_machine.mem[0x0511] = 0x60; /* RTS */
+    test_machine.c.pc = 0x0200;
+    machine_set_calls(&test_machine, vcalls_create());
+    cpu_run(&test_machine.c);
+
+    /* $0400 returns past $0300, and $0500 uses RTS as a jump */
+    count = vcalls_totals(test_machine.calls, &totals);
+    if (count != 3 || test_machine.calls->current != VCALLS_ROOT ||
+        totals[0].callee != 0x0500 || totals[0].inclusive != 24 ||
+        totals[0].exclusive != 24 || totals[0].calls != 1 ||
+        totals[1].callee != 0x0300 || totals[1].inclusive != 20 ||
+        totals[1].exclusive != 6 ||
+        totals[2].callee != 0x0400 || totals[2].inclusive != 14) {
+        fail("Machine calls", "Returns should unwind by the stack pointer");
+        free(totals);
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+    free(totals);
+
+    out = tmpfile();
+    vcalls_write_collapsed(test_machine.calls, out);
+    rewind(out);
+    while (fgets(line, sizeof(line), out) != NULL) {
+        if (!strcmp(line, "(root);$0300;$0400 14\n") ||
+            !strcmp(line, "(root);$0500 24\n")) {
+            found++;
+        }
+    }
+    fclose(out);
+    cleanup_vmachine(&test_machine);
+    if (found != 2) {
+        fail("Machine calls", "Should write collapsed stacks");
+        return;
+    }
+
+    pass("Machine calls");
+}
+
+/* Test protected ranges that cover only part of a page */
+static void test_machine_partial_protection(void) {
+    vmachine_config_t config;
+    address_range ar;
+
+    memset(&config, 0, sizeof(config));
+    init_vmachine(&test_machine, &config);
+
+    ar.start = 0x2010;
+    ar.end = 0x201F;
+    add_protected_range(&test_machine, ar);
+
+    machine_write(&test_machine, 0x200F, 0x01);
+    machine_write(&test_machine, 0x2010, 0x02);
+    machine_write(&test_machine, 0x201F, 0x03);
+    machine_write(&test_machine, 0x2020, 0x04);
+    if (machine_read(&test_machine, 0x200F) != 0x01 ||
+        machine_read(&test_machine, 0x2010) != 0x00 ||
+        machine_read(&test_machine, 0x201F) != 0x00 ||
+        machine_read(&test_machine, 0x2020) != 0x04) {
+        fail("Machine partial protection", "Only the protected range should ignore writes");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    remove_protected_range(&test_machine, ar);
+    machine_write(&test_machine, 0x2010, 0x02);
+    if (machine_read(&test_machine, 0x2010) != 0x02) {
+        fail("Machine partial protection", "Unprotected address should be writable");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    /* Unprotecting part of ROM makes just that part writable */
+    ar.start = 0xE000;
+    ar.end = 0xE0FF;
+    remove_protected_range(&test_machine, ar);
+    machine_write(&test_machine, 0xE000, 0x05);
+    machine_write(&test_machine, 0xE100, 0x06);
+    if (machine_read(&test_machine, 0xE000) != 0x05 ||
+        machine_read(&test_machine, 0xE100) != 0x00) {
+        fail("Machine partial protection", "Only the unprotected ROM page should be writable");
+        cleanup_vmachine(&test_machine);
+        return;
+    }
+
+    cleanup_vmachine(&test_machine);
+    pass("Machine partial protection");
+}
+
+/*
+ * ============================================================================
+ * Main test runner
+ * ============================================================================
+ */
+
+/* ROM Image Tests */
+#define ROM_TEST_WOZ "/tmp/v6502c_rom_test.woz"
+#define ROM_TEST_IMG ROM_TEST_WOZ ROM_IMAGE_SUFFIX
+
+/* Write a Wozmon file and give it a known modification time. */
+static int write_woz(const char *text, time_t mtime) {
+    struct utimbuf times;
+    FILE *f;
+
+    f = fopen(ROM_TEST_WOZ, "w");
+    if (f == NULL) return 0;
+    fputs(text, f);
+    if (fclose(f) != 0) return 0;
+    times.actime = mtime;
+    times.modtime = mtime;
+    return utime(ROM_TEST_WOZ, &times) == 0;
+}
+
+/*
+ * Open the test Wozmon file at $D000 and check its first two bytes.
+ * cached says whether it should have come from the image cache.
+ */
+static int check_woz(byte first, byte second, bool cached) {
+    rom_image_t rom;
+    int ok;
+
+    if (rom_image_open(&rom, ROM_TEST_WOZ, 0xD000, 0x3000) < 0) return 0;
+    ok = rom.size == 2 && rom.data[0] == first && rom.data[1] == second &&
+         (rom.buffer == NULL) == (cached != FALSE);
+    rom_image_close(&rom);
+    return ok;
+}
+
+static void test_rom_image_rebuild(void) {
+    remove(ROM_TEST_IMG);
+    if (!write_woz("D000: A9 01\n", 1000000) || !check_woz(0xA9, 0x01, FALSE)) {
+        fail("ROM image rebuild", "Should parse a Wozmon file without a cache");
+        remove(ROM_TEST_WOZ);
+        remove(ROM_TEST_IMG);
+        return;
+    }
+    if (!check_woz(0xA9, 0x01, TRUE)) {
+        fail("ROM image rebuild", "Should load the image written by the first open");
+        remove(ROM_TEST_WOZ);
+        remove(ROM_TEST_IMG);
+        return;
+    }
+
+    /* Same size, later modification time */
+    if (!write_woz("D000: A9 02\n", 2000000) || !check_woz(0xA9, 0x02, FALSE) ||
+        !check_woz(0xA9, 0x02, TRUE)) {
+        fail("ROM image rebuild", "Should rebuild the image when the mtime changes");
+    } else {
+        pass("ROM image rebuild");
+    }
+    remove(ROM_TEST_WOZ);
+    remove(ROM_TEST_IMG);
+}
+
+static void test_rom_image_checksum(void) {
+    FILE *f;
+    int ok;
+
+    remove(ROM_TEST_IMG);
+    ok = write_woz("D000: A9 01\n", 1000000) && check_woz(0xA9, 0x01, FALSE);
+
+    /* Damage the contents but leave the header alone */
+    f = fopen(ROM_TEST_IMG, "r+b");
+    if (!ok || f == NULL) {
+        if (f != NULL) fclose(f);
+        fail("ROM image checksum", "Failed to build the image");
+        remove(ROM_TEST_WOZ);
+        remove(ROM_TEST_IMG);
+        return;
+    }
+    fseek(f, ROM_IMAGE_HEADER_SIZE, SEEK_SET);
+    fputc(0x00, f);
+    fclose(f);
+
+    if (!check_woz(0xA9, 0x01, FALSE)) {
+        fail("ROM image checksum", "Should parse the Wozmon file when the checksum is wrong");
+    } else if (!check_woz(0xA9, 0x01, TRUE)) {
+        fail("ROM image checksum", "Should replace the damaged image");
+    } else {
+        pass("ROM image checksum");
+    }
+    remove(ROM_TEST_WOZ);
+    remove(ROM_TEST_IMG);
+}
+
+static void test_rom_image_load_address(void) {
+    rom_image_t rom;
+    int ok;
+
+    remove(ROM_TEST_IMG);
+    ok = write_woz("D000: A9 01\n", 1000000) && check_woz(0xA9, 0x01, FALSE);
+    if (!ok || rom_image_open(&rom, ROM_TEST_IMG, 0xD000, 0x3000) < 0) {
+        fail("ROM image load address", "Should open an image at its own load address");
+        remove(ROM_TEST_WOZ);
+        remove(ROM_TEST_IMG);
+        return;
+    }
+    rom_image_close(&rom);
+
+    if (rom_image_open(&rom, ROM_TEST_IMG, 0xE000, 0x2000) == 0) {
+        rom_image_close(&rom);
+        fail("ROM image load address", "Should reject an image built for another address");
+        remove(ROM_TEST_WOZ);
+        remove(ROM_TEST_IMG);
+        return;
+    }
+
+    /* A cache built for another address is parsed again */
+    if (rom_image_open(&rom, ROM_TEST_WOZ, 0xC000, 0x4000) < 0) {
+        fail("ROM image load address", "Failed to open the Wozmon file at $C000");
+    } else if (rom.buffer == NULL || rom.size != 0x1002 || rom.data[0x1000] != 0xA9) {
+        rom_image_close(&rom);
+        fail("ROM image load address", "Should not use a cache built for another address");
+    } else {
+        rom_image_close(&rom);
+        pass("ROM image load address");
+    }
+    remove(ROM_TEST_WOZ);
+    remove(ROM_TEST_IMG);
+}
+
+int main(void) {
+    printf("Device Emulation Test Suite\n");
+    printf("============================\n\n");
+
+    printf("--- ACIA (6551) Tests ---\n");
+    test_acia_create_destroy();
+    test_acia_reset();
+    test_acia_status();
+    test_acia_data_read();
+    test_acia_data_write();
+    test_acia_tx_buffer();
+    test_acia_rx_fifo();
+    test_acia_overrun();
+    test_acia_frame_cycles();
+    test_acia_tx_timing();
+    test_acia_rx_timing();
+    test_acia_command_control();
+    test_acia_irq();
+    test_acia_null_device();
+
+    printf("\n--- VIA (6522) Tests ---\n");
+    test_via_create_destroy();
+    test_via_reset();
+    test_via_ports();
+    test_via_timer1();
+    test_via_timer1_continuous();
+    test_via_timer2();
+    test_via_advance();
+    test_via_sync();
+    test_via_ier();
+    test_via_ifr();
     test_via_irq_pending();
     test_via_other_registers();
     test_via_null_device();
@@ -1238,6 +3134,32 @@ int main(void) {
     test_fileio_eof();
     test_fileio_null_device();
 
+    printf("\n--- vMachine Tests ---\n");
+    test_machine_memory_map();
+    test_machine_partial_protection();
+    test_machine_via_events();
+    test_machine_irq();
+    test_machine_run_cycles();
+    test_machine_run_cycles_blocked();
+    test_machine_host_idle();
+    test_machine_host_idle_input();
+    test_machine_halt_at_eof();
+    test_machine_tx_latency();
+    test_machine_rx_pump();
+    test_machine_acia_timing();
+    test_machine_clone();
+    test_machine_state();
+    test_machine_delta_state();
+    test_machine_replay();
+    test_machine_history();
+    test_machine_trace();
+    test_machine_calls();
+
+    printf("\n--- ROM Image Tests ---\n");
+    test_rom_image_rebuild();
+    test_rom_image_checksum();
+    test_rom_image_load_address();
+
     printf("\n============================\n");
     printf("Tests passed: %d\n", tests_passed);
     printf("Tests failed: %d\n", tests_failed);
@@ -31,170 +31,232 @@
 #include "cli.h"
 #include "vmachine.h"
 #include "monitor.h"
+#include "vrom.h"
 
 #include <signal.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <string.h>
+#include <fcntl.h>
 
 #if defined(__CREATE_PTYS__)
-#include <stdlib.h>
-#include <fcntl.h>
 #include <termios.h>
 #endif
 
+/* Only used by the signal handler, which has no other way to find it */
 vmachine_t *g_machine;
 
-/* CPU callback wrappers that use the global machine pointer */
-static void _tick(void) {
-  if (g_machine != NULL) {
-    machine_tick(g_machine);
-    usleep(1); /* Throttle to approximately 1MHz */
+static pace_t g_pace;
+
+/* Tick callback, the userdata pointer is the machine */
+static void _tick(void *userdata) {
+  vmachine_t *machine = (vmachine_t *)userdata;
+  machine_tick(machine);
+  if (machine->c.cycles - g_pace.last_cycles >= PACE_BATCH_CYCLES) {
+    pace_tick(&g_pace, machine->c.cycles);
   }
 }
 
-static byte _read(address a) {
-  if (g_machine != NULL) {
-    return machine_read(g_machine, a);
-  }
-  return 0;
+/* Nanoseconds from a to b. */
+static double _elapsed_ns(struct timespec *a, struct timespec *b) {
+  return (double)(b->tv_sec - a->tv_sec) * 1e9 +
+    (double)(b->tv_nsec - a->tv_nsec);
 }
 
-static void _write(address a, byte b) {
-  if (g_machine != NULL) {
-    machine_write(g_machine, a, b);
-  }
+void pace_init(pace_t *pace, unsigned long khz, count_t cycles) {
+  pace->khz = khz;
+  clock_gettime(CLOCK_MONOTONIC, &pace->start);
+  pace->last = pace->start;
+  pace->start_cycles = cycles;
+  pace->last_cycles = cycles;
+  pace->run_cycles = 0;
+  pace->run_seconds = 0.0;
 }
 
-void signal_handler(int sig) {
-  switch (sig) {
-  case SIGINT:
-    if (g_machine != NULL) {
-      puts("BREAK");
-      cpu_halt(&g_machine->c);
-    }
-    signal(SIGINT, signal_handler);
+void pace_tick(pace_t *pace, count_t cycles) {
+  struct timespec now, delay;
+  double batch_ns, target_ns, ahead_ns;
+
+  if (cycles < pace->last_cycles) {
+    /* The cycle count went backwards, e.g. a machine state was loaded */
+    pace_init(pace, pace->khz, cycles);
+    return;
   }
-}
 
-int load_binary_rom(const char *filename, byte *buffer, size_t max_size) {
-  FILE *f = fopen(filename, "rb");
-  size_t bytes_read = 0;
-  if (f == NULL) {
-    fprintf(stderr, "Error: Unable to open ROM file '%s'\n", filename);
-    return -1;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  batch_ns = _elapsed_ns(&pace->last, &now);
+  if (batch_ns > PACE_GAP_NS) {
+    /* Execution was paused, restart from here */
+    pace->start = now;
+    pace->start_cycles = cycles;
+  } else {
+    pace->run_cycles += cycles - pace->last_cycles;
+    pace->run_seconds += batch_ns / 1e9;
+  }
+  pace->last = now;
+  pace->last_cycles = cycles;
+
+  if (pace->khz == 0) return;
+
+  /* One kHz is one cycle per millisecond, 1e6 ns */
+  target_ns = (double)(cycles - pace->start_cycles) * 1e6 / (double)pace->khz;
+  ahead_ns = target_ns - _elapsed_ns(&pace->start, &now);
+  if (ahead_ns > 0) {
+    delay.tv_sec = (time_t)(ahead_ns / 1e9);
+    delay.tv_nsec = (long)(ahead_ns - (double)delay.tv_sec * 1e9);
+    nanosleep(&delay, NULL);
+  } else if (-ahead_ns > PACE_MAX_LAG_NS) {
+    /* Too far behind to catch up, the host is simply too slow */
+    pace->start = now;
+    pace->start_cycles = cycles;
   }
-  bytes_read = fread(buffer, 1, max_size, f);
-  fclose(f);
-  return (int)bytes_read;
 }
 
-int load_woz_rom(const char *filename, byte *buffer, size_t max_size, size_t offset) {
-  /* Woz Format: */
-  /* D000: F5 D6 FA D5 09 DC 8B D8 */
-  FILE *f = fopen(filename, "r");
-  size_t max_offset = 0;
-  if (f == NULL) {
-    fprintf(stderr, "Error: Unable to open ROM file '%s'\n", filename);
-    return -1;
+double pace_achieved_mhz(pace_t *pace) {
+  if (pace->run_seconds <= 0.0) return 0.0;
+  return (double)pace->run_cycles / pace->run_seconds / 1e6;
+}
+
+static void _usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-m MHZ] [-b] [-r LOG | -p LOG] [-t FILE] <romfile> [scriptfile...]\n", name);
+  fprintf(stderr, "       %s -B PROGRAM [-o FILE] [-r LOG] [-t FILE] <romfile>\n", name);
+  fprintf(stderr, "  -m MHZ  target clock speed, 0 for unthrottled (default 1)\n");
+  fprintf(stderr, "  -b      run the ACIAs at the baud rate set by the guest\n");
+  fprintf(stderr, "  -r LOG  record terminal and file input to LOG\n");
+  fprintf(stderr, "  -p LOG  replay the input recorded in LOG, unthrottled\n");
+  fprintf(stderr, "  -t FILE write a binary instruction trace to FILE\n");
+  fprintf(stderr, "  -B PROGRAM run a BASIC program headless, unthrottled, and exit\n");
+  fprintf(stderr, "  -o FILE write the program's output to FILE instead of stdout\n");
+}
+
+/* Run the script files, or BASIC from reset, then the monitor. */
+static void _run_interactive(vmachine_t *machine, int scripts, char **filenames) {
+  int i;
+
+  puts(V6502C_VERSION);
+  puts(V6502C_COPYRIGHT);
+  puts("");
+
+  if (scripts > 0) {
+    puts("Processing command-line script files...");
+    for (i = 0; i < scripts; i++) {
+      read_file(machine, filenames[i]);
+    }
+  } else {
+    /* No script files provided, start with default settings. */
+    puts("No script files provided, starting with default settings...");
+    sleep(2); /* Give the user time to connect a terminal */
+    V6502C_TRACE = FALSE;
+    V6502C_VERBOSE = TRUE;
+    cpu_reset(&machine->c);
+    cpu_step(&machine->c);
+    cpu_run(&machine->c);
   }
 
-  /* Initialize buffer to zeros */
-  memset(buffer, 0, max_size);
+  puts("Type 'help' for help.");
+  puts("");
 
-  {
-    char line[256];
-    while (fgets(line, sizeof(line), f) != NULL) {
-      char *p = line;
-      unsigned int addr;
-      size_t buf_offset;
-
-      /* Parse the address before the colon */
-      addr = 0;
-      while (*p && *p != ':') {
-        if (*p >= '0' && *p <= '9') {
-          addr = (addr << 4) | (*p - '0');
-        } else if (*p >= 'A' && *p <= 'F') {
-          addr = (addr << 4) | (*p - 'A' + 10);
-        } else if (*p >= 'a' && *p <= 'f') {
-          addr = (addr << 4) | (*p - 'a' + 10);
-        }
-        p++;
-      }
+  monitor_repl(machine, stdin);
 
-      if (*p != ':') {
-        continue; /* Skip lines without a colon */
-      }
-      p++; /* Skip the colon */
+  if (g_pace.run_cycles > 0) {
+    printf("Ran %.0f cycles in %.2f seconds, %.3f MHz\n",
+           (double)g_pace.run_cycles, g_pace.run_seconds,
+           pace_achieved_mhz(&g_pace));
+  }
+}
 
-      /* Calculate buffer offset */
-      if (addr < offset) {
-        continue; /* Address is below our offset, skip */
-      }
-      buf_offset = addr - offset;
-      if (buf_offset >= max_size) {
-        continue; /* Address is outside our buffer range, skip */
-      }
+/*
+ * Build the ACIA1 input for a batch run in a temporary file: answers to
+ * the MEMORY SIZE and TERMINAL WIDTH prompts, the program with its line
+ * endings turned into carriage returns, and RUN. The ACIA reads through
+ * a file descriptor, so the input cannot simply live in memory.
+ */
+static FILE *_batch_input(const char *filename) {
+  FILE *f, *input;
+  int ch, last = 0;
 
-      /* Parse hex bytes */
-      while (*p) {
-        unsigned int byte_val;
-        int nibbles = 0;
-
-        /* Skip whitespace */
-        while (*p == ' ' || *p == '\t') {
-          p++;
-        }
-
-        if (*p == '\0' || *p == '\n' || *p == '\r') {
-          break;
-        }
-
-        /* Parse a hex byte (1 or 2 nibbles) */
-        byte_val = 0;
-        while (nibbles < 2) {
-          if (*p >= '0' && *p <= '9') {
-            byte_val = (byte_val << 4) | (*p - '0');
-            nibbles++;
-            p++;
-          } else if (*p >= 'A' && *p <= 'F') {
-            byte_val = (byte_val << 4) | (*p - 'A' + 10);
-            nibbles++;
-            p++;
-          } else if (*p >= 'a' && *p <= 'f') {
-            byte_val = (byte_val << 4) | (*p - 'a' + 10);
-            nibbles++;
-            p++;
-          } else {
-            break;
-          }
-        }
-
-        if (nibbles > 0 && buf_offset < max_size) {
-          buffer[buf_offset] = (byte)byte_val;
-          buf_offset++;
-          if (buf_offset > max_offset) {
-            max_offset = buf_offset;
-          }
-        }
-      }
+  f = fopen(filename, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Error: Unable to open program file '%s'\n", filename);
+    return NULL;
+  }
+  input = tmpfile();
+  if (input == NULL) {
+    fprintf(stderr, "Error: Unable to create a temporary file\n");
+    fclose(f);
+    return NULL;
+  }
+
+  fputs("\r\r", input);
+  while ((ch = getc(f)) != EOF) {
+    if (ch == '\n') {
+      if (last != '\r') putc('\r', input);
+    } else {
+      putc(ch, input);
     }
+    last = ch;
   }
+  if (last != 0 && last != '\r' && last != '\n') putc('\r', input);
+  fputs("RUN\r", input);
   fclose(f);
-  return (int)max_offset;
+
+  if (fflush(input) != 0) {
+    fprintf(stderr, "Error: Unable to write a temporary file\n");
+    fclose(input);
+    return NULL;
+  }
+  rewind(input);
+  return input;
+}
+
+/*
+ * Run the machine from reset until the program has finished and BASIC
+ * waits for input that will never come, or the CPU stops. There is no
+ * pacing and no host idling. The statistics go to stderr, stdout may
+ * hold the program's output.
+ */
+static void _run_batch(vmachine_t *machine) {
+  struct timespec start, end;
+  count_t instructions = 0;
+  count_t cycles;
+  double seconds;
+
+  machine->host_idle = FALSE;
+  machine->halt_at_eof = TRUE;
+  machine->acia1->tx_flush_newline = 0;
+  V6502C_TRACE = FALSE;
+  V6502C_VERBOSE = FALSE;
+
+  cpu_reset(&machine->c);
+  cycles = machine->c.cycles;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (!machine->c.halted && !machine->c.stopped) {
+    cpu_step(&machine->c);
+    machine_tick(machine);
+    instructions++;
+  }
+  machine_flush(machine);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  seconds = _elapsed_ns(&start, &end) / 1e9;
+  fprintf(stderr, "Ran %.0f instructions, %.0f cycles in %.3f seconds",
+          (double)instructions, (double)(machine->c.cycles - cycles), seconds);
+  if (seconds > 0.0) {
+    fprintf(stderr, ", %.3f MIPS", (double)instructions / seconds / 1e6);
+  }
+  fputc('\n', stderr);
 }
 
-int load_rom(const char *filename, byte *buffer, size_t max_size, size_t offset) {
-  /* Determine file type by extension */
-  const char *ext = strrchr(filename, '.');
-  if (ext != NULL) {
-    if (strcmp(ext, ".woz") == 0) {
-      /* Load WOZ format ROM */
-      return load_woz_rom(filename, buffer, max_size, offset);
+void signal_handler(int sig) {
+  switch (sig) {
+  case SIGINT:
+    if (g_machine != NULL) {
+      puts("BREAK");
+      cpu_halt(&g_machine->c);
     }
+    signal(SIGINT, signal_handler);
   }
-  /* Default to binary ROM */
-  return load_binary_rom(filename, buffer, max_size);
 }
 
 #if defined(__CREATE_PTYS__)
@@ -280,52 +342,122 @@ void pty_destroy(pty_handle_t *pty) {
 #endif /* __CREATE_PTYS__ */
 
 int main(int argc, char** argv) {
-  int i;
+  int first_arg = 1;
   vmachine_t machine;
   vmachine_config_t config;
-
-  byte rom_data[VMACHINE_ROM_SIZE];
-  size_t rom_size = 0;
-  char *rom_filename = argv[1];
+  unsigned long khz = PACE_DEFAULT_KHZ;
+  double mhz = 0.0;
+  char *end = NULL;
+  bool baud_timing = FALSE;
+  char *record_filename = NULL;
+  char *replay_filename = NULL;
+  vreplay_t *input_log = NULL;
+  char *trace_filename = NULL;
+  vtrace_t *trace = NULL;
+  char *batch_filename = NULL;
+  char *output_filename = NULL;
+  FILE *batch_input = NULL;
+  FILE *batch_output = NULL;
+  FILE *info;
+
+  rom_image_t rom;
+  char *rom_filename = NULL;
 
 #if defined(__CREATE_PTYS__)
   pty_handle_t *pty1 = NULL;
   pty_handle_t *pty2 = NULL;
 #endif
 
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s <romfile> [scriptfile...]\n", argv[0]);
+  /* Parse options */
+  while (first_arg < argc && argv[first_arg][0] == '-') {
+    if (!strcmp("-m", argv[first_arg]) && first_arg + 1 < argc) {
+      mhz = strtod(argv[first_arg + 1], &end);
+      if (*end != '\0' || mhz < 0.0) {
+        fprintf(stderr, "Invalid clock speed: %s\n", argv[first_arg + 1]);
+        return 1;
+      }
+      khz = (unsigned long)(mhz * 1000.0 + 0.5);
+      first_arg += 2;
+    } else if (!strcmp("-b", argv[first_arg])) {
+      baud_timing = TRUE;
+      first_arg++;
+    } else if (!strcmp("-r", argv[first_arg]) && first_arg + 1 < argc) {
+      record_filename = argv[first_arg + 1];
+      first_arg += 2;
+    } else if (!strcmp("-p", argv[first_arg]) && first_arg + 1 < argc) {
+      replay_filename = argv[first_arg + 1];
+      first_arg += 2;
+    } else if (!strcmp("-t", argv[first_arg]) && first_arg + 1 < argc) {
+      trace_filename = argv[first_arg + 1];
+      first_arg += 2;
+    } else if (!strcmp("-B", argv[first_arg]) && first_arg + 1 < argc) {
+      batch_filename = argv[first_arg + 1];
+      first_arg += 2;
+    } else if (!strcmp("-o", argv[first_arg]) && first_arg + 1 < argc) {
+      output_filename = argv[first_arg + 1];
+      first_arg += 2;
+    } else {
+      _usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (first_arg >= argc || (record_filename != NULL && replay_filename != NULL) ||
+      (batch_filename != NULL && (replay_filename != NULL || argc > first_arg + 1)) ||
+      (output_filename != NULL && batch_filename == NULL)) {
+    _usage(argv[0]);
     return 1;
   }
+  rom_filename = argv[first_arg];
 
   /* Load ROM */
-  rom_size = load_rom(rom_filename, rom_data, sizeof(rom_data), VMACHINE_ROM_START);
-  if (rom_size < 0) {
+  if (rom_image_open(&rom, rom_filename, VMACHINE_ROM_START, VMACHINE_ROM_SIZE) < 0) {
     return 1;
   }
-  printf("Loaded ROM: %s, Size: %d bytes\n", rom_filename, (int)rom_size);
 
-#if defined(__CREATE_PTYS__)
-  /* Allocate PTYs for ACIA devices */
-  pty1 = pty_alloc();
-  if (pty1 == NULL) {
-    fprintf(stderr, "Warning: Failed to allocate PTY for ACIA1\n");
+  if (batch_filename != NULL) {
+    batch_input = _batch_input(batch_filename);
+    if (batch_input == NULL) {
+      rom_image_close(&rom);
+      return 1;
+    }
+    batch_output = stdout;
+    if (output_filename != NULL) {
+      batch_output = fopen(output_filename, "w");
+      if (batch_output == NULL) {
+        fprintf(stderr, "Error: Unable to create output file '%s'\n", output_filename);
+        fclose(batch_input);
+        rom_image_close(&rom);
+        return 1;
+      }
+    }
   } else {
-    printf("ACIA1 PTY: %s\n", pty1->slave_name);
+    printf("Loaded ROM: %s, Size: %d bytes\n", rom_filename, (int)rom.size);
   }
 
-  pty2 = pty_alloc();
-  if (pty2 == NULL) {
-    fprintf(stderr, "Warning: Failed to allocate PTY for ACIA2\n");
-  } else {
-    printf("ACIA2 PTY: %s\n", pty2->slave_name);
+#if defined(__CREATE_PTYS__)
+  /* Allocate PTYs for ACIA devices, a batch run needs none */
+  if (batch_filename == NULL) {
+    pty1 = pty_alloc();
+    if (pty1 == NULL) {
+      fprintf(stderr, "Warning: Failed to allocate PTY for ACIA1\n");
+    } else {
+      printf("ACIA1 PTY: %s\n", pty1->slave_name);
+    }
+
+    pty2 = pty_alloc();
+    if (pty2 == NULL) {
+      fprintf(stderr, "Warning: Failed to allocate PTY for ACIA2\n");
+    } else {
+      printf("ACIA2 PTY: %s\n", pty2->slave_name);
+    }
   }
 #endif
 
   /* Initialize VM configuration */
   memset(&config, 0, sizeof(config));
-  config.rom_data = rom_data;
-  config.rom_size = rom_size;
+  config.rom_data = rom.data;
+  config.rom_size = rom.size;
 
 #if defined(__CREATE_PTYS__)
   config.acia1_input = pty1 ? pty1->file : NULL;
@@ -338,42 +470,91 @@ int main(int argc, char** argv) {
   config.acia2_input = NULL;
   config.acia2_output = NULL;
 #endif
+  if (batch_filename != NULL) {
+    config.acia1_input = batch_input;
+    config.acia1_output = batch_output;
+    config.acia2_input = NULL;
+    config.acia2_output = NULL;
+  }
 
   init_vmachine(&machine, &config);
+  rom_image_close(&rom);
   g_machine = &machine;
-  machine.c.read = _read;
-  machine.c.write = _write;
-  machine.c.tick = _tick;
+  machine.c.tick_ctx = _tick;
   machine.trace_fn = monitor_trace_fn;
+  pace_init(&g_pace, khz, machine.c.cycles);
+  machine.clock_khz = khz;
+  if (baud_timing) {
+    /* Frames are timed in emulated cycles at the paced clock speed */
+    machine.acia1->timing = TRUE;
+    machine.acia2->timing = TRUE;
+    if (khz > 0) {
+      machine.acia1->clock_hz = khz * 1000UL;
+      machine.acia2->clock_hz = khz * 1000UL;
+    }
+  }
 
-  signal(SIGINT, signal_handler);
-
-  puts(V6502C_VERSION);
-  puts(V6502C_COPYRIGHT);
-  puts("");
-
-  if (argc > 2) {
-    puts("Processing command-line script files...");
-    for (i = 2; i < argc; i++) {
-      read_file(&machine, argv[i]);
+  /* The log must cover the machine from its first instruction */
+  if (record_filename != NULL) {
+    input_log = vreplay_record(record_filename);
+    if (input_log == NULL) {
+      fprintf(stderr, "Could not create input log: %s\n", record_filename);
+      cleanup_vmachine(&machine);
+      return 1;
     }
-  } else {
-    /* No script files provided, start with default settings. */
-    puts("No script files provided, starting with default settings...");
-    sleep(2); /* Give the user time to connect a terminal */
-    V6502C_TRACE = FALSE;
-    V6502C_VERBOSE = TRUE;
-    cpu_reset(&machine.c);
-    cpu_step(&machine.c);
-    cpu_run(&machine.c);
+  } else if (replay_filename != NULL) {
+    input_log = vreplay_open(replay_filename);
+    if (input_log == NULL) {
+      fprintf(stderr, "Could not open input log: %s\n", replay_filename);
+      cleanup_vmachine(&machine);
+      return 1;
+    }
+    /* Timing comes from the log, there is nothing to wait for */
+    pace_init(&g_pace, 0, machine.c.cycles);
+  }
+  machine_set_input_log(&machine, input_log);
+
+  if (trace_filename != NULL) {
+    trace = vtrace_open(trace_filename, VTRACE_DEFAULT_BUFFER);
+    if (trace == NULL) {
+      fprintf(stderr, "Could not create trace file: %s\n", trace_filename);
+      cleanup_vmachine(&machine);
+      return 1;
+    }
+    machine_set_trace(&machine, trace);
   }
 
-  puts("Type 'help' for help.");
-  puts("");
+  signal(SIGINT, signal_handler);
 
-  monitor_repl(&machine, stdin);
+  if (batch_filename != NULL) {
+    _run_batch(&machine);
+  } else {
+    _run_interactive(&machine, argc - first_arg - 1, argv + first_arg + 1);
+  }
 
+  /* In a batch run stdout may hold the program's output */
+  info = batch_filename != NULL ? stderr : stdout;
+  if (input_log != NULL) {
+    fprintf(info, "%s %lu input events\n", input_log->replaying ? "Replayed" : "Recorded",
+            input_log->events);
+  }
+  machine_set_input_log(&machine, NULL);
+  if (vreplay_close(input_log) != 0) {
+    fprintf(stderr, "Error writing the input log\n");
+  }
+  if (machine.trace != NULL) {
+    fprintf(info, "Traced %lu instructions\n", machine.trace->records);
+    if (machine_set_trace(&machine, NULL) != 0) {
+      fprintf(stderr, "Error writing the trace file\n");
+    }
+  }
   cleanup_vmachine(&machine);
+  if (batch_input != NULL) {
+    fclose(batch_input);
+  }
+  if (batch_output != NULL && batch_output != stdout) {
+    fclose(batch_output);
+  }
 
 #if defined(__CREATE_PTYS__)
   if (pty1 != NULL) {
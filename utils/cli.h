@@ -7,8 +7,11 @@
 #define _XOPEN_SOURCE 600
 
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <vtypes.h>
+
 /**
  * Copyright (c) 2025 Andrew C. Young
  *
@@ -34,6 +37,39 @@
  *
  */
 
+/**
+ * Pacing governor.
+ * Every PACE_BATCH_CYCLES emulated cycles the governor compares the
+ * cycles run against a monotonic clock and sleeps once to hold the
+ * target frequency. If the emulator falls more than PACE_MAX_LAG_NS
+ * behind, or a batch took longer than PACE_GAP_NS because execution
+ * was paused, it starts over from the current time instead of racing
+ * to catch up.
+ */
+#define PACE_BATCH_CYCLES 10000
+#define PACE_MAX_LAG_NS   50000000L
+#define PACE_GAP_NS       250000000L
+#define PACE_DEFAULT_KHZ  1000
+
+typedef struct pace {
+  unsigned long khz;       /* Target frequency in kHz, 0 for unthrottled */
+  count_t start_cycles;    /* Cycle count at the pacing reference point */
+  struct timespec start;   /* Time at the pacing reference point */
+  count_t last_cycles;     /* Cycle count at the last check */
+  struct timespec last;    /* Time at the last check */
+  count_t run_cycles;      /* Cycles run, excluding pauses */
+  double run_seconds;      /* Time spent running, excluding pauses */
+} pace_t;
+
+/** Start pacing from the given cycle count. */
+void pace_init(pace_t *pace, unsigned long khz, count_t cycles);
+
+/** Call after every instruction. Sleeps when ahead of the target. */
+void pace_tick(pace_t *pace, count_t cycles);
+
+/** Achieved frequency in MHz while running. */
+double pace_achieved_mhz(pace_t *pace);
+
 #if defined(__CREATE_PTYS__)
 
 /**
@@ -0,0 +1,229 @@
+/**
+ * profreport - Summarize an execution profile by routine
+ *
+ * Usage: profreport [-n COUNT] <profile> [labelfile]
+ *        profreport -c <stacks> <labelfile>
+ *
+ * Reads a profile saved with the monitor's PROFILE SAVE command and
+ * prints the routines that used the most cycles. Each address is
+ * charged to the nearest label at or below it, taken from an ld65 label
+ * file (ld65 -Ln, e.g. msbasic/tmp/v6502c.lbl). Without a label file
+ * every address is reported on its own.
+ *
+ * With -c it instead replaces the $XXXX addresses in a collapsed stack
+ * file saved with CALLS SAVE by their labels, ready for flame graph
+ * tools.
+ *
+ * Copyright 2025 Andrew C. Young
+ * LICENSE: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADDRESSES 0x10000
+#define NAME_SIZE 64
+#define LINE_SIZE 256
+
+typedef struct {
+    char name[NAME_SIZE];
+    unsigned int start;
+    double instructions;
+    double cycles;
+} routine_t;
+
+static double instructions[ADDRESSES];
+static double cycles[ADDRESSES];
+
+/* Label index for each address, -1 if none */
+static long labels[ADDRESSES];
+
+static routine_t *routines = NULL;
+static long routine_count = 0;
+
+static int add_routine(const char *name, unsigned int start) {
+    routine_t *r;
+
+    if (routine_count % 256 == 0) {
+        r = (routine_t *)realloc(routines, (routine_count + 256) * sizeof(routine_t));
+        if (r == NULL) return 0;
+        routines = r;
+    }
+    r = &routines[routine_count++];
+    strncpy(r->name, name, NAME_SIZE - 1);
+    r->name[NAME_SIZE - 1] = '\0';
+    r->start = start;
+    r->instructions = 0;
+    r->cycles = 0;
+    return 1;
+}
+
+/* Read "al 00E000 .NAME" lines. The first label at an address wins. */
+static int read_labels(const char *filename) {
+    FILE *f;
+    char line[LINE_SIZE];
+    char name[LINE_SIZE];
+    unsigned int a;
+    long i;
+
+    f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "al %x .%255s", &a, name) != 2) continue;
+        if (a >= ADDRESSES || name[0] == '@' || labels[a] >= 0) continue;
+        if (!add_routine(name, a)) {
+            fprintf(stderr, "Error: Out of memory\n");
+            fclose(f);
+            return 0;
+        }
+        labels[a] = routine_count - 1;
+    }
+    fclose(f);
+
+    /* Fill the gaps so every address points at the label below it */
+    for (i = 1; i < ADDRESSES; i++) {
+        if (labels[i] < 0) labels[i] = labels[i - 1];
+    }
+    return 1;
+}
+
+static int read_profile(const char *filename) {
+    FILE *f;
+    char line[LINE_SIZE];
+    unsigned int a;
+    double n, c;
+
+    f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == ';') continue;
+        if (sscanf(line, "%x %lf %lf", &a, &n, &c) != 3 || a >= ADDRESSES) {
+            fprintf(stderr, "Error: Invalid profile line '%s'\n", line);
+            fclose(f);
+            return 0;
+        }
+        instructions[a] += n;
+        cycles[a] += c;
+    }
+    fclose(f);
+    return 1;
+}
+
+/* Print a collapsed stack file with its addresses replaced by labels. */
+static int symbolize(const char *filename) {
+    FILE *f;
+    char line[4096];
+    char *p;
+    unsigned int a;
+    int n;
+    routine_t *r;
+
+    f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        for (p = line; *p; p++) {
+            if (*p == '$' && sscanf(p + 1, "%4x%n", &a, &n) == 1 && n == 4 &&
+                labels[a] >= 0) {
+                r = &routines[labels[a]];
+                if (r->start == a) {
+                    fputs(r->name, stdout);
+                } else {
+                    printf("%s+%u", r->name, a - r->start);
+                }
+                p += n;
+            } else {
+                putchar(*p);
+            }
+        }
+    }
+    fclose(f);
+    return 1;
+}
+
+static int by_cycles(const void *a, const void *b) {
+    const routine_t *ra = (const routine_t *)a;
+    const routine_t *rb = (const routine_t *)b;
+
+    if (ra->cycles != rb->cycles) return ra->cycles < rb->cycles ? 1 : -1;
+    return ra->start < rb->start ? -1 : 1;
+}
+
+int main(int argc, char **argv) {
+    char name[NAME_SIZE];
+    double total_cycles = 0;
+    double total_instructions = 0;
+    long count = 30;
+    long unlabeled;
+    long i;
+    int arg = 1;
+
+    for (i = 0; i < ADDRESSES; i++) {
+        labels[i] = -1;
+    }
+
+    if (argc == 4 && !strcmp("-c", argv[1])) {
+        if (!read_labels(argv[3]) || !symbolize(argv[2])) return 1;
+        free(routines);
+        return 0;
+    }
+    if (arg + 1 < argc && !strcmp("-n", argv[arg])) {
+        count = atol(argv[arg + 1]);
+        arg += 2;
+    }
+    if (argc - arg < 1 || argc - arg > 2) {
+        fprintf(stderr, "Usage: %s [-n COUNT] <profile> [labelfile]\n", argv[0]);
+        fprintf(stderr, "       %s -c <stacks> <labelfile>\n", argv[0]);
+        fprintf(stderr, "  -n COUNT  number of routines to print (default 30)\n");
+        fprintf(stderr, "  -c        label the addresses in a collapsed stack file\n");
+        return 1;
+    }
+    if (argc - arg == 2 && !read_labels(argv[arg + 1])) return 1;
+    if (!read_profile(argv[arg])) return 1;
+
+    /* Addresses without a label below them get a routine each */
+    unlabeled = routine_count;
+    for (i = 0; i < ADDRESSES; i++) {
+        if (instructions[i] == 0 || labels[i] >= 0) continue;
+        sprintf(name, "$%04lX", i);
+        if (!add_routine(name, (unsigned int)i)) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 1;
+        }
+        labels[i] = routine_count - 1;
+    }
+
+    for (i = 0; i < ADDRESSES; i++) {
+        if (instructions[i] == 0) continue;
+        routines[labels[i]].instructions += instructions[i];
+        routines[labels[i]].cycles += cycles[i];
+        total_instructions += instructions[i];
+        total_cycles += cycles[i];
+    }
+    if (total_cycles == 0) {
+        printf("The profile is empty.\n");
+        return 0;
+    }
+
+    qsort(routines, routine_count, sizeof(routine_t), by_cycles);
+    printf("%14s %6s %14s  %-5s %s\n", "Cycles", "%", "Instructions", "Addr", "Routine");
+    for (i = 0; i < routine_count && i < count && routines[i].cycles > 0; i++) {
+        printf("%14.0f %6.2f %14.0f  %04X  %s\n",
+               routines[i].cycles, 100.0 * routines[i].cycles / total_cycles,
+               routines[i].instructions, routines[i].start, routines[i].name);
+    }
+    printf("%14.0f %6.2f %14.0f  Total, %ld unlabeled addresses\n",
+           total_cycles, 100.0, total_instructions, routine_count - unlabeled);
+
+    free(routines);
+    return 0;
+}
@@ -0,0 +1,207 @@
+/**
+ * tracedump - Print a binary instruction trace
+ *
+ * Usage: tracedump [options] <tracefile>
+ *
+ * Prints one line per traced instruction: the cycle count, PC,
+ * instruction bytes, disassembly, effective address and registers
+ * before the instruction ran. See src/vtrace.h for the file format.
+ *
+ * Copyright 2025 Andrew C. Young
+ * LICENSE: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inst.h"
+#include "vtrace.h"
+
+#define _NAME_ENTRY(op, i, m) #i,
+
+/* Instruction names, without the I_ prefix of the enum */
+static const char *names[] = {
+    V6502_OPCODES(_NAME_ENTRY)
+};
+
+typedef struct {
+    count_t cycles;
+    unsigned int pc;
+    unsigned int ea;
+    byte op[3];
+    byte a, x, y, sr, sp;
+} record_t;
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [options] <tracefile>\n", name);
+    fprintf(stderr, "  -p FFFF.FFFF  only instructions with the PC in the range\n");
+    fprintf(stderr, "  -e FFFF.FFFF  only instructions that access the range\n");
+    fprintf(stderr, "  -i NAME       only this instruction, e.g. JSR\n");
+    fprintf(stderr, "  -s CYCLE      skip instructions before the cycle count\n");
+    fprintf(stderr, "  -n COUNT      stop after printing COUNT instructions\n");
+}
+
+static int parse_range(const char *s, unsigned int *start, unsigned int *end) {
+    if (sscanf(s, "%x.%x", start, end) == 2) return *start <= *end;
+    if (sscanf(s, "%x", start) == 1) {
+        *end = *start;
+        return 1;
+    }
+    return 0;
+}
+
+static void decode(const byte *r, record_t *rec) {
+    int i;
+
+    rec->cycles = 0;
+    for (i = 7; i >= 0; i--) {
+        rec->cycles = (rec->cycles << 8) | r[i];
+    }
+    rec->pc = r[8] | (r[9] << 8);
+    rec->ea = r[10] | (r[11] << 8);
+    rec->op[0] = r[12];
+    rec->op[1] = r[13];
+    rec->op[2] = r[14];
+    rec->a = r[15];
+    rec->x = r[16];
+    rec->y = r[17];
+    rec->sr = r[18];
+    rec->sp = r[19];
+}
+
+/* Whether the instruction has an effective address */
+static int has_ea(byte op) {
+    switch (addressings[op]) {
+    case A_ACC:
+    case A_IMP:
+    case A_IMM:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+/* Disassemble an instruction. Returns its length in bytes. */
+static int disassemble(const record_t *rec, char *out) {
+    const char *name = names[rec->op[0]] + 2;
+    unsigned int word = rec->op[1] | (rec->op[2] << 8);
+
+    switch (addressings[rec->op[0]]) {
+    case A_ACC: sprintf(out, "%s A", name); return 1;
+    case A_IMP: sprintf(out, "%s", name); return 1;
+    case A_IMM: sprintf(out, "%s #$%02X", name, rec->op[1]); return 2;
+    case A_REL: sprintf(out, "%s $%04X", name, rec->ea); return 2;
+    case A_ZPG: sprintf(out, "%s $%02X", name, rec->op[1]); return 2;
+    case A_ZPX: sprintf(out, "%s $%02X,X", name, rec->op[1]); return 2;
+    case A_ZPY: sprintf(out, "%s $%02X,Y", name, rec->op[1]); return 2;
+    case A_INX: sprintf(out, "%s ($%02X,X)", name, rec->op[1]); return 2;
+    case A_INY: sprintf(out, "%s ($%02X),Y", name, rec->op[1]); return 2;
+    case A_ZPI: sprintf(out, "%s ($%02X)", name, rec->op[1]); return 2;
+    case A_ABS: sprintf(out, "%s $%04X", name, word); return 3;
+    case A_ABX: sprintf(out, "%s $%04X,X", name, word); return 3;
+    case A_ABY: sprintf(out, "%s $%04X,Y", name, word); return 3;
+    case A_IND: sprintf(out, "%s ($%04X)", name, word); return 3;
+    case A_ABI: sprintf(out, "%s ($%04X,X)", name, word); return 3;
+    }
+    sprintf(out, "%s", name);
+    return 1;
+}
+
+static void print_record(const record_t *rec) {
+    char text[32];
+    char bytes[16];
+    int length = disassemble(rec, text);
+
+    if (length == 1) {
+        sprintf(bytes, "%02X", rec->op[0]);
+    } else if (length == 2) {
+        sprintf(bytes, "%02X %02X", rec->op[0], rec->op[1]);
+    } else {
+        sprintf(bytes, "%02X %02X %02X", rec->op[0], rec->op[1], rec->op[2]);
+    }
+    printf("%12.0f  %04X  %-8s  %-14s", (double)rec->cycles, rec->pc, bytes, text);
+    if (has_ea(rec->op[0])) {
+        printf("  %04X", rec->ea);
+    } else {
+        printf("      ");
+    }
+    printf("  A=%02X X=%02X Y=%02X SR=%02X SP=%02X\n",
+           rec->a, rec->x, rec->y, rec->sr, rec->sp);
+}
+
+int main(int argc, char **argv) {
+    FILE *f;
+    byte header[VTRACE_HEADER_SIZE];
+    byte r[VTRACE_RECORD_SIZE];
+    record_t rec;
+    unsigned int pc_start = 0, pc_end = 0xFFFF;
+    unsigned int ea_start = 0, ea_end = 0xFFFF;
+    int ea_filter = 0;
+    const char *only = NULL;
+    double skip = 0;
+    long count = -1;
+    long printed = 0;
+    int arg = 1;
+
+    while (arg < argc && argv[arg][0] == '-') {
+        if (arg + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (!strcmp("-p", argv[arg])) {
+            if (!parse_range(argv[arg + 1], &pc_start, &pc_end)) {
+                fprintf(stderr, "Error: Invalid address range '%s'\n", argv[arg + 1]);
+                return 1;
+            }
+        } else if (!strcmp("-e", argv[arg])) {
+            if (!parse_range(argv[arg + 1], &ea_start, &ea_end)) {
+                fprintf(stderr, "Error: Invalid address range '%s'\n", argv[arg + 1]);
+                return 1;
+            }
+            ea_filter = 1;
+        } else if (!strcmp("-i", argv[arg])) {
+            only = argv[arg + 1];
+        } else if (!strcmp("-s", argv[arg])) {
+            skip = atof(argv[arg + 1]);
+        } else if (!strcmp("-n", argv[arg])) {
+            count = atol(argv[arg + 1]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        arg += 2;
+    }
+    if (arg != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    f = fopen(argv[arg], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", argv[arg]);
+        return 1;
+    }
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) ||
+        memcmp(header, VTRACE_MAGIC, 4) != 0 ||
+        (header[4] | (header[5] << 8)) != VTRACE_VERSION ||
+        (header[6] | (header[7] << 8)) != VTRACE_RECORD_SIZE) {
+        fprintf(stderr, "Error: '%s' is not a v6502c trace\n", argv[arg]);
+        fclose(f);
+        return 1;
+    }
+
+    while (count != 0 && fread(r, 1, sizeof(r), f) == sizeof(r)) {
+        decode(r, &rec);
+        if ((double)rec.cycles < skip) continue;
+        if (rec.pc < pc_start || rec.pc > pc_end) continue;
+        if (ea_filter && (!has_ea(rec.op[0]) || rec.ea < ea_start || rec.ea > ea_end)) continue;
+        if (only != NULL && strcmp(only, names[rec.op[0]] + 2) != 0) continue;
+        print_record(&rec);
+        printed++;
+        if (count > 0 && printed == count) break;
+    }
+
+    fclose(f);
+    return 0;
+}